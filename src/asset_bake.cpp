@@ -0,0 +1,96 @@
+// Offline converter from the .norm.txt text assets to the binary .mesh
+// container loaded by the renderer.
+//
+//	asset_bake ../assets/teapot_bezier0.norm.txt ../assets/teapot_bezier0.mesh
+
+#include "mesh.hpp"
+#include "mesh_bake.hpp"
+#include "mesh_file.hpp"
+#include "mesh_optimize.hpp"
+#include "mesh_quantize.hpp"
+#include "norm_txt_loader.hpp"
+#include "thread_pool.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void usage() {
+	fprintf(stderr,
+		"usage: asset_bake [options] <input.norm.txt> <output.mesh>\n"
+		"  --weld-epsilon <e>  merge vertices closer than e "
+		"(default %g)\n"
+		"  --no-weld           keep the unindexed triangle list\n"
+		"  --no-lods           skip the simplified levels of detail\n"
+		"  --no-meshlets       skip meshlet clustering\n"
+		"  --no-optimize       keep the triangle and vertex order\n"
+		"  --no-bvh            skip the triangle BVH for ray queries\n"
+		"  --cache-size <n>    vertex cache entries to optimize for "
+		"(default %u)\n"
+		"  --overdraw-threshold <f>\n"
+		"                      ACMR increase allowed for overdraw "
+		"(default %g)\n"
+		"  --vertex-format float|quantized\n"
+		"                      vertex encoding (default quantized)\n",
+		mesh_bake_defaults().weld_epsilon, MESH_VERTEX_CACHE_SIZE,
+		MESH_OVERDRAW_THRESHOLD);
+}
+
+int main(int argc, char **argv) {
+	MeshBakeOptions options = mesh_bake_defaults();
+	MeshVertexFormat vertex_format = MESH_VERTEX_QUANTIZED;
+	int arg = 1;
+	for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+		if (strcmp(argv[arg], "--weld-epsilon") == 0 &&
+		    arg + 1 < argc) {
+			options.weld_epsilon = atof(argv[++arg]);
+		} else if (strcmp(argv[arg], "--no-weld") == 0) {
+			options.weld = false;
+		} else if (strcmp(argv[arg], "--no-lods") == 0) {
+			options.lods = false;
+		} else if (strcmp(argv[arg], "--no-meshlets") == 0) {
+			options.meshlets = false;
+		} else if (strcmp(argv[arg], "--no-optimize") == 0) {
+			options.optimize = false;
+		} else if (strcmp(argv[arg], "--no-bvh") == 0) {
+			options.bvh = false;
+		} else if (strcmp(argv[arg], "--cache-size") == 0 &&
+			   arg + 1 < argc) {
+			options.cache_size = atoi(argv[++arg]);
+		} else if (strcmp(argv[arg], "--overdraw-threshold") == 0 &&
+			   arg + 1 < argc) {
+			options.overdraw_threshold = atof(argv[++arg]);
+		} else if (strcmp(argv[arg], "--vertex-format") == 0 &&
+			   arg + 1 < argc &&
+			   mesh_vertex_format_parse(argv[arg + 1],
+						    &vertex_format)) {
+			arg++;
+		} else {
+			usage();
+			return 1;
+		}
+	}
+	if (argc - arg != 2) {
+		usage();
+		return 1;
+	}
+	const char *input_path = argv[arg];
+	const char *output_path = argv[arg + 1];
+
+	ThreadPool pool;
+	Mesh mesh;
+	if (!mesh_load_norm_txt_mapped(input_path, &mesh, &pool)) {
+		return 1;
+	}
+	mesh_bake(input_path, &mesh, options, &pool);
+	MeshQuantizeError error;
+	if (!mesh_file_write(output_path, mesh, vertex_format, &error)) {
+		return 1;
+	}
+	if (vertex_format != MESH_VERTEX_FLOAT) {
+		mesh_quantize_error_print(input_path, error);
+	}
+	printf("%s: %u triangles, %u %s vertices\n", output_path,
+	       mesh.triangleCount(), mesh.vertexCount(),
+	       mesh_vertex_format_name(vertex_format));
+	return 0;
+}
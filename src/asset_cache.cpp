@@ -0,0 +1,157 @@
+#include "asset_cache.hpp"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static inline uint64_t mix(uint64_t h) {
+	// MurmurHash3 finalizer.
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+uint64_t asset_hash(const void *data, size_t size, uint64_t seed) {
+	const uint8_t *p = (const uint8_t *)data;
+	uint64_t h = mix(seed ^ size);
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t w;
+		memcpy(&w, p + i, sizeof(w));
+		h = (h ^ mix(w)) * 0x9e3779b97f4a7c15ull;
+		h ^= h >> 29;
+	}
+	uint64_t tail = 0;
+	if (i < size) {
+		memcpy(&tail, p + i, size - i);
+	}
+	return mix(h ^ mix(tail));
+}
+
+AssetCache::AssetCache(const char *dir) {
+	this->dir = dir;
+	this->dirty = false;
+	this->hits = 0;
+	this->misses = 0;
+	if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "asset cache: cannot create %s\n", dir);
+	}
+	this->load();
+}
+
+AssetCache::~AssetCache() { this->save(); }
+
+// One source per line: hash size mtime_ns path.
+void AssetCache::load() {
+	std::string path = this->dir + "/index";
+	FILE *f = fopen(path.c_str(), "r");
+	if (f == NULL) {
+		return;
+	}
+	char line[4096];
+	while (fgets(line, sizeof(line), f) != NULL) {
+		Source source;
+		int name = 0;
+		if (sscanf(line, "%" SCNx64 " %" SCNu64 " %" SCNd64 " %n",
+			   &source.hash, &source.size, &source.mtime_ns,
+			   &name) != 3 ||
+		    name == 0) {
+			continue;
+		}
+		line[strcspn(line, "\n")] = '\0';
+		this->sources[line + name] = source;
+	}
+	fclose(f);
+}
+
+void AssetCache::save() {
+	if (!this->dirty) {
+		return;
+	}
+	std::string path = this->dir + "/index";
+	std::string tmp_path = path + ".tmp";
+	FILE *f = fopen(tmp_path.c_str(), "w");
+	if (f == NULL) {
+		return;
+	}
+	for (const auto &it : this->sources) {
+		fprintf(f, "%016" PRIx64 " %" PRIu64 " %" PRId64 " %s\n",
+			it.second.hash, it.second.size, it.second.mtime_ns,
+			it.first.c_str());
+	}
+	if (fclose(f) != 0 || rename(tmp_path.c_str(), path.c_str()) != 0) {
+		unlink(tmp_path.c_str());
+		return;
+	}
+	this->dirty = false;
+}
+
+bool AssetCache::sourceHash(const char *path, uint64_t *hash) {
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		return false;
+	}
+	int64_t mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 +
+			   st.st_mtim.tv_nsec;
+	auto it = this->sources.find(path);
+	if (it != this->sources.end() &&
+	    it->second.size == (uint64_t)st.st_size &&
+	    it->second.mtime_ns == mtime_ns) {
+		*hash = it->second.hash;
+		return true;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	const void *data = NULL;
+	if (st.st_size > 0) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			::close(fd);
+			return false;
+		}
+		madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+	}
+	*hash = asset_hash(data, st.st_size, 0);
+	if (data != NULL) {
+		munmap((void *)data, st.st_size);
+	}
+	::close(fd);
+	this->sources[path] = {(uint64_t)st.st_size, mtime_ns, *hash};
+	this->dirty = true;
+	return true;
+}
+
+bool AssetCache::lookup(const char *source, const char *variant,
+			const char *extension, std::string *path) {
+	path->clear();
+	uint64_t hash;
+	if (!this->sourceHash(source, &hash)) {
+		this->misses++;
+		return false;
+	}
+	hash = asset_hash(variant, strlen(variant), hash);
+	char name[32];
+	snprintf(name, sizeof(name), "/%016" PRIx64, hash);
+	*path = this->dir + name + extension;
+	if (access(path->c_str(), R_OK) == 0) {
+		this->hits++;
+		return true;
+	}
+	this->misses++;
+	return false;
+}
+
+void AssetCache::print() const {
+	printf("asset cache %s: %u hits, %u misses\n", this->dir.c_str(),
+	       this->hits, this->misses);
+}
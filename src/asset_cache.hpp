@@ -0,0 +1,58 @@
+#ifndef _ASSET_CACHE_HPP
+#define _ASSET_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// Where derived assets are kept, relative to the build directory like the
+// asset paths.
+#define ASSET_CACHE_DIR "../cache"
+
+// Directory of data derived from source assets, named by a hash of the
+// source content and of a variant string that identifies the importer
+// version and its options. A changed source or importer simply maps to a
+// new file; stale files are never read again.
+//
+// Hashing large sources on every launch would defeat the purpose, so an
+// index remembers each source's size, mtime and hash and the content is
+// only rehashed when the first two change.
+class AssetCache {
+      private:
+	struct Source {
+		uint64_t size;
+		int64_t mtime_ns;
+		uint64_t hash;
+	};
+
+	std::string dir;
+	std::unordered_map<std::string, Source> sources;
+	bool dirty;
+
+	bool sourceHash(const char *path, uint64_t *hash);
+
+	void load();
+
+	void save();
+
+      public:
+	uint32_t hits;
+	uint32_t misses;
+
+	explicit AssetCache(const char *dir);
+	~AssetCache();
+
+	// Sets path to the cache file holding variant of source, extension
+	// appended. Returns true on a hit, false when the file still has to
+	// be produced (or the source cannot be read, path is then empty).
+	bool lookup(const char *source, const char *variant,
+		    const char *extension, std::string *path);
+
+	void print() const;
+};
+
+// 64 bit non-cryptographic hash, for cache keys.
+uint64_t asset_hash(const void *data, size_t size, uint64_t seed);
+
+#endif
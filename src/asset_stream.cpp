@@ -0,0 +1,250 @@
+#include "asset_stream.hpp"
+#include "mesh_bake.hpp"
+#include "mesh_file.hpp"
+#include "norm_txt_loader.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+
+static void upload_mesh_file(GpuMesh *gpu, const MeshFile &file) {
+	// Counts come from the section sizes, MeshFile::open checked that
+	// the header agrees with them.
+	const MeshFileHeader *h = file.header;
+	uint64_t vertices_size = 0;
+	const void *vertices = file.vertices(&vertices_size);
+	uint64_t indices_size = 0;
+	const void *indices = file.indices(&indices_size);
+	uint32_t index_count =
+	    h->index_size > 0 ? indices_size / h->index_size : 0;
+	uint32_t lod_count = 0;
+	const MeshLodRange *lods = file.lods(&lod_count);
+	gpu_mesh_upload(gpu, h->layout, vertices, vertices_size,
+			vertices_size / h->layout.stride, indices, index_count,
+			h->index_size, lods, lod_count);
+	uint32_t meshlet_count = 0;
+	const Meshlet *meshlets = file.meshlets(&meshlet_count);
+	gpu_mesh_set_meshlets(gpu, meshlets, meshlet_count);
+	gpu_mesh_set_format(gpu, (MeshVertexFormat)h->vertex_format,
+			    h->aabb_min, h->aabb_max);
+}
+
+// Uploads a baked .mesh straight from the mapping: the one asset_bake wrote
+// next to the asset if there is one, otherwise the cached bake of the text
+// asset. On a cache miss the text is parsed, processed, encoded in
+// vertex_format and written to the cache; if that fails it is uploaded
+// directly. bvh receives the triangles and BVH for picking, if any.
+static bool load_asset(GpuMesh *gpu, Mesh *bvh, const char *mesh_path,
+		       const char *text_path, MeshVertexFormat vertex_format,
+		       ThreadPool *pool, AssetCache *cache) {
+	MeshFile file;
+	if (file.open(mesh_path)) {
+		upload_mesh_file(gpu, file);
+		mesh_file_read_bvh(file, bvh);
+		return true;
+	}
+	char variant[64];
+	snprintf(variant, sizeof(variant), "mesh %d bake %d %s",
+		 MESH_FILE_VERSION, MESH_BAKE_VERSION,
+		 mesh_vertex_format_name(vertex_format));
+	std::string cache_path;
+	if (cache->lookup(text_path, variant, ".mesh", &cache_path) &&
+	    file.open(cache_path.c_str())) {
+		upload_mesh_file(gpu, file);
+		mesh_file_read_bvh(file, bvh);
+		return true;
+	}
+
+	Mesh mesh;
+	if (!mesh_load_norm_txt_mapped(text_path, &mesh, pool)) {
+		return false;
+	}
+	mesh_bake(text_path, &mesh, mesh_bake_defaults(), pool);
+
+	MeshQuantizeError error;
+	if (!cache_path.empty() &&
+	    mesh_file_write(cache_path.c_str(), mesh, vertex_format, &error) &&
+	    file.open(cache_path.c_str())) {
+		if (vertex_format != MESH_VERTEX_FLOAT) {
+			mesh_quantize_error_print(text_path, error);
+		}
+		upload_mesh_file(gpu, file);
+		mesh_file_read_bvh(file, bvh);
+		return true;
+	}
+
+	float aabb_min[3], aabb_max[3];
+	mesh_bounds(mesh, aabb_min, aabb_max);
+	std::vector<uint8_t> vertices;
+	mesh_encode_vertices(mesh, vertex_format, aabb_min, aabb_max,
+			     &vertices, &error);
+	if (vertex_format != MESH_VERTEX_FLOAT) {
+		mesh_quantize_error_print(text_path, error);
+	}
+	std::vector<uint8_t> indices;
+	std::vector<MeshLodRange> lods;
+	mesh_pack_indices(mesh, &indices, &lods);
+	uint32_t index_size = mesh_index_size(mesh);
+	gpu_mesh_upload(gpu, mesh_layout(vertex_format), vertices.data(),
+			vertices.size(), mesh.vertexCount(), indices.data(),
+			indices.size() / index_size, index_size, lods.data(),
+			lods.size());
+	gpu_mesh_set_meshlets(gpu, mesh.meshlets.data(), mesh.meshlets.size());
+	gpu_mesh_set_format(gpu, vertex_format, aabb_min, aabb_max);
+	mesh.lods.clear();
+	mesh.meshlets.clear();
+	*bvh = std::move(mesh);
+	return true;
+}
+
+AssetStreamer::AssetStreamer(GLFWwindow *window, ThreadPool *pool,
+			     AssetCache *cache,
+			     MeshVertexFormat vertex_format) {
+	this->pool = pool;
+	this->cache = cache;
+	this->vertex_format = vertex_format;
+	this->stopping = false;
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	this->context = glfwCreateWindow(1, 1, "loader", NULL, window);
+	glfwDefaultWindowHints();
+	if (this->context == NULL) {
+		fprintf(stderr, "no shared context, loading assets on the "
+				"render thread\n");
+		return;
+	}
+	this->worker = std::thread(&AssetStreamer::run, this);
+}
+
+AssetStreamer::~AssetStreamer() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->wake.notify_all();
+	if (this->worker.joinable()) {
+		this->worker.join();
+	}
+	for (StreamedAsset *asset : this->assets) {
+		int state = asset->state;
+		if (state == ASSET_UPLOADED) {
+			glDeleteSync(asset->fence);
+		}
+		if (state == ASSET_UPLOADED || state == ASSET_RESIDENT) {
+			gpu_mesh_destroy(&asset->gpu);
+		}
+		delete asset;
+	}
+	if (this->context != NULL) {
+		glfwDestroyWindow(this->context);
+	}
+}
+
+// Loads asset with whatever context is current and fences the upload.
+static bool load_and_fence(StreamedAsset *asset,
+			   MeshVertexFormat vertex_format, ThreadPool *pool,
+			   AssetCache *cache) {
+	if (!load_asset(&asset->gpu, &asset->bvh, asset->mesh_path.c_str(),
+			asset->text_path.c_str(), vertex_format, pool, cache)) {
+		fprintf(stderr, "failed to load %s\n",
+			asset->text_path.c_str());
+		return false;
+	}
+	asset->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	// Without a flush the fence may never reach the GPU from this
+	// context, and the render thread would wait on it forever.
+	glFlush();
+	return true;
+}
+
+void AssetStreamer::run() {
+	glfwMakeContextCurrent(this->context);
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (true) {
+		this->wake.wait(lock, [this] {
+			return this->stopping || !this->queue.empty();
+		});
+		if (this->stopping) {
+			break;
+		}
+		StreamedAsset *asset = this->queue.front();
+		this->queue.pop_front();
+		lock.unlock();
+
+		asset->state = ASSET_LOADING;
+		bool ok = load_and_fence(asset, this->vertex_format, this->pool,
+					 this->cache);
+
+		lock.lock();
+		asset->state = ok ? ASSET_UPLOADED : ASSET_FAILED;
+		if (ok) {
+			this->uploaded.push_back(asset);
+		}
+		if (this->queue.empty()) {
+			this->cache->print();
+		}
+	}
+	glfwMakeContextCurrent(NULL);
+}
+
+StreamedAsset *AssetStreamer::request(const char *mesh_path,
+				      const char *text_path) {
+	StreamedAsset *asset = new StreamedAsset();
+	asset->mesh_path = mesh_path;
+	asset->text_path = text_path;
+	asset->state = ASSET_QUEUED;
+	asset->fence = NULL;
+	asset->stats = {};
+	asset->requested = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->assets.push_back(asset);
+	if (this->context == NULL) {
+		asset->state = ASSET_LOADING;
+		bool ok = load_and_fence(asset, this->vertex_format, this->pool,
+					 this->cache);
+		asset->state = ok ? ASSET_UPLOADED : ASSET_FAILED;
+		if (ok) {
+			this->uploaded.push_back(asset);
+		}
+		this->cache->print();
+		return asset;
+	}
+	this->queue.push_back(asset);
+	this->wake.notify_one();
+	return asset;
+}
+
+void AssetStreamer::update() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	for (size_t i = 0; i < this->uploaded.size();) {
+		StreamedAsset *asset = this->uploaded[i];
+		GLenum status = glClientWaitSync(asset->fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			i++;
+			continue;
+		}
+		glDeleteSync(asset->fence);
+		asset->fence = NULL;
+		this->uploaded[i] = this->uploaded.back();
+		this->uploaded.pop_back();
+		if (status == GL_WAIT_FAILED) {
+			gpu_mesh_destroy(&asset->gpu);
+			asset->state = ASSET_FAILED;
+			continue;
+		}
+
+		gpu_mesh_create_vao(&asset->gpu);
+		const GpuMesh &gpu = asset->gpu;
+		std::chrono::duration<float> latency =
+		    std::chrono::steady_clock::now() - asset->requested;
+		asset->stats.latency_ms = 1000.0f * latency.count();
+		asset->stats.bytes =
+		    (uint64_t)gpu.vertex_count * gpu.layout.stride +
+		    (uint64_t)gpu.index_count * gpu.index_size;
+		asset->stats.bytes_per_second =
+		    asset->stats.bytes / std::max(latency.count(), 1e-6f);
+		printf("%s: resident after %.1f ms, %.1f MB/s\n",
+		       asset->text_path.c_str(), asset->stats.latency_ms,
+		       asset->stats.bytes_per_second / 1e6f);
+		asset->state = ASSET_RESIDENT;
+	}
+}
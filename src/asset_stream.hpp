@@ -0,0 +1,82 @@
+#ifndef _ASSET_STREAM_HPP
+#define _ASSET_STREAM_HPP
+
+#include "asset_cache.hpp"
+#include "gpu_mesh.hpp"
+#include "mesh_quantize.hpp"
+#include "thread_pool.hpp"
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum AssetState {
+	ASSET_QUEUED,
+	ASSET_LOADING,
+	ASSET_UPLOADED, // buffers filled, waiting for the fence
+	ASSET_RESIDENT, // ready to draw
+	ASSET_FAILED,
+};
+
+struct AssetLoadStats {
+	float latency_ms; // from request() until resident
+	uint64_t bytes;	  // vertex and index buffer bytes uploaded
+	float bytes_per_second;
+};
+
+struct StreamedAsset {
+	std::string mesh_path;
+	std::string text_path;
+	std::atomic<int> state; // AssetState
+	GpuMesh gpu;		// only touch once state is ASSET_RESIDENT
+	Mesh bvh; // LOD0 triangles and BVH for picking, empty without one
+	AssetLoadStats stats;
+
+	GLsync fence;
+	std::chrono::steady_clock::time_point requested;
+};
+
+// Loads assets on a worker thread so the render loop never blocks on disk
+// or decoding. The worker owns a hidden GL context sharing objects with the
+// main window: it fills the buffers there and fences them, update() on the
+// render thread waits for nothing and makes finished assets resident once
+// their fence has signaled.
+class AssetStreamer {
+      private:
+	GLFWwindow *context;
+	ThreadPool *pool;
+	AssetCache *cache;
+	MeshVertexFormat vertex_format;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<StreamedAsset *> queue;
+	std::vector<StreamedAsset *> uploaded;
+	std::vector<StreamedAsset *> assets;
+	bool stopping;
+
+	void run();
+
+      public:
+	// Call on the thread that owns window, after glewInit().
+	AssetStreamer(GLFWwindow *window, ThreadPool *pool, AssetCache *cache,
+		      MeshVertexFormat vertex_format);
+	~AssetStreamer();
+
+	// The returned asset stays valid until the streamer is destroyed.
+	// mesh_path is a baked .mesh that is preferred when present.
+	StreamedAsset *request(const char *mesh_path, const char *text_path);
+
+	// Call once per frame on the render thread.
+	void update();
+};
+
+#endif
@@ -1,88 +1,364 @@
 #include "basic_shader.hpp"
+#include "gl_state.hpp"
+#include "shader_cache.hpp"
+#include "shader_source.hpp"
+#include "uniform_block.hpp"
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
-#include <fstream>
+#include <algorithm>
+#include <cstdio>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
-#include <sstream>
 #include <string>
 
-std::string BasicShader::read_file(const char *path) {
-	unsigned int shader;
-	int status, len;
-	char log[SHADER_ERROR_LOG_LEN];
-	std::ifstream fs(path);
-	std::stringstream ss;
-	ss << fs.rdbuf();
-	std::string str = ss.str();
-	return str;
+uint32_t BasicShader::string_lookups = 0;
+
+// Issues the compile of the shader read from files and attaches it. Its
+// status is only checked by finish, so the driver can compile all stages,
+// and all programs, at once.
+void BasicShader::attach(unsigned int type, const std::string &source,
+			 const char *stage,
+			 const std::vector<std::string> &files) {
+	unsigned int shader = glCreateShader(type);
+	const char *code = source.c_str();
+	glShaderSource(shader, 1, &code, NULL);
+	glCompileShader(shader);
+	glAttachShader(this->building, shader);
+	this->compiled.push_back({shader, stage, files});
 }
 
-BasicShader::BasicShader(const char *vertexShaderPath,
-			 const char *fragmentShaderPath) {
-	unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-	unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-	std::string vertexShaderString = read_file(vertexShaderPath);
-	std::string fragmentShaderString = read_file(fragmentShaderPath);
-	const char *vertexShaderCode = vertexShaderString.c_str();
-	const char *fragmentShaderCode = fragmentShaderString.c_str();
-	glShaderSource(vertexShader, 1, &vertexShaderCode, NULL);
-	glShaderSource(fragmentShader, 1, &fragmentShaderCode, NULL);
-
-	this->ID = glCreateProgram();
+// Reads the sources and tries the binary cache, otherwise issues the
+// compiles and the link. A source that cannot be read fails the build
+// before anything is compiled, the files read so far are still watched.
+bool BasicShader::build() {
+	uint32_t count = this->sources.size();
+	std::string sources[BASIC_SHADER_MAX_STAGES];
+	std::vector<std::string> files[BASIC_SHADER_MAX_STAGES];
+	this->files.clear();
+	bool read = true;
+	for (uint32_t i = 0; i < count; i++) {
+		if (!shader_source_load(this->sources[i].path.c_str(),
+					this->defines, &sources[i],
+					&files[i])) {
+			read = false;
+		}
+		for (const std::string &file : files[i]) {
+			if (std::find(this->files.begin(), this->files.end(),
+				      file) == this->files.end()) {
+				this->files.push_back(file);
+			}
+		}
+	}
+	if (!read) {
+		this->failed = true;
+		return false;
+	}
+	this->building = glCreateProgram();
+	this->loaded = false;
+	this->key = 0;
+	this->binaries = shader_cache_supported();
+	if (this->binaries) {
+		this->key = shader_cache_key(sources, count);
+		this->loaded = shader_cache_load(this->building, this->key);
+	}
+	if (this->loaded) {
+		return true;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		this->attach(this->sources[i].type, sources[i],
+			     this->sources[i].name, files[i]);
+	}
+	if (this->binaries) {
+		GLenum hint = GL_PROGRAM_BINARY_RETRIEVABLE_HINT;
+		glProgramParameteri(this->building, hint, GL_TRUE);
+	}
+	glLinkProgram(this->building);
+	return true;
+}
+
+// Drops the build in flight, if any.
+void BasicShader::discard() {
+	for (const Compiled &c : this->compiled) {
+		glDeleteShader(c.shader);
+	}
+	this->compiled.clear();
+	if (this->building != 0) {
+		glDeleteProgram(this->building);
+		this->building = 0;
+	}
+}
 
+// Checks the build and, if it linked, makes it the program. A failed
+// build is logged and dropped, the previous program stays.
+bool BasicShader::finish() {
 	int status, len;
 	char log[SHADER_ERROR_LOG_LEN];
-	glCompileShader(vertexShader);
-	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &status);
-	if (status == GL_FALSE) {
-		glGetShaderInfoLog(vertexShader, SHADER_ERROR_LOG_LEN, &len,
-				   log);
-		std::cout << log << std::endl;
-		std::cout << "**GL Shader Error : vertex shader : "
-			  << vertexShaderPath << " **" << std::endl
-			  << vertexShaderCode << std::endl;
-	} else {
-		glAttachShader(this->ID, vertexShader);
-	}
-	glCompileShader(fragmentShader);
-	glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &status);
-	if (status == GL_FALSE) {
-		glGetShaderInfoLog(fragmentShader, SHADER_ERROR_LOG_LEN, &len,
-				   log);
-		std::cout << log << std::endl;
-		std::cout << "**GL Shader Error : fragment shader : "
-			  << fragmentShaderPath << " **" << std::endl
-			  << fragmentShaderCode << std::endl;
-	} else {
-		glAttachShader(this->ID, fragmentShader);
-	}
-	glLinkProgram(this->ID);
-	glGetProgramiv(this->ID, GL_LINK_STATUS, &status);
+	for (const Compiled &c : this->compiled) {
+		glGetShaderiv(c.shader, GL_COMPILE_STATUS, &status);
+		if (status == GL_FALSE) {
+			glGetShaderInfoLog(c.shader, SHADER_ERROR_LOG_LEN, &len,
+					   log);
+			std::cout << log << std::endl;
+			std::cout << "**GL Shader Error : " << c.stage
+				  << " shader : " << c.files[0] << " **"
+				  << std::endl;
+			// Log lines start with the index of their file.
+			for (size_t i = 1; i < c.files.size(); i++) {
+				std::cout << i << ": " << c.files[i]
+					  << std::endl;
+			}
+		}
+		glDetachShader(this->building, c.shader);
+	}
+
+	glGetProgramiv(this->building, GL_LINK_STATUS, &status);
 	if (status == GL_FALSE) {
-		glGetProgramInfoLog(this->ID, SHADER_ERROR_LOG_LEN, &len, log);
+		glGetProgramInfoLog(this->building, SHADER_ERROR_LOG_LEN, &len,
+				    log);
 		std::cout << "** GL Program Error **" << std::endl;
 		std::cout << log << std::endl;
+		this->discard();
+		this->failed = true;
+		return false;
+	}
+	if (this->binaries && !this->loaded) {
+		shader_cache_store(this->building, this->key);
+	}
+	if (this->ID != 0) {
+		this->copyUniforms(this->ID, this->building);
+		glDeleteProgram(this->ID);
+		gl_state_forget(this->ID);
+	}
+	this->ID = this->building;
+	this->building = 0;
+	this->discard();
+	this->cached = this->loaded;
+	this->failed = false;
+	this->generation++;
+	this->reflect();
+	this->ready = true;
+	return true;
+}
+
+// Carries the values of the default block uniforms over to a rebuilt
+// program, for those with the same name and type. Arrays and types the
+// shaders do not use are left at their defaults.
+void BasicShader::copyUniforms(unsigned int from, unsigned int to) {
+	GLint current = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+	gl_state_use_program(to);
+
+	int count = 0, max_length = 0;
+	glGetProgramiv(to, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(to, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+	std::string name(max_length, '\0');
+	for (int i = 0; i < count; i++) {
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(to, i, max_length, NULL, &size, &type,
+				   &name[0]);
+		int location = glGetUniformLocation(to, name.c_str());
+		int old = glGetUniformLocation(from, name.c_str());
+		if (size != 1 || location < 0 || old < 0) {
+			continue;
+		}
+		float f[16];
+		int n;
+		switch (type) {
+		case GL_FLOAT:
+		case GL_FLOAT_VEC2:
+		case GL_FLOAT_VEC3:
+		case GL_FLOAT_VEC4:
+			glGetUniformfv(from, old, f);
+			n = type == GL_FLOAT ? 1 : type - GL_FLOAT_VEC2 + 2;
+			if (n == 1) {
+				glUniform1fv(location, 1, f);
+			} else if (n == 2) {
+				glUniform2fv(location, 1, f);
+			} else if (n == 3) {
+				glUniform3fv(location, 1, f);
+			} else {
+				glUniform4fv(location, 1, f);
+			}
+			break;
+		case GL_FLOAT_MAT4:
+			glGetUniformfv(from, old, f);
+			glUniformMatrix4fv(location, 1, GL_FALSE, f);
+			break;
+		case GL_INT:
+		case GL_BOOL:
+		case GL_SAMPLER_2D:
+		case GL_SAMPLER_2D_SHADOW:
+			glGetUniformiv(from, old, &n);
+			glUniform1i(location, n);
+			break;
+		}
+	}
+	gl_state_use_program(current == (GLint)from ? to : current);
+}
+
+bool BasicShader::poll() {
+	if (this->building == 0) {
+		return true;
+	}
+	if (GLEW_KHR_parallel_shader_compile ||
+	    GLEW_ARB_parallel_shader_compile) {
+		int done = GL_FALSE;
+		glGetProgramiv(this->building, GL_COMPLETION_STATUS_KHR,
+			       &done);
+		if (done == GL_FALSE) {
+			return false;
+		}
+	}
+	this->finish();
+	return true;
+}
+
+void BasicShader::reload() {
+	this->discard();
+	this->build();
+}
+
+void BasicShader::reflect() {
+	this->uniforms.clear();
+	this->missing.clear();
+	int count = 0, max_length = 0;
+	glGetProgramiv(this->ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(this->ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+	std::string name(max_length, '\0');
+	for (int i = 0; i < count; i++) {
+		GLsizei length = 0;
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(this->ID, i, max_length, &length, &size,
+				   &type, &name[0]);
+		std::string key(name.data(), length);
+		int location = glGetUniformLocation(this->ID, key.c_str());
+		if (location < 0) {
+			continue; // member of a uniform block
+		}
+		this->uniforms[key] = location;
+		// Arrays are reported as "name[0]", accept plain "name" too.
+		size_t n = key.size();
+		if (n > 3 && key.compare(n - 3, 3, "[0]") == 0) {
+			this->uniforms[key.substr(0, n - 3)] = location;
+		}
+	}
+
+	// Blocks go to the binding points shared by all programs.
+	glGetProgramiv(this->ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	glGetProgramiv(this->ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+		       &max_length);
+	name.assign(max_length, '\0');
+	for (int i = 0; i < count; i++) {
+		glGetActiveUniformBlockName(this->ID, i, max_length, NULL,
+					    &name[0]);
+		int binding = uniform_block_binding(name.c_str());
+		if (binding < 0) {
+			fprintf(stderr, "shader %u: unknown uniform block %s\n",
+				this->ID, name.c_str());
+			continue;
+		}
+		glUniformBlockBinding(this->ID, i, binding);
+	}
+}
+
+int BasicShader::uniform(const char *name, bool required) {
+	string_lookups++;
+	auto it = this->uniforms.find(name);
+	if (it != this->uniforms.end()) {
+		return it->second;
+	}
+	if (required && this->missing.insert(name).second) {
+		fprintf(stderr, "shader %u: no active uniform %s\n", this->ID,
+			name);
+	}
+	return -1;
+}
+
+void BasicShader::init(const Stage *stages, uint32_t count,
+		       const std::string &defines, bool background) {
+	for (uint32_t i = 0; i < count; i++) {
+		this->sources.push_back(
+		    {stages[i].type, stages[i].path, stages[i].name});
+	}
+	this->defines = defines;
+	this->ID = 0;
+	this->building = 0;
+	this->ready = false;
+	this->cached = false;
+	this->failed = false;
+	this->generation = 0;
+	bool built = this->build();
+	if (!background && (!built || !this->finish())) {
 		exit(1);
 	}
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
+}
+
+BasicShader::BasicShader(const char *vertexShaderPath,
+			 const char *fragmentShaderPath, bool background,
+			 const std::string &defines) {
+	const Stage stages[] = {
+	    {GL_VERTEX_SHADER, vertexShaderPath, "vertex"},
+	    {GL_FRAGMENT_SHADER, fragmentShaderPath, "fragment"},
+	};
+	this->init(stages, 2, defines, background);
+}
+
+BasicShader::BasicShader(const char *vertexShaderPath,
+			 const char *tessControlShaderPath,
+			 const char *tessEvaluationShaderPath,
+			 const char *fragmentShaderPath, bool background,
+			 const std::string &defines) {
+	const Stage stages[] = {
+	    {GL_VERTEX_SHADER, vertexShaderPath, "vertex"},
+	    {GL_TESS_CONTROL_SHADER, tessControlShaderPath,
+	     "tessellation control"},
+	    {GL_TESS_EVALUATION_SHADER, tessEvaluationShaderPath,
+	     "tessellation evaluation"},
+	    {GL_FRAGMENT_SHADER, fragmentShaderPath, "fragment"},
+	};
+	this->init(stages, 4, defines, background);
+}
+
+BasicShader::~BasicShader() {
+	this->discard();
+	glDeleteProgram(this->ID);
+	gl_state_forget(this->ID);
 }
 
 void BasicShader::setMat4(const char *name, glm::mat4 value) {
-	glUniformMatrix4fv(glGetUniformLocation(this->ID, name), 1, GL_FALSE,
-			   glm::value_ptr(value));
+	this->setMat4(this->uniform(name), value);
 }
 
 void BasicShader::setVec3(const char *name, glm::vec3 value) {
-	glUniform3fv(glGetUniformLocation(this->ID, name), 1,
-		     glm::value_ptr(value));
+	this->setVec3(this->uniform(name), value);
 }
 
 void BasicShader::setFloat(const char *name, float value) {
-	glUniform1f(glGetUniformLocation(this->ID, name), value);
+	this->setFloat(this->uniform(name), value);
+}
+
+void BasicShader::setInt(const char *name, int value) {
+	this->setInt(this->uniform(name), value);
+}
+
+void BasicShader::setMat4(int location, const glm::mat4 &value) {
+	glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void BasicShader::setVec3(int location, const glm::vec3 &value) {
+	glUniform3fv(location, 1, glm::value_ptr(value));
+}
+
+void BasicShader::setFloat(int location, float value) {
+	glUniform1f(location, value);
+}
+
+void BasicShader::setInt(int location, int value) {
+	glUniform1i(location, value);
 }
 
-void BasicShader::use() { glUseProgram(this->ID); }
+void BasicShader::use() { gl_state_use_program(this->ID); }
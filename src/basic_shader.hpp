@@ -2,21 +2,109 @@
 #define _BASIC_SHADER_HPP
 
 #define SHADER_ERROR_LOG_LEN 1024
+#define BASIC_SHADER_MAX_STAGES 4
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <cstdint>
 #include <glm/gtc/type_ptr.hpp>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 class BasicShader {
       private:
-	std::string read_file(const char *path);
+	struct Stage {
+		unsigned int type;
+		const char *path;
+		const char *name;
+	};
+
+	// Active uniforms by name, reflected once after linking. Uniform
+	// blocks are bound to their UNIFORM_BLOCK_* binding points then.
+	std::unordered_map<std::string, int> uniforms;
+	std::unordered_set<std::string> missing; // names already warned about
+
+	// What the program is built from, again on reload.
+	struct Source {
+		unsigned int type;
+		std::string path;
+		const char *name;
+	};
+	std::vector<Source> sources;
+	std::string defines;
+
+	// Shaders of a program that has not been checked yet, kept for their
+	// logs.
+	struct Compiled {
+		unsigned int shader;
+		const char *stage;
+		std::vector<std::string> files; // source string numbers
+	};
+	std::vector<Compiled> compiled;
+	unsigned int building; // program being built, 0 if none
+	uint64_t key;	       // in the binary cache
+	bool binaries;	       // store the program once linked
+	bool loaded;	       // building came from the binary cache
+
+	void init(const Stage *stages, uint32_t count,
+		  const std::string &defines, bool background);
+	bool build();
+	void attach(unsigned int type, const std::string &source,
+		    const char *stage, const std::vector<std::string> &files);
+	void discard();
+	bool finish();
+	void copyUniforms(unsigned int from, unsigned int to);
+	void reflect();
 
       public:
-	unsigned int ID; // program ID
+	unsigned int ID; // program ID, 0 until the first build linked
+
+	// Uniform lookups by name since the caller last reset it. Per frame
+	// code sets uniforms through handles from uniform(), which keeps this
+	// at zero.
+	static uint32_t string_lookups;
 
+	bool ready;  // linked and reflected, uniform() may be called
+	bool cached; // loaded from the binary cache
+	bool failed; // the last build did not compile or link
+	// Bumped whenever ID is replaced; handles from uniform() belong to
+	// one generation.
+	uint32_t generation;
+	// Every file the stages were read from, includes too.
+	std::vector<std::string> files;
+
+	// A background program only issues its compiles and link, poll
+	// finishes it. Otherwise it is ready when constructed, and a program
+	// that fails to build ends the process. defines, a block of #define
+	// lines, is put into every stage (see shader_source_load).
+	BasicShader(const char *vertexShaderPath,
+		    const char *fragmentShaderPath, bool background = false,
+		    const std::string &defines = "");
+
+	// Program with tessellation stages, needs GL 4.0.
 	BasicShader(const char *vertexShaderPath,
-		    const char *fragmentShaderPath);
+		    const char *tessControlShaderPath,
+		    const char *tessEvaluationShaderPath,
+		    const char *fragmentShaderPath, bool background = false,
+		    const std::string &defines = "");
+
+	~BasicShader();
+
+	// Rebuilds the program from its files in the background, dropping a
+	// build still in flight. Until poll finishes it the old program stays
+	// in use, and stays for good if the new one fails to build.
+	void reload();
+
+	// Finishes a build, the first one or a reload, once the driver has
+	// linked it. Returns false while it is still compiling. Only waits
+	// for the driver when it lacks KHR_parallel_shader_compile.
+	bool poll();
+
+	// Location of the active uniform name, -1 (which the setters ignore)
+	// with a warning if the program has none unless it is optional.
+	int uniform(const char *name, bool required = true);
 
 	void setMat4(const char *name, glm::mat4 value);
 
@@ -24,6 +112,16 @@ class BasicShader {
 
 	void setFloat(const char *name, float value);
 
+	void setInt(const char *name, int value);
+
+	void setMat4(int location, const glm::mat4 &value);
+
+	void setVec3(int location, const glm::vec3 &value);
+
+	void setFloat(int location, float value);
+
+	void setInt(int location, int value);
+
 	void use();
 };
 
@@ -0,0 +1,541 @@
+// Micro benchmarks for the CPU side of the renderer.
+//
+//	cube_bench parse <file.norm.txt>
+//	cube_bench gen-norm <file.norm.txt> <megabytes>
+//	cube_bench bezier <file.bpt>
+//	cube_bench sort <packets>
+//	cube_bench cull <objects>
+//	cube_bench bvh <objects>
+//	cube_bench mesh-bvh <triangles>
+
+#include "bezier_patch.hpp"
+#include "cull.hpp"
+#include "mesh.hpp"
+#include "mesh_bvh.hpp"
+#include "norm_txt_loader.hpp"
+#include "radix_sort.hpp"
+#include "scene_bvh.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+#include <sys/stat.h>
+
+static double now_seconds() {
+	return std::chrono::duration<double>(
+		   std::chrono::steady_clock::now().time_since_epoch())
+	    .count();
+}
+
+static void report(const char *name, double seconds, size_t bytes,
+		   uint32_t triangles) {
+	printf("%-10s %8.3f ms %10.1f MB/s %12.0f tris/s\n", name,
+	       seconds * 1e3, bytes / seconds / 1e6, triangles / seconds);
+}
+
+static int bench_parse(const char *path) {
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		fprintf(stderr, "cannot stat %s\n", path);
+		return 1;
+	}
+	ThreadPool pool;
+	printf("%s: %.1f MB, %u threads\n", path, st.st_size / 1e6,
+	       pool.size());
+
+	// Warm the page cache so both loaders measure parsing, not disk.
+	Mesh mesh;
+	if (!mesh_load_norm_txt_mapped(path, &mesh, &pool)) {
+		return 1;
+	}
+
+	double t = now_seconds();
+	mesh_load_norm_txt(path, &mesh);
+	report("fscanf", now_seconds() - t, st.st_size, mesh.triangleCount());
+
+	t = now_seconds();
+	mesh_load_norm_txt_mapped(path, &mesh, &pool);
+	report("parallel", now_seconds() - t, st.st_size,
+	       mesh.triangleCount());
+	return 0;
+}
+
+// Writes a file in the teapot layout with random coordinates; every number
+// is printed with the same width so the size can be chosen up front.
+static int gen_norm(const char *path, double megabytes) {
+	const size_t triangle_bytes = 6 * 30 + 1;
+	size_t triangle_count = megabytes * 1e6 / triangle_bytes;
+	FILE *f = fopen(path, "w");
+	if (f == NULL) {
+		fprintf(stderr, "cannot open %s\n", path);
+		return 1;
+	}
+	fprintf(f, "%zu\n", triangle_count);
+	uint32_t seed = 1;
+	for (size_t i = 0; i < triangle_count; i++) {
+		for (int v = 0; v < 6; v++) {
+			float c[3];
+			for (int k = 0; k < 3; k++) {
+				seed = seed * 1664525u + 1013904223u;
+				c[k] = (seed >> 8) / 16777216.0f * 8.0f - 4.0f;
+			}
+			fprintf(f, "%9.6f %9.6f %9.6f\n", c[0], c[1], c[2]);
+		}
+		fputc('\n', f);
+	}
+	fclose(f);
+	printf("%s: %zu triangles\n", path, triangle_count);
+	return 0;
+}
+
+// Full tessellations at fixed levels, then a camera flying in towards the
+// patches and back out again, as the renderer would update them.
+static int bench_bezier(const char *path) {
+	std::vector<BezierPatch> patches;
+	if (!bezier_load(path, &patches)) {
+		return 1;
+	}
+	for (uint32_t level = 4; level <= BEZIER_MAX_LEVEL; level *= 2) {
+		BezierLevels levels = {level, {level, level, level, level}};
+		Mesh mesh;
+		const int runs = 20;
+		double t = now_seconds();
+		for (int run = 0; run < runs; run++) {
+			mesh.vertices.clear();
+			mesh.indices.clear();
+			for (const BezierPatch &patch : patches) {
+				bezier_tessellate(patch, levels, &mesh);
+			}
+		}
+		double seconds = (now_seconds() - t) / runs;
+		printf("level %2u   %8.3f ms %10.1f Mverts/s %8u tris\n", level,
+		       seconds * 1e3, mesh.vertexCount() / seconds / 1e6,
+		       mesh.triangleCount());
+	}
+
+	BezierTessellator tessellator(patches);
+	const int frames = 600;
+	uint32_t regenerated = 0, cached = 0, changed = 0;
+	double t = now_seconds();
+	for (int frame = 0; frame < frames; frame++) {
+		float phase = 2.0f * (float)M_PI * frame / frames;
+		float distance = 12.0f - 9.0f * std::sin(0.5f * phase);
+		float eye[3] = {distance * std::cos(phase), 3.0f,
+				distance * std::sin(phase)};
+		changed += tessellator.update(eye, 869.0f);
+		regenerated += tessellator.stats.regenerated;
+		cached += tessellator.stats.cached;
+	}
+	double seconds = now_seconds() - t;
+	printf("camera     %8.3f ms/frame, %u of %d frames changed, "
+	       "%.2f patches retessellated and %.2f from cache per frame\n",
+	       seconds * 1e3 / frames, changed, frames,
+	       (double)regenerated / frames, (double)cached / frames);
+	return 0;
+}
+
+// Keys shaped like the render queue's: a few programs, some hundred meshes,
+// a handful of materials and 24 bits of depth. Sorted by radix_sort and by
+// std::sort for reference.
+static int bench_sort(uint32_t count) {
+	std::vector<SortItem> keys(count), items, scratch(count);
+	uint32_t seed = 1;
+	for (uint32_t i = 0; i < count; i++) {
+		seed = seed * 1664525u + 1013904223u;
+		uint64_t program = seed >> 28;
+		uint64_t mesh = (seed >> 20) & 0xff;
+		uint64_t material = (seed >> 17) & 0x7;
+		seed = seed * 1664525u + 1013904223u;
+		uint64_t depth = seed >> 8;
+		keys[i].key = (program << 50) | (mesh << 38) |
+			      (material << 30) | (depth << 6);
+		keys[i].value = i;
+	}
+	const int runs = 20;
+	double radix = 0.0, reference = 0.0;
+	bool same = true;
+	for (int run = 0; run < runs; run++) {
+		items = keys;
+		double t = now_seconds();
+		radix_sort(items.data(), scratch.data(), count);
+		radix += now_seconds() - t;
+
+		std::vector<SortItem> sorted = keys;
+		t = now_seconds();
+		std::stable_sort(sorted.begin(), sorted.end(),
+				 [](const SortItem &a, const SortItem &b) {
+					 return a.key < b.key;
+				 });
+		reference += now_seconds() - t;
+		for (uint32_t i = 0; i < count; i++) {
+			same = same && items[i].value == sorted[i].value;
+		}
+	}
+	printf("radix      %8.3f ms %10.1f Mkeys/s\n", radix * 1e3 / runs,
+	       count * runs / radix / 1e6);
+	printf("std::sort  %8.3f ms %10.1f Mkeys/s\n",
+	       reference * 1e3 / runs, count * runs / reference / 1e6);
+	if (!same) {
+		fprintf(stderr, "orders differ\n");
+		return 1;
+	}
+	return 0;
+}
+
+// Spheres and boxes scattered through a 400 unit cube around a camera with
+// the renderer's projection, about one in twenty in view. Each kernel is
+// checked against the scalar tests it replaces.
+static int bench_cull(uint32_t count) {
+	CullSpheres spheres;
+	CullBoxes boxes;
+	uint32_t seed = 1;
+	auto random = [&seed](float lo, float hi) {
+		seed = seed * 1664525u + 1013904223u;
+		return lo + (seed >> 8) / 16777216.0f * (hi - lo);
+	};
+	for (uint32_t i = 0; i < count; i++) {
+		float x = random(-200.0f, 200.0f);
+		float y = random(-200.0f, 200.0f);
+		float z = random(-200.0f, 200.0f);
+		spheres.x.push_back(x);
+		spheres.y.push_back(y);
+		spheres.z.push_back(z);
+		spheres.radius.push_back(random(0.1f, 2.0f));
+		boxes.x.push_back(x);
+		boxes.y.push_back(y);
+		boxes.z.push_back(z);
+		boxes.extent_x.push_back(random(0.1f, 2.0f));
+		boxes.extent_y.push_back(random(0.1f, 2.0f));
+		boxes.extent_z.push_back(random(0.1f, 2.0f));
+	}
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f),
+						1280.0f / 720.0f, 0.1f, 200.0f);
+	glm::mat4 view =
+	    glm::lookAt(glm::vec3(0.0f), glm::vec3(0.3f, 0.1f, -1.0f),
+			glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = frustum_from_matrix(projection * view);
+
+	std::vector<uint32_t> reference(count), visible(count);
+	for (int boxed = 0; boxed < 2; boxed++) {
+		const int runs = 20;
+		uint32_t expected = 0;
+		double t = now_seconds();
+		for (int run = 0; run < runs; run++) {
+			expected = 0;
+			for (uint32_t i = 0; i < count; i++) {
+				glm::vec3 center(spheres.x[i], spheres.y[i],
+						 spheres.z[i]);
+				bool inside =
+				    boxed ? frustum_test_box(
+						frustum, center,
+						glm::vec3(boxes.extent_x[i],
+							  boxes.extent_y[i],
+							  boxes.extent_z[i]))
+					  : frustum_test_sphere(
+						frustum, center,
+						spheres.radius[i]);
+				if (inside) {
+					reference[expected++] = i;
+				}
+			}
+		}
+		double seconds = (now_seconds() - t) / runs;
+		const char *kind = boxed ? "boxes" : "spheres";
+		printf("%-7s %-6s %8.3f ms %10.1f Mobjects/s, %u visible\n",
+		       kind, "test", seconds * 1e3, count / seconds / 1e6,
+		       expected);
+		for (uint32_t simd = CULL_SIMD_NONE; simd <= cull_simd_best();
+		     simd++) {
+			uint32_t n = 0;
+			t = now_seconds();
+			for (int run = 0; run < runs; run++) {
+				n = boxed ? frustum_cull_boxes(frustum, boxes,
+							       visible.data(),
+							       (CullSimd)simd)
+					  : frustum_cull_spheres(
+						frustum, spheres,
+						visible.data(), (CullSimd)simd);
+			}
+			seconds = (now_seconds() - t) / runs;
+			printf("%-7s %-6s %8.3f ms %10.1f Mobjects/s\n", kind,
+			       cull_simd_name((CullSimd)simd), seconds * 1e3,
+			       count / seconds / 1e6);
+			if (n != expected ||
+			    !std::equal(visible.begin(), visible.begin() + n,
+					reference.begin())) {
+				fprintf(stderr, "%s culls differently\n",
+					cull_simd_name((CullSimd)simd));
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+// Boxes scattered like bench_cull's, in a SceneBvh: a build, moving one
+// in a hundred objects one by one, moving all of them and refitting once,
+// culls against the SIMD box test, and rays through the frustum.
+static int bench_bvh(uint32_t count) {
+	std::vector<glm::vec3> min(count), max(count);
+	CullBoxes boxes;
+	uint32_t seed = 1;
+	auto random = [&seed](float lo, float hi) {
+		seed = seed * 1664525u + 1013904223u;
+		return lo + (seed >> 8) / 16777216.0f * (hi - lo);
+	};
+	auto place = [&](uint32_t i, glm::vec3 center) {
+		glm::vec3 extent(random(0.1f, 2.0f), random(0.1f, 2.0f),
+				 random(0.1f, 2.0f));
+		min[i] = center - extent;
+		max[i] = center + extent;
+	};
+	for (uint32_t i = 0; i < count; i++) {
+		place(i, glm::vec3(random(-200.0f, 200.0f),
+				   random(-200.0f, 200.0f),
+				   random(-200.0f, 200.0f)));
+	}
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f),
+						1280.0f / 720.0f, 0.1f, 200.0f);
+	glm::mat4 view =
+	    glm::lookAt(glm::vec3(0.0f), glm::vec3(0.3f, 0.1f, -1.0f),
+			glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = frustum_from_matrix(projection * view);
+
+	SceneBvh bvh;
+	double t = now_seconds();
+	bvh.build(min.data(), max.data(), count);
+	double seconds = now_seconds() - t;
+	printf("build  %8.3f ms, %u nodes, depth %u, cost %.1f\n",
+	       seconds * 1e3, bvh.stats.nodes, bvh.stats.depth, bvh.cost());
+
+	uint32_t moved = count / 100;
+	t = now_seconds();
+	for (uint32_t i = 0; i < moved; i++) {
+		uint32_t object = i * 100;
+		glm::vec3 center = 0.5f * (min[object] + max[object]);
+		place(object, center + glm::vec3(random(-5.0f, 5.0f),
+						 random(-5.0f, 5.0f),
+						 random(-5.0f, 5.0f)));
+		bvh.move(object, min[object], max[object]);
+	}
+	seconds = now_seconds() - t;
+	printf("move   %8.3f ms for %u objects, cost %.1f\n", seconds * 1e3,
+	       moved, bvh.cost());
+
+	// Both refits start from the same tree and moves.
+	std::vector<glm::vec3> start_min = min, start_max = max;
+	uint32_t start_seed = seed;
+	for (int rotate = 0; rotate < 2; rotate++) {
+		min = start_min;
+		max = start_max;
+		seed = start_seed;
+		bvh.build(min.data(), max.data(), count);
+		for (uint32_t i = 0; i < count; i++) {
+			glm::vec3 center = 0.5f * (min[i] + max[i]);
+			place(i, center + glm::vec3(random(-5.0f, 5.0f),
+						    random(-5.0f, 5.0f),
+						    random(-5.0f, 5.0f)));
+			bvh.set(i, min[i], max[i]);
+		}
+		t = now_seconds();
+		bvh.refit(rotate);
+		seconds = now_seconds() - t;
+		printf("refit  %8.3f ms %s rotations, cost %.1f\n",
+		       seconds * 1e3, rotate ? "with" : "without", bvh.cost());
+	}
+	t = now_seconds();
+	bvh.build(min.data(), max.data(), count);
+	seconds = now_seconds() - t;
+	printf("build  %8.3f ms after the moves, cost %.1f\n", seconds * 1e3,
+	       bvh.cost());
+
+	for (uint32_t i = 0; i < count; i++) {
+		glm::vec3 center = 0.5f * (min[i] + max[i]);
+		glm::vec3 extent = 0.5f * (max[i] - min[i]);
+		boxes.x.push_back(center.x);
+		boxes.y.push_back(center.y);
+		boxes.z.push_back(center.z);
+		boxes.extent_x.push_back(extent.x);
+		boxes.extent_y.push_back(extent.y);
+		boxes.extent_z.push_back(extent.z);
+	}
+	const int runs = 20;
+	std::vector<uint32_t> reference(count), visible(count);
+	uint32_t expected = 0, n = 0;
+	t = now_seconds();
+	for (int run = 0; run < runs; run++) {
+		expected = frustum_cull_boxes(frustum, boxes, reference.data());
+	}
+	seconds = (now_seconds() - t) / runs;
+	printf("cull   %8.3f ms %s, %u visible\n", seconds * 1e3,
+	       cull_simd_name(cull_simd_best()), expected);
+	t = now_seconds();
+	for (int run = 0; run < runs; run++) {
+		n = bvh.cull(frustum, visible.data());
+	}
+	seconds = (now_seconds() - t) / runs;
+	printf("cull   %8.3f ms bvh, %u nodes visited\n", seconds * 1e3,
+	       bvh.stats.visited);
+	std::sort(visible.begin(), visible.begin() + n);
+	if (n != expected || !std::equal(visible.begin(), visible.begin() + n,
+					 reference.begin())) {
+		fprintf(stderr, "bvh culls differently\n");
+		return 1;
+	}
+
+	const uint32_t rays = 100000;
+	uint32_t hits = 0;
+	t = now_seconds();
+	for (uint32_t i = 0; i < rays; i++) {
+		glm::vec3 direction(random(-0.5f, 0.5f), random(-0.3f, 0.3f),
+				    -1.0f);
+		uint32_t object;
+		float distance;
+		hits += bvh.raycast(glm::vec3(0.0f), direction, 1000.0f,
+				    &object, &distance);
+	}
+	seconds = now_seconds() - t;
+	printf("rays   %8.3f ms for %u, %.1f Mrays/s, %u hits\n",
+	       seconds * 1e3, rays, rays / seconds / 1e6, hits);
+	return 0;
+}
+
+// A rolling terrain of about count triangles, its BVH built on one thread
+// and on all of them, then rays cast at it from above, a few checked
+// against testing every triangle.
+static int bench_mesh_bvh(uint32_t count) {
+	uint32_t side = (uint32_t)std::sqrt(count / 2.0) + 1;
+	Mesh mesh;
+	for (uint32_t z = 0; z <= side; z++) {
+		for (uint32_t x = 0; x <= side; x++) {
+			float u = (float)x / side, v = (float)z / side;
+			float height = 0.05f * std::sin(40.0f * u) *
+					   std::cos(30.0f * v) +
+				       0.2f * u * v;
+			float vertex[MESH_FLOATS_PER_VERTEX] = {
+			    u, height, v, 0.0f, 1.0f, 0.0f};
+			mesh.vertices.insert(mesh.vertices.end(), vertex,
+					     vertex + MESH_FLOATS_PER_VERTEX);
+		}
+	}
+	for (uint32_t z = 0; z < side; z++) {
+		for (uint32_t x = 0; x < side; x++) {
+			uint32_t a = z * (side + 1) + x, b = a + side + 1;
+			uint32_t quad[6] = {a, b, a + 1, a + 1, b, b + 1};
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+	double millions = mesh.triangleCount() / 1e6;
+
+	unsigned int threads[2] = {1, 0};
+	for (unsigned int n : threads) {
+		ThreadPool pool(n);
+		MeshBvhStats stats;
+		mesh_build_bvh(&mesh, &pool, &stats);
+		printf("%2u threads %8.1f ms, %6.1f ms per Mtri, "
+		       "%u triangles\n",
+		       pool.size(), stats.ms, stats.ms / millions,
+		       mesh.triangleCount());
+		printf("           %u nodes, %u leaves, depth %u, cost %.1f, "
+		       "%.1f MB per Mtri\n",
+		       stats.nodes, stats.leaves, stats.depth, stats.cost,
+		       stats.bytes / 1e6 / millions);
+	}
+
+	uint32_t seed = 1;
+	auto random = [&seed](float lo, float hi) {
+		seed = seed * 1664525u + 1013904223u;
+		return lo + (seed >> 8) / 16777216.0f * (hi - lo);
+	};
+	// A root with every triangle in one leaf, testing each of them.
+	Mesh flat = mesh;
+	flat.bvh.assign(1, {});
+	MeshBvhNode &root = flat.bvh[0];
+	for (int c = 0; c < 4; c++) {
+		for (int k = 0; k < 3; k++) {
+			root.min[k][c] = -FLT_MAX;
+			root.max[k][c] = FLT_MAX;
+		}
+		root.child[c] = MESH_BVH_EMPTY;
+	}
+	root.child[0] = 0;
+	root.count[0] = mesh.triangleCount();
+	flat.bvh_triangles.resize(mesh.triangleCount());
+	for (uint32_t t = 0; t < mesh.triangleCount(); t++) {
+		flat.bvh_triangles[t] = t;
+	}
+
+	const uint32_t rays = 200000;
+	uint32_t hits = 0, checked = 0;
+	double seconds = 0.0;
+	for (uint32_t i = 0; i < rays; i++) {
+		float origin[3] = {random(0.0f, 1.0f), 1.0f,
+				   random(0.0f, 1.0f)};
+		float direction[3] = {random(-0.5f, 0.5f), -1.0f,
+				      random(-0.5f, 0.5f)};
+		uint32_t triangle;
+		float distance;
+		double t = now_seconds();
+		bool hit = mesh_bvh_raycast(mesh, origin, direction, 10.0f,
+					    &triangle, &distance);
+		seconds += now_seconds() - t;
+		hits += hit;
+		if (i % 2000 != 0) {
+			continue;
+		}
+		uint32_t found;
+		float nearest;
+		bool any = mesh_bvh_raycast(flat, origin, direction, 10.0f,
+					    &found, &nearest);
+		if (any != hit || (hit && nearest != distance)) {
+			fprintf(stderr, "ray %u hits differently\n", i);
+			return 1;
+		}
+		checked++;
+	}
+	printf("rays     %8.1f ms for %u, %.2f Mrays/s, %u hits, %u checked\n",
+	       seconds * 1e3, rays, rays / seconds / 1e6, hits, checked);
+	return 0;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: cube_bench parse <file.norm.txt>\n"
+			"       cube_bench gen-norm <file.norm.txt> "
+			"<megabytes>\n"
+			"       cube_bench bezier <file.bpt>\n"
+			"       cube_bench sort <packets>\n"
+			"       cube_bench cull <objects>\n"
+			"       cube_bench bvh <objects>\n"
+			"       cube_bench mesh-bvh <triangles>\n");
+}
+
+int main(int argc, char **argv) {
+	if (argc == 3 && strcmp(argv[1], "parse") == 0) {
+		return bench_parse(argv[2]);
+	}
+	if (argc == 4 && strcmp(argv[1], "gen-norm") == 0) {
+		return gen_norm(argv[2], atof(argv[3]));
+	}
+	if (argc == 3 && strcmp(argv[1], "bezier") == 0) {
+		return bench_bezier(argv[2]);
+	}
+	if (argc == 3 && strcmp(argv[1], "sort") == 0) {
+		return bench_sort(atoi(argv[2]));
+	}
+	if (argc == 3 && strcmp(argv[1], "cull") == 0) {
+		return bench_cull(atoi(argv[2]));
+	}
+	if (argc == 3 && strcmp(argv[1], "bvh") == 0) {
+		return bench_bvh(atoi(argv[2]));
+	}
+	if (argc == 3 && strcmp(argv[1], "mesh-bvh") == 0) {
+		return bench_mesh_bvh(atoi(argv[2]));
+	}
+	usage();
+	return 1;
+}
@@ -0,0 +1,553 @@
+#include "bezier_patch.hpp"
+#include "vertex_layout.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Below this |dP/du x dP/dv| the normal is taken from inside the patch.
+#define BEZIER_DEGENERATE_NORMAL 1e-12f
+#define BEZIER_NORMAL_NUDGE 1e-3f
+
+MeshLayout bezier_patch_layout() { return VERTEX_LAYOUT_POSITION; }
+
+bool bezier_load(const char *path, std::vector<BezierPatch> *patches) {
+	patches->clear();
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "failed to open file: %s\n", path);
+		return false;
+	}
+	uint32_t patch_count, point_count;
+	std::vector<uint32_t> indices;
+	std::vector<float> points;
+	bool ok = fscanf(f, "%u", &patch_count) == 1;
+	for (uint32_t i = 0; ok && i < 16 * patch_count; i++) {
+		uint32_t index;
+		ok = fscanf(f, " %u", &index) == 1;
+		indices.push_back(index);
+		fscanf(f, " ,");
+	}
+	ok = ok && fscanf(f, "%u", &point_count) == 1;
+	for (uint32_t i = 0; ok && i < 3 * point_count; i++) {
+		float value;
+		ok = fscanf(f, " %f", &value) == 1;
+		points.push_back(value);
+		fscanf(f, " ,");
+	}
+	fclose(f);
+	if (!ok) {
+		fprintf(stderr, "%s: truncated patch file\n", path);
+		return false;
+	}
+
+	patches->resize(patch_count);
+	for (uint32_t p = 0; p < patch_count; p++) {
+		for (int k = 0; k < 16; k++) {
+			uint32_t index = indices[16 * p + k];
+			if (index == 0 || index > point_count) {
+				fprintf(stderr, "%s: patch %u: bad index %u\n",
+					path, p, index);
+				patches->clear();
+				return false;
+			}
+			memcpy((*patches)[p].control[k],
+			       &points[3 * (index - 1)], 3 * sizeof(float));
+		}
+	}
+	return true;
+}
+
+static inline void bernstein(float t, float b[4], float d[4]) {
+	float s = 1.0f - t;
+	b[0] = s * s * s;
+	b[1] = 3.0f * t * s * s;
+	b[2] = 3.0f * t * t * s;
+	b[3] = t * t * t;
+	d[0] = -3.0f * s * s;
+	d[1] = 3.0f * s * (s - 2.0f * t);
+	d[2] = 3.0f * t * (2.0f * s - t);
+	d[3] = 3.0f * t * t;
+}
+
+// Position and the unnormalized normal at (u, v).
+static void evaluate_point(const BezierPatch &patch, float u, float v,
+			   float p[3], float n[3]) {
+	float bu[4], du[4], bv[4], dv[4];
+	bernstein(u, bu, du);
+	bernstein(v, bv, dv);
+	float pu[3] = {0.0f, 0.0f, 0.0f};
+	float pv[3] = {0.0f, 0.0f, 0.0f};
+	p[0] = p[1] = p[2] = 0.0f;
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			const float *c = patch.control[4 * i + j];
+			for (int k = 0; k < 3; k++) {
+				p[k] += bu[i] * bv[j] * c[k];
+				pu[k] += du[i] * bv[j] * c[k];
+				pv[k] += bu[i] * dv[j] * c[k];
+			}
+		}
+	}
+	n[0] = pu[1] * pv[2] - pu[2] * pv[1];
+	n[1] = pu[2] * pv[0] - pu[0] * pv[2];
+	n[2] = pu[0] * pv[1] - pu[1] * pv[0];
+}
+
+// Unit normal at (u, v), moving towards the patch center while a collapsed
+// edge leaves dP/du or dP/dv zero.
+static void normal_at(const BezierPatch &patch, float u, float v,
+		      float out[3]) {
+	float p[3], n[3];
+	for (int step = 0;; step++) {
+		evaluate_point(patch, u, v, p, n);
+		float length2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+		if (length2 > BEZIER_DEGENERATE_NORMAL || step == 4) {
+			float scale = length2 > 0.0f ? 1.0f / std::sqrt(length2)
+						     : 0.0f;
+			for (int k = 0; k < 3; k++) {
+				out[k] = n[k] * scale;
+			}
+			return;
+		}
+		u += (u < 0.5f ? 1.0f : -1.0f) * BEZIER_NORMAL_NUDGE;
+		v += (v < 0.5f ? 1.0f : -1.0f) * BEZIER_NORMAL_NUDGE;
+	}
+}
+
+static void evaluate_scalar(const BezierPatch &patch, float u, float v,
+			    float *out) {
+	float n[3];
+	evaluate_point(patch, u, v, out, n);
+	float length2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+	if (length2 > BEZIER_DEGENERATE_NORMAL) {
+		float scale = 1.0f / std::sqrt(length2);
+		for (int k = 0; k < 3; k++) {
+			out[3 + k] = n[k] * scale;
+		}
+	} else {
+		normal_at(patch, u, v, out + 3);
+	}
+}
+
+#ifdef __SSE2__
+static inline void bernstein4(__m128 t, __m128 b[4], __m128 d[4]) {
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 three = _mm_set1_ps(3.0f);
+	__m128 s = _mm_sub_ps(one, t);
+	__m128 ss = _mm_mul_ps(s, s);
+	__m128 tt = _mm_mul_ps(t, t);
+	b[0] = _mm_mul_ps(ss, s);
+	b[1] = _mm_mul_ps(_mm_mul_ps(three, t), ss);
+	b[2] = _mm_mul_ps(_mm_mul_ps(three, tt), s);
+	b[3] = _mm_mul_ps(tt, t);
+	d[0] = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(three, ss));
+	d[1] = _mm_mul_ps(_mm_mul_ps(three, s),
+			  _mm_sub_ps(s, _mm_mul_ps(two, t)));
+	d[2] = _mm_mul_ps(_mm_mul_ps(three, t),
+			  _mm_sub_ps(_mm_mul_ps(two, s), t));
+	d[3] = _mm_mul_ps(three, tt);
+}
+
+// Four points per iteration, one per lane.
+static void evaluate4(const BezierPatch &patch, const float *u, const float *v,
+		      float *out) {
+	__m128 bu[4], du[4], bv[4], dv[4];
+	bernstein4(_mm_loadu_ps(u), bu, du);
+	bernstein4(_mm_loadu_ps(v), bv, dv);
+	__m128 p[3], pu[3], pv[3];
+	for (int k = 0; k < 3; k++) {
+		p[k] = pu[k] = pv[k] = _mm_setzero_ps();
+	}
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			__m128 w = _mm_mul_ps(bu[i], bv[j]);
+			__m128 wu = _mm_mul_ps(du[i], bv[j]);
+			__m128 wv = _mm_mul_ps(bu[i], dv[j]);
+			const float *c = patch.control[4 * i + j];
+			for (int k = 0; k < 3; k++) {
+				__m128 ck = _mm_set1_ps(c[k]);
+				p[k] = _mm_add_ps(p[k], _mm_mul_ps(w, ck));
+				pu[k] = _mm_add_ps(pu[k], _mm_mul_ps(wu, ck));
+				pv[k] = _mm_add_ps(pv[k], _mm_mul_ps(wv, ck));
+			}
+		}
+	}
+	__m128 n[3];
+	n[0] = _mm_sub_ps(_mm_mul_ps(pu[1], pv[2]), _mm_mul_ps(pu[2], pv[1]));
+	n[1] = _mm_sub_ps(_mm_mul_ps(pu[2], pv[0]), _mm_mul_ps(pu[0], pv[2]));
+	n[2] = _mm_sub_ps(_mm_mul_ps(pu[0], pv[1]), _mm_mul_ps(pu[1], pv[0]));
+	__m128 length2 = _mm_add_ps(
+	    _mm_add_ps(_mm_mul_ps(n[0], n[0]), _mm_mul_ps(n[1], n[1])),
+	    _mm_mul_ps(n[2], n[2]));
+	__m128 degenerate =
+	    _mm_cmple_ps(length2, _mm_set1_ps(BEZIER_DEGENERATE_NORMAL));
+	__m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length2));
+
+	float lanes[6][4];
+	for (int k = 0; k < 3; k++) {
+		_mm_storeu_ps(lanes[k], p[k]);
+		_mm_storeu_ps(lanes[3 + k], _mm_mul_ps(n[k], scale));
+	}
+	int fix = _mm_movemask_ps(degenerate);
+	for (int lane = 0; lane < 4; lane++) {
+		float *o = out + lane * MESH_FLOATS_PER_VERTEX;
+		for (int k = 0; k < 6; k++) {
+			o[k] = lanes[k][lane];
+		}
+		if (fix & (1 << lane)) {
+			normal_at(patch, u[lane], v[lane], o + 3);
+		}
+	}
+}
+#endif
+
+void bezier_evaluate(const BezierPatch &patch, const float *u, const float *v,
+		     uint32_t count, float *out) {
+	uint32_t i = 0;
+#ifdef __SSE2__
+	for (; i + 4 <= count; i += 4) {
+		evaluate4(patch, u + i, v + i,
+			  out + (size_t)i * MESH_FLOATS_PER_VERTEX);
+	}
+#endif
+	for (; i < count; i++) {
+		evaluate_scalar(patch, u[i], v[i],
+				out + (size_t)i * MESH_FLOATS_PER_VERTEX);
+	}
+}
+
+// Control points along edge e, in the direction of edge_point.
+static void edge_controls(const BezierPatch &patch, int e,
+			  const float *out[4]) {
+	for (int k = 0; k < 4; k++) {
+		switch (e) {
+		case 0:
+			out[k] = patch.control[4 * k];
+			break;
+		case 1:
+			out[k] = patch.control[12 + k];
+			break;
+		case 2:
+			out[k] = patch.control[4 * (3 - k) + 3];
+			break;
+		default:
+			out[k] = patch.control[3 - k];
+			break;
+		}
+	}
+}
+
+static inline bool same_point(const float *a, const float *b) {
+	return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+// Writes the positions of the points of edge e from its curve alone,
+// walking it in the same direction whichever patch it belongs to. The patch
+// on the other side of a shared edge then computes bit identical points.
+static void evaluate_edge(const BezierPatch &patch, int e, uint32_t segments,
+			  float *out) {
+	const float *c[4];
+	edge_controls(patch, e, c);
+	int first = same_point(c[0], c[3]) ? 1 : 0;
+	bool reversed = std::lexicographical_compare(
+	    c[3 - first], c[3 - first] + 3, c[first], c[first] + 3);
+	if (reversed) {
+		std::swap(c[0], c[3]);
+		std::swap(c[1], c[2]);
+	}
+	for (uint32_t k = 0; k <= segments; k++) {
+		float b[4], d[4];
+		uint32_t step = reversed ? segments - k : k;
+		bernstein((float)step / segments, b, d);
+		float *p = out + (size_t)k * MESH_FLOATS_PER_VERTEX;
+		for (int i = 0; i < 3; i++) {
+			p[i] = b[0] * c[0][i] + b[1] * c[1][i] +
+			       b[2] * c[2][i] + b[3] * c[3][i];
+		}
+	}
+}
+
+// (u, v) at parameter t along edge, walking the boundary counterclockwise.
+static inline void edge_point(int edge, float t, float *u, float *v) {
+	switch (edge) {
+	case 0:
+		*u = t, *v = 0.0f;
+		break;
+	case 1:
+		*u = 1.0f, *v = t;
+		break;
+	case 2:
+		*u = 1.0f - t, *v = 1.0f;
+		break;
+	default:
+		*u = 0.0f, *v = 1.0f - t;
+		break;
+	}
+}
+
+void bezier_tessellate(const BezierPatch &patch, const BezierLevels &levels,
+		       Mesh *mesh) {
+	uint32_t n = std::max(levels.inner, (uint32_t)BEZIER_MIN_LEVEL);
+	uint32_t m = n - 1; // inner grid points per row
+	std::vector<float> us, vs;
+
+	// Inner grid first, point (i, j) at (i + 1, j + 1) / n.
+	for (uint32_t j = 0; j < m; j++) {
+		for (uint32_t i = 0; i < m; i++) {
+			us.push_back((float)(i + 1) / n);
+			vs.push_back((float)(j + 1) / n);
+		}
+	}
+	auto inner = [m](uint32_t i, uint32_t j) { return j * m + i; };
+	uint32_t edge_base[4];
+	for (int e = 0; e < 4; e++) {
+		uint32_t segments = std::max(levels.edges[e], 1u);
+		edge_base[e] = us.size();
+		for (uint32_t k = 0; k <= segments; k++) {
+			float u, v;
+			edge_point(e, (float)k / segments, &u, &v);
+			us.push_back(u);
+			vs.push_back(v);
+		}
+	}
+
+	uint32_t base = mesh->vertexCount();
+	mesh->vertices.resize((size_t)(base + us.size()) *
+			      MESH_FLOATS_PER_VERTEX);
+	float *vertices = &mesh->vertices[(size_t)base *
+					  MESH_FLOATS_PER_VERTEX];
+	bezier_evaluate(patch, us.data(), vs.data(), us.size(), vertices);
+	for (int e = 0; e < 4; e++) {
+		float *edge = vertices + (size_t)edge_base[e] *
+					     MESH_FLOATS_PER_VERTEX;
+		evaluate_edge(patch, e, std::max(levels.edges[e], 1u), edge);
+	}
+
+	std::vector<uint32_t> &out = mesh->indices;
+	auto triangle = [&](uint32_t a, uint32_t b, uint32_t c) {
+		out.push_back(base + a);
+		out.push_back(base + b);
+		out.push_back(base + c);
+	};
+	for (uint32_t j = 0; j + 1 < m; j++) {
+		for (uint32_t i = 0; i + 1 < m; i++) {
+			triangle(inner(i, j), inner(i + 1, j),
+				 inner(i + 1, j + 1));
+			triangle(inner(i, j), inner(i + 1, j + 1),
+				 inner(i, j + 1));
+		}
+	}
+
+	// Stitch each edge to the side of the inner grid facing it, merging
+	// the two rows by parameter: edge point k sits at k / segments, inner
+	// point k at (k + 1) / n.
+	for (int e = 0; e < 4; e++) {
+		uint32_t segments = std::max(levels.edges[e], 1u);
+		auto side = [&](uint32_t k) {
+			switch (e) {
+			case 0:
+				return inner(k, 0);
+			case 1:
+				return inner(m - 1, k);
+			case 2:
+				return inner(m - 1 - k, m - 1);
+			default:
+				return inner(0, m - 1 - k);
+			}
+		};
+		uint32_t i = 0, k = 0;
+		while (i < segments || k + 1 < m) {
+			bool advance_edge =
+			    k + 1 == m ||
+			    (i < segments && (i + 1) * n <= (k + 2) * segments);
+			if (advance_edge) {
+				triangle(edge_base[e] + i, edge_base[e] + i + 1,
+					 side(k));
+				i++;
+			} else {
+				triangle(edge_base[e] + i, side(k + 1),
+					 side(k));
+				k++;
+			}
+		}
+	}
+}
+
+// Smallest of 2, 3, 4, 6, 8, 12, ... that is at least level. Few distinct
+// levels make the per patch caches effective.
+static uint32_t ladder_level(float level) {
+	uint32_t step = BEZIER_MIN_LEVEL;
+	while (step < BEZIER_MAX_LEVEL && step < level) {
+		step = (step & (step - 1)) == 0 ? step + step / 2
+						: (step / 3) * 4;
+	}
+	return std::min(step, (uint32_t)BEZIER_MAX_LEVEL);
+}
+
+static inline uint64_t levels_key(const BezierLevels &levels) {
+	uint64_t key = levels.inner;
+	for (int e = 0; e < 4; e++) {
+		key |= (uint64_t)levels.edges[e] << (8 * (e + 1));
+	}
+	return key;
+}
+
+BezierTessellator::BezierTessellator(const std::vector<BezierPatch> &patches) {
+	this->patches = patches;
+	this->states.resize(patches.size());
+	this->stats = {};
+	this->stats.patches = patches.size();
+	for (size_t p = 0; p < patches.size(); p++) {
+		PatchState &state = this->states[p];
+		float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+		float hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+		for (int c = 0; c < 16; c++) {
+			for (int k = 0; k < 3; k++) {
+				float x = patches[p].control[c][k];
+				lo[k] = std::min(lo[k], x);
+				hi[k] = std::max(hi[k], x);
+			}
+		}
+		// The patch lies inside the hull of its control points.
+		float radius2 = 0.0f;
+		for (int k = 0; k < 3; k++) {
+			state.center[k] = 0.5f * (lo[k] + hi[k]);
+			radius2 += 0.25f * (hi[k] - lo[k]) * (hi[k] - lo[k]);
+		}
+		state.radius = std::sqrt(radius2);
+		state.level = 0;
+		state.key = 0;
+	}
+	this->findNeighbours();
+}
+
+void BezierTessellator::findNeighbours() {
+	for (size_t p = 0; p < this->patches.size(); p++) {
+		PatchState &state = this->states[p];
+		for (int e = 0; e < 4; e++) {
+			const float *a[4];
+			edge_controls(this->patches[p], e, a);
+			state.neighbours[e] = -1;
+			state.degenerate[e] = same_point(a[0], a[1]) &&
+					      same_point(a[0], a[2]) &&
+					      same_point(a[0], a[3]);
+			if (state.degenerate[e]) {
+				continue;
+			}
+			// A shared edge runs the other way round in the
+			// neighbour.
+			for (size_t q = 0; q < this->patches.size() &&
+					   state.neighbours[e] < 0;
+			     q++) {
+				for (int f = 0; f < 4 && q != p; f++) {
+					const float *b[4];
+					edge_controls(this->patches[q], f, b);
+					if (same_point(a[0], b[3]) &&
+					    same_point(a[1], b[2]) &&
+					    same_point(a[2], b[1]) &&
+					    same_point(a[3], b[0])) {
+						state.neighbours[e] = q;
+						break;
+					}
+				}
+			}
+		}
+	}
+}
+
+// Shared edges take the finer of the two levels, collapsed edges need a
+// single segment.
+BezierLevels BezierTessellator::levels(uint32_t patch) const {
+	const PatchState &state = this->states[patch];
+	BezierLevels levels;
+	levels.inner = state.level;
+	for (int e = 0; e < 4; e++) {
+		levels.edges[e] = state.level;
+		if (state.degenerate[e]) {
+			levels.edges[e] = 1;
+		} else if (state.neighbours[e] >= 0) {
+			levels.edges[e] =
+			    std::max(state.level,
+				     this->states[state.neighbours[e]].level);
+		}
+	}
+	return levels;
+}
+
+bool BezierTessellator::update(const float eye[3], float pixels_per_unit) {
+	for (PatchState &state : this->states) {
+		float d2 = 0.0f;
+		for (int k = 0; k < 3; k++) {
+			d2 += (eye[k] - state.center[k]) *
+			      (eye[k] - state.center[k]);
+		}
+		// Distance to the bounding sphere, at least its radius so the
+		// level stays bounded with the eye inside it.
+		float distance =
+		    std::max(std::sqrt(d2) - state.radius, state.radius);
+		float pixels = 2.0f * state.radius * pixels_per_unit / distance;
+		float level = pixels / BEZIER_PIXELS_PER_SEGMENT;
+		// Refine as soon as needed, coarsen only with a margin.
+		uint32_t refine = ladder_level(level);
+		uint32_t coarsen =
+		    ladder_level(level / (1.0f - BEZIER_HYSTERESIS));
+		if (refine > state.level) {
+			state.level = refine;
+		} else if (coarsen < state.level) {
+			state.level = coarsen;
+		}
+	}
+
+	bool changed = false;
+	this->stats.regenerated = 0;
+	this->stats.cached = 0;
+	this->stats.min_level = BEZIER_MAX_LEVEL;
+	this->stats.max_level = 0;
+	for (size_t p = 0; p < this->states.size(); p++) {
+		PatchState &state = this->states[p];
+		this->stats.min_level =
+		    std::min(this->stats.min_level, state.level);
+		this->stats.max_level =
+		    std::max(this->stats.max_level, state.level);
+		BezierLevels levels = this->levels(p);
+		uint64_t key = levels_key(levels);
+		if (key == state.key) {
+			continue;
+		}
+		changed = true;
+		state.key = key;
+		if (state.cache.count(key) != 0) {
+			this->stats.cached++;
+			continue;
+		}
+		if (state.cache.size() >= BEZIER_CACHE_SIZE) {
+			state.cache.clear();
+		}
+		bezier_tessellate(this->patches[p], levels, &state.cache[key]);
+		this->stats.regenerated++;
+	}
+	if (!changed) {
+		return false;
+	}
+
+	this->mesh.vertices.clear();
+	this->mesh.indices.clear();
+	for (const PatchState &state : this->states) {
+		const Mesh &part = state.cache.at(state.key);
+		uint32_t base = this->mesh.vertexCount();
+		this->mesh.vertices.insert(this->mesh.vertices.end(),
+					   part.vertices.begin(),
+					   part.vertices.end());
+		for (uint32_t i : part.indices) {
+			this->mesh.indices.push_back(base + i);
+		}
+	}
+	this->stats.triangles = this->mesh.indices.size() / 3;
+	return true;
+}
@@ -0,0 +1,103 @@
+#ifndef _BEZIER_PATCH_HPP
+#define _BEZIER_PATCH_HPP
+
+#include "mesh.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Segments along a patch edge. Two keeps an inner vertex to stitch the edges
+// to; 64 keeps a level in one byte of the cache key.
+#define BEZIER_MIN_LEVEL 2
+#define BEZIER_MAX_LEVEL 64
+
+// Screen space length, in pixels, a segment should cover.
+#define BEZIER_PIXELS_PER_SEGMENT 16.0f
+
+// A coarser level is only picked once the needed one is this fraction below
+// it, as with LOD_HYSTERESIS.
+#define BEZIER_HYSTERESIS 0.25f
+
+// Tessellations kept per patch before its cache starts over.
+#define BEZIER_CACHE_SIZE 8
+
+// Bicubic Bezier patch, control[4 * i + j] weighs B_i(u) B_j(v). Patches are
+// oriented so that dP/du x dP/dv faces outward.
+struct BezierPatch {
+	float control[16][3];
+};
+
+// Segments per edge, in the order v = 0, u = 1, v = 1, u = 0, which walks the
+// boundary counterclockwise in (u, v); inner applies to the rest.
+struct BezierLevels {
+	uint32_t inner;
+	uint32_t edges[4];
+};
+
+struct BezierStats {
+	uint32_t patches;
+	uint32_t regenerated; // tessellated by the last update
+	uint32_t cached;      // changed level, found in the cache
+	uint32_t min_level;
+	uint32_t max_level;
+	uint32_t triangles;
+};
+
+// Vertex layout of an array of BezierPatch: the control points as float
+// positions at location 0, 16 vertices per patch.
+MeshLayout bezier_patch_layout();
+
+// Reads the comma separated format of the Newell teapot data: patch count,
+// 16 one-based control point indices per patch, point count, one x,y,z line
+// per point.
+bool bezier_load(const char *path, std::vector<BezierPatch> *patches);
+
+// Writes MESH_FLOATS_PER_VERTEX floats per (u[i], v[i]): position and unit
+// normal. Normals at degenerate points, like the pole of the lid, are taken
+// from just inside the patch.
+void bezier_evaluate(const BezierPatch &patch, const float *u, const float *v,
+		     uint32_t count, float *out);
+
+// Triangulates patch as a regular inner grid surrounded by one ring of
+// triangles that stitches it to the edges. Neighbours that use the same
+// level on a shared edge meet without cracks. Triangles are counterclockwise
+// seen from outside. Appends to mesh, indices offset by its vertex count.
+void bezier_tessellate(const BezierPatch &patch, const BezierLevels &levels,
+		       Mesh *mesh);
+
+// Keeps a tessellation of a patch set at the density the camera needs.
+// Levels are chosen per patch from its projected size and each patch keeps
+// the tessellations it produced recently, so a camera move only evaluates
+// patches whose levels changed to something not seen before.
+class BezierTessellator {
+      private:
+	struct PatchState {
+		float center[3]; // sphere around the control points
+		float radius;
+		int32_t neighbours[4]; // patch sharing each edge, or -1
+		bool degenerate[4];    // edge collapsed to a point
+		uint32_t level;
+		uint64_t key; // levels of the tessellation in mesh
+		std::unordered_map<uint64_t, Mesh> cache;
+	};
+
+	std::vector<BezierPatch> patches;
+	std::vector<PatchState> states;
+
+	void findNeighbours();
+	BezierLevels levels(uint32_t patch) const;
+
+      public:
+	// All patches, rebuilt by update when a level changed.
+	Mesh mesh;
+	BezierStats stats;
+
+	BezierTessellator(const std::vector<BezierPatch> &patches);
+
+	// eye is in the object space of the patches, pixels_per_unit is the
+	// projected size of one unit at distance one. Returns true when mesh
+	// changed.
+	bool update(const float eye[3], float pixels_per_unit);
+};
+
+#endif
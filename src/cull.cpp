@@ -0,0 +1,285 @@
+#include "cull.hpp"
+#include <algorithm>
+#include <cmath>
+
+// SSE2 is part of x86-64; AVX is checked for at run time and its kernel
+// compiled for it alone.
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CULL_X86 1
+#endif
+
+// What the kernels read: centers, and a radius or three half extents.
+struct CullInput {
+	const float *x, *y, *z;
+	const float *radius; // NULL for boxes
+	const float *extent[3];
+	uint32_t count;
+};
+
+Frustum frustum_from_matrix(const glm::mat4 &m) {
+	// glm is column major, m[c][r]; row r is (m[0][r], .., m[3][r]).
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; r++) {
+		rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+	}
+	Frustum frustum;
+	for (int i = 0; i < 3; i++) {
+		frustum.planes[2 * i] = rows[3] + rows[i];
+		frustum.planes[2 * i + 1] = rows[3] - rows[i];
+	}
+	for (glm::vec4 &plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+bool frustum_test_sphere(const Frustum &frustum, const glm::vec3 &center,
+			 float radius) {
+	for (const glm::vec4 &plane : frustum.planes) {
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool frustum_test_box(const Frustum &frustum, const glm::vec3 &center,
+		      const glm::vec3 &extent) {
+	for (const glm::vec4 &plane : frustum.planes) {
+		// How far the box reaches along the plane normal.
+		float reach = glm::dot(glm::abs(glm::vec3(plane)), extent);
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -reach) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Objects from first on, one at a time; also the tail of the SIMD kernels.
+static uint32_t cull_scalar(const Frustum &frustum, const CullInput &in,
+			    uint32_t first, uint32_t *visible) {
+	uint32_t n = 0;
+	for (uint32_t i = first; i < in.count; i++) {
+		glm::vec3 center(in.x[i], in.y[i], in.z[i]);
+		bool inside =
+		    in.radius != NULL
+			? frustum_test_sphere(frustum, center, in.radius[i])
+			: frustum_test_box(frustum, center,
+					   glm::vec3(in.extent[0][i],
+						     in.extent[1][i],
+						     in.extent[2][i]));
+		if (inside) {
+			visible[n++] = i;
+		}
+	}
+	return n;
+}
+
+// The SIMD kernels evaluate the scalar tests' expressions in the same order,
+// so both agree on objects touching a plane. An object is kept when it is on
+// the inner side of all six planes; the lanes that are become bits of a mask
+// and are appended in order.
+#ifdef CULL_X86
+static uint32_t cull_sse(const Frustum &frustum, const CullInput &in,
+			 uint32_t *visible) {
+	__m128 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+	for (int p = 0; p < 6; p++) {
+		const glm::vec4 &plane = frustum.planes[p];
+		nx[p] = _mm_set1_ps(plane.x);
+		ny[p] = _mm_set1_ps(plane.y);
+		nz[p] = _mm_set1_ps(plane.z);
+		nw[p] = _mm_set1_ps(plane.w);
+		ax[p] = _mm_set1_ps(std::fabs(plane.x));
+		ay[p] = _mm_set1_ps(std::fabs(plane.y));
+		az[p] = _mm_set1_ps(std::fabs(plane.z));
+	}
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	uint32_t n = 0, i = 0;
+	for (; i + 4 <= in.count; i += 4) {
+		__m128 x = _mm_loadu_ps(in.x + i);
+		__m128 y = _mm_loadu_ps(in.y + i);
+		__m128 z = _mm_loadu_ps(in.z + i);
+		__m128 radius, ex, ey, ez;
+		if (in.radius != NULL) {
+			radius = _mm_loadu_ps(in.radius + i);
+		} else {
+			ex = _mm_loadu_ps(in.extent[0] + i);
+			ey = _mm_loadu_ps(in.extent[1] + i);
+			ez = _mm_loadu_ps(in.extent[2] + i);
+		}
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m128 d = _mm_add_ps(_mm_mul_ps(nx[p], x),
+					      _mm_mul_ps(ny[p], y));
+			d = _mm_add_ps(_mm_add_ps(d, _mm_mul_ps(nz[p], z)),
+				       nw[p]);
+			__m128 reach = radius;
+			if (in.radius == NULL) {
+				reach = _mm_add_ps(_mm_mul_ps(ax[p], ex),
+						   _mm_mul_ps(ay[p], ey));
+				reach =
+				    _mm_add_ps(reach, _mm_mul_ps(az[p], ez));
+			}
+			inside = _mm_and_ps(
+			    inside, _mm_cmpge_ps(d, _mm_xor_ps(reach, sign)));
+		}
+		for (int mask = _mm_movemask_ps(inside); mask != 0;
+		     mask &= mask - 1) {
+			visible[n++] = i + __builtin_ctz(mask);
+		}
+	}
+	return n + cull_scalar(frustum, in, i, visible + n);
+}
+
+__attribute__((target("avx"))) static uint32_t
+cull_avx(const Frustum &frustum, const CullInput &in, uint32_t *visible) {
+	__m256 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+	for (int p = 0; p < 6; p++) {
+		const glm::vec4 &plane = frustum.planes[p];
+		nx[p] = _mm256_set1_ps(plane.x);
+		ny[p] = _mm256_set1_ps(plane.y);
+		nz[p] = _mm256_set1_ps(plane.z);
+		nw[p] = _mm256_set1_ps(plane.w);
+		ax[p] = _mm256_set1_ps(std::fabs(plane.x));
+		ay[p] = _mm256_set1_ps(std::fabs(plane.y));
+		az[p] = _mm256_set1_ps(std::fabs(plane.z));
+	}
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	uint32_t n = 0, i = 0;
+	for (; i + 8 <= in.count; i += 8) {
+		__m256 x = _mm256_loadu_ps(in.x + i);
+		__m256 y = _mm256_loadu_ps(in.y + i);
+		__m256 z = _mm256_loadu_ps(in.z + i);
+		__m256 radius, ex, ey, ez;
+		if (in.radius != NULL) {
+			radius = _mm256_loadu_ps(in.radius + i);
+		} else {
+			ex = _mm256_loadu_ps(in.extent[0] + i);
+			ey = _mm256_loadu_ps(in.extent[1] + i);
+			ez = _mm256_loadu_ps(in.extent[2] + i);
+		}
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m256 d = _mm256_add_ps(_mm256_mul_ps(nx[p], x),
+						 _mm256_mul_ps(ny[p], y));
+			d = _mm256_add_ps(
+			    _mm256_add_ps(d, _mm256_mul_ps(nz[p], z)), nw[p]);
+			__m256 reach = radius;
+			if (in.radius == NULL) {
+				reach = _mm256_add_ps(_mm256_mul_ps(ax[p], ex),
+						      _mm256_mul_ps(ay[p], ey));
+				reach = _mm256_add_ps(reach,
+						      _mm256_mul_ps(az[p], ez));
+			}
+			inside = _mm256_and_ps(
+			    inside, _mm256_cmp_ps(d, _mm256_xor_ps(reach, sign),
+						  _CMP_GE_OQ));
+		}
+		for (int mask = _mm256_movemask_ps(inside); mask != 0;
+		     mask &= mask - 1) {
+			visible[n++] = i + __builtin_ctz(mask);
+		}
+	}
+	return n + cull_scalar(frustum, in, i, visible + n);
+}
+#endif
+
+CullSimd cull_simd_best() {
+#ifdef CULL_X86
+	static const CullSimd best =
+	    __builtin_cpu_supports("avx") ? CULL_SIMD_AVX : CULL_SIMD_SSE;
+	return best;
+#else
+	return CULL_SIMD_NONE;
+#endif
+}
+
+const char *cull_simd_name(CullSimd simd) {
+	switch (simd) {
+	case CULL_SIMD_SSE:
+		return "sse";
+	case CULL_SIMD_AVX:
+		return "avx";
+	default:
+		return "scalar";
+	}
+}
+
+static uint32_t cull(const Frustum &frustum, const CullInput &in,
+		     uint32_t *visible, CullSimd simd) {
+	simd = std::min(simd, cull_simd_best());
+#ifdef CULL_X86
+	if (simd == CULL_SIMD_AVX) {
+		return cull_avx(frustum, in, visible);
+	}
+	if (simd == CULL_SIMD_SSE) {
+		return cull_sse(frustum, in, visible);
+	}
+#endif
+	return cull_scalar(frustum, in, 0, visible);
+}
+
+uint32_t frustum_cull_spheres(const Frustum &frustum,
+			      const CullSpheres &spheres, uint32_t *visible,
+			      CullSimd simd) {
+	CullInput in = {spheres.x.data(), spheres.y.data(),
+			spheres.z.data(), spheres.radius.data(),
+			{NULL, NULL, NULL}, (uint32_t)spheres.x.size()};
+	return cull(frustum, in, visible, simd);
+}
+
+uint32_t frustum_cull_boxes(const Frustum &frustum, const CullBoxes &boxes,
+			    uint32_t *visible, CullSimd simd) {
+	CullInput in = {boxes.x.data(),
+			boxes.y.data(),
+			boxes.z.data(),
+			NULL,
+			{boxes.extent_x.data(), boxes.extent_y.data(),
+			 boxes.extent_z.data()},
+			(uint32_t)boxes.x.size()};
+	return cull(frustum, in, visible, simd);
+}
+
+void meshlet_cull(const Meshlet *meshlets, uint32_t count,
+		  const glm::mat4 &model, const Frustum &frustum,
+		  const glm::vec3 &eye, std::vector<uint32_t> *visible,
+		  MeshletCullStats *stats) {
+	glm::mat3 linear(model);
+	float scale = std::max(glm::length(linear[0]),
+			       std::max(glm::length(linear[1]),
+					glm::length(linear[2])));
+	uint32_t frustum_culled = 0;
+	uint32_t cone_culled = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		const Meshlet &m = meshlets[i];
+		glm::vec3 center = glm::vec3(
+		    model *
+		    glm::vec4(m.center[0], m.center[1], m.center[2], 1.0f));
+		float radius = m.radius * scale;
+		if (!frustum_test_sphere(frustum, center, radius)) {
+			frustum_culled++;
+			continue;
+		}
+		// Every triangle faces away when the direction from the eye
+		// is within the cone's complement around the axis, for every
+		// point of the bounding sphere.
+		if (m.cone_cutoff < 1.0f) {
+			glm::vec3 axis = glm::normalize(
+			    linear * glm::vec3(m.cone_axis[0], m.cone_axis[1],
+					       m.cone_axis[2]));
+			glm::vec3 view = center - eye;
+			if (glm::dot(view, axis) >=
+			    m.cone_cutoff * glm::length(view) + radius) {
+				cone_culled++;
+				continue;
+			}
+		}
+		visible->push_back(i);
+	}
+	if (stats != NULL) {
+		stats->total = count;
+		stats->frustum_culled = frustum_culled;
+		stats->cone_culled = cone_culled;
+	}
+}
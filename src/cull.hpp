@@ -0,0 +1,75 @@
+#ifndef _CULL_HPP
+#define _CULL_HPP
+
+#include "mesh.hpp"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Planes with inward normals, xyz normalized, in the space of the matrix
+// they were extracted from.
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+struct MeshletCullStats {
+	uint32_t total;
+	uint32_t frustum_culled;
+	uint32_t cone_culled;
+};
+
+// Bounds in structure of arrays form, the layout the culling kernels load a
+// register of objects at a time from. Boxes are centers and half extents.
+struct CullSpheres {
+	std::vector<float> x, y, z;
+	std::vector<float> radius;
+};
+
+struct CullBoxes {
+	std::vector<float> x, y, z;
+	std::vector<float> extent_x, extent_y, extent_z;
+};
+
+// Instruction sets of the culling kernels, each implies the ones before.
+enum CullSimd : uint32_t {
+	CULL_SIMD_NONE = 0,
+	CULL_SIMD_SSE = 1, // 4 objects per iteration
+	CULL_SIMD_AVX = 2, // 8 objects per iteration
+};
+
+// Gribb and Hartmann; pass projection * view for world space planes.
+Frustum frustum_from_matrix(const glm::mat4 &m);
+
+bool frustum_test_sphere(const Frustum &frustum, const glm::vec3 &center,
+			 float radius);
+
+bool frustum_test_box(const Frustum &frustum, const glm::vec3 &center,
+		      const glm::vec3 &extent);
+
+// The widest kernel this CPU runs.
+CullSimd cull_simd_best();
+
+const char *cull_simd_name(CullSimd simd);
+
+// Writes the indices of the spheres or boxes that intersect the frustum to
+// visible, ascending, and returns how many there are; visible needs room for
+// all of them. The answers match frustum_test_sphere and frustum_test_box
+// exactly, with any simd; one the CPU lacks falls back to the best it has.
+uint32_t frustum_cull_spheres(const Frustum &frustum,
+			      const CullSpheres &spheres, uint32_t *visible,
+			      CullSimd simd = cull_simd_best());
+
+uint32_t frustum_cull_boxes(const Frustum &frustum, const CullBoxes &boxes,
+			    uint32_t *visible,
+			    CullSimd simd = cull_simd_best());
+
+// Appends the indices of the meshlets that are inside the frustum and not
+// entirely back facing as seen from eye. Meshlet bounds are transformed by
+// model; the cone test assumes model has no non-uniform scale. stats may be
+// NULL.
+void meshlet_cull(const Meshlet *meshlets, uint32_t count,
+		  const glm::mat4 &model, const Frustum &frustum,
+		  const glm::vec3 &eye, std::vector<uint32_t> *visible,
+		  MeshletCullStats *stats);
+
+#endif
@@ -0,0 +1,224 @@
+#include "gl_state.hpp"
+#include <GL/glew.h>
+
+// Value of an entry whose GL state is not known.
+#define UNKNOWN 0xffffffffu
+
+enum {
+	BUFFER_ARRAY,
+	BUFFER_UNIFORM,
+	BUFFER_DRAW_INDIRECT,
+	BUFFER_SHADER_STORAGE,
+	BUFFER_COPY_READ,
+	BUFFER_COPY_WRITE,
+	BUFFER_TARGETS,
+};
+
+enum {
+	CAPABILITY_DEPTH_TEST,
+	CAPABILITY_BLEND,
+	CAPABILITY_CULL_FACE,
+	CAPABILITIES,
+};
+
+struct Texture {
+	unsigned int target;
+	unsigned int name;
+};
+
+struct GlState {
+	unsigned int program;
+	unsigned int vao;
+	unsigned int buffers[BUFFER_TARGETS];
+	unsigned int active_texture;
+	Texture textures[GL_STATE_TEXTURE_UNITS];
+	unsigned int capabilities[CAPABILITIES]; // GL_TRUE, GL_FALSE
+	unsigned int depth_mask;
+	unsigned int depth_func;
+	unsigned int blend_source;
+	unsigned int blend_destination;
+	GlStateStats stats;
+
+	GlState() {
+		this->stats = {};
+		this->forgetAll();
+	}
+
+	void forgetAll() {
+		this->program = this->vao = UNKNOWN;
+		for (unsigned int &b : this->buffers) {
+			b = UNKNOWN;
+		}
+		this->active_texture = UNKNOWN;
+		for (Texture &t : this->textures) {
+			t = {UNKNOWN, UNKNOWN};
+		}
+		for (unsigned int &c : this->capabilities) {
+			c = UNKNOWN;
+		}
+		this->depth_mask = this->depth_func = UNKNOWN;
+		this->blend_source = this->blend_destination = UNKNOWN;
+	}
+
+	// Stores value in *entry and returns true when GL has to be told.
+	bool change(unsigned int *entry, unsigned int value) {
+		if (*entry == value) {
+			this->stats.elided++;
+			return false;
+		}
+		*entry = value;
+		this->stats.issued++;
+		return true;
+	}
+};
+
+static thread_local GlState state;
+
+static int buffer_index(unsigned int target) {
+	switch (target) {
+	case GL_ARRAY_BUFFER:
+		return BUFFER_ARRAY;
+	case GL_UNIFORM_BUFFER:
+		return BUFFER_UNIFORM;
+	case GL_DRAW_INDIRECT_BUFFER:
+		return BUFFER_DRAW_INDIRECT;
+	case GL_SHADER_STORAGE_BUFFER:
+		return BUFFER_SHADER_STORAGE;
+	case GL_COPY_READ_BUFFER:
+		return BUFFER_COPY_READ;
+	case GL_COPY_WRITE_BUFFER:
+		return BUFFER_COPY_WRITE;
+	}
+	return -1;
+}
+
+static int capability_index(unsigned int capability) {
+	switch (capability) {
+	case GL_DEPTH_TEST:
+		return CAPABILITY_DEPTH_TEST;
+	case GL_BLEND:
+		return CAPABILITY_BLEND;
+	case GL_CULL_FACE:
+		return CAPABILITY_CULL_FACE;
+	}
+	return -1;
+}
+
+void gl_state_use_program(unsigned int program) {
+	if (state.change(&state.program, program)) {
+		glUseProgram(program);
+	}
+}
+
+void gl_state_bind_vertex_array(unsigned int vao) {
+	if (state.change(&state.vao, vao)) {
+		glBindVertexArray(vao);
+	}
+}
+
+void gl_state_bind_buffer(unsigned int target, unsigned int buffer) {
+	int i = buffer_index(target);
+	if (i < 0) {
+		state.stats.issued++;
+		glBindBuffer(target, buffer);
+	} else if (state.change(&state.buffers[i], buffer)) {
+		glBindBuffer(target, buffer);
+	}
+}
+
+void gl_state_bind_buffer_base(unsigned int target, unsigned int index,
+			       unsigned int buffer) {
+	int i = buffer_index(target);
+	if (i >= 0) {
+		state.buffers[i] = buffer;
+	}
+	state.stats.issued++;
+	glBindBufferBase(target, index, buffer);
+}
+
+void gl_state_bind_texture(unsigned int unit, unsigned int target,
+			   unsigned int texture) {
+	if (unit >= GL_STATE_TEXTURE_UNITS) {
+		state.active_texture = unit;
+		state.stats.issued += 2;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		return;
+	}
+	Texture &t = state.textures[unit];
+	if (t.target == target && t.name == texture) {
+		state.stats.elided++;
+		return;
+	}
+	if (state.change(&state.active_texture, unit)) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+	t = {target, texture};
+	state.stats.issued++;
+	glBindTexture(target, texture);
+}
+
+void gl_state_set(unsigned int capability, bool enabled) {
+	int i = capability_index(capability);
+	unsigned int value = enabled ? GL_TRUE : GL_FALSE;
+	if (i >= 0 && !state.change(&state.capabilities[i], value)) {
+		return;
+	}
+	if (i < 0) {
+		state.stats.issued++;
+	}
+	if (enabled) {
+		glEnable(capability);
+	} else {
+		glDisable(capability);
+	}
+}
+
+void gl_state_depth_mask(bool write) {
+	if (state.change(&state.depth_mask, write ? GL_TRUE : GL_FALSE)) {
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+	}
+}
+
+void gl_state_depth_func(unsigned int func) {
+	if (state.change(&state.depth_func, func)) {
+		glDepthFunc(func);
+	}
+}
+
+void gl_state_blend_func(unsigned int source, unsigned int destination) {
+	if (state.blend_source == source &&
+	    state.blend_destination == destination) {
+		state.stats.elided++;
+		return;
+	}
+	state.blend_source = source;
+	state.blend_destination = destination;
+	state.stats.issued++;
+	glBlendFunc(source, destination);
+}
+
+void gl_state_forget(unsigned int name) {
+	if (state.program == name) {
+		state.program = UNKNOWN;
+	}
+	if (state.vao == name) {
+		state.vao = UNKNOWN;
+	}
+	for (unsigned int &b : state.buffers) {
+		if (b == name) {
+			b = UNKNOWN;
+		}
+	}
+	for (Texture &t : state.textures) {
+		if (t.name == name) {
+			t = {UNKNOWN, UNKNOWN};
+		}
+	}
+}
+
+void gl_state_invalidate() { state.forgetAll(); }
+
+GlStateStats gl_state_stats() { return state.stats; }
+
+void gl_state_reset_stats() { state.stats = {}; }
@@ -0,0 +1,52 @@
+#ifndef _GL_STATE_HPP
+#define _GL_STATE_HPP
+
+#include <cstdint>
+
+// Texture units whose bindings are shadowed; others always reach GL.
+#define GL_STATE_TEXTURE_UNITS 16
+
+// Calls made through the functions below since the last
+// gl_state_reset_stats, on the calling thread.
+struct GlStateStats {
+	uint32_t issued; // passed on to GL
+	uint32_t elided; // skipped, the state was already set
+};
+
+// Shadow of the program, vertex array, buffer and texture bindings and the
+// depth and blend state, so setting what is already set makes no GL call.
+// The shadow is per thread, as each thread has one context current. Changes
+// made with plain GL calls are not seen; code that does so, other than
+// ImGui's renderer which restores what it changes, must call
+// gl_state_invalidate.
+void gl_state_use_program(unsigned int program);
+void gl_state_bind_vertex_array(unsigned int vao);
+
+// The element array binding belongs to the bound vertex array and is not
+// shadowed, neither are targets the renderer does not use.
+void gl_state_bind_buffer(unsigned int target, unsigned int buffer);
+
+// Always issued, but also sets the generic binding of target.
+void gl_state_bind_buffer_base(unsigned int target, unsigned int index,
+			       unsigned int buffer);
+
+void gl_state_bind_texture(unsigned int unit, unsigned int target,
+			   unsigned int texture);
+
+// capability is GL_DEPTH_TEST, GL_BLEND or GL_CULL_FACE.
+void gl_state_set(unsigned int capability, bool enabled);
+void gl_state_depth_mask(bool write);
+void gl_state_depth_func(unsigned int func);
+void gl_state_blend_func(unsigned int source, unsigned int destination);
+
+// To call after deleting an object: GL unbinds it and may hand its name out
+// again. Names of all kinds are matched, forgetting a binding is harmless.
+void gl_state_forget(unsigned int name);
+
+// Forgets everything, the next call of each kind reaches GL.
+void gl_state_invalidate();
+
+GlStateStats gl_state_stats();
+void gl_state_reset_stats();
+
+#endif
@@ -0,0 +1,190 @@
+#include "gpu_mesh.hpp"
+#include "gl_state.hpp"
+#include <GL/glew.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <vector>
+
+void gpu_mesh_upload(GpuMesh *gpu, const MeshLayout &layout,
+		     const void *vertices, size_t vertices_size,
+		     uint32_t vertex_count, const void *indices,
+		     uint32_t index_count, uint32_t index_size,
+		     const MeshLodRange *lods, uint32_t lod_count) {
+	// Both buffers go through GL_ARRAY_BUFFER; the element binding
+	// belongs to a VAO, which the uploading context may not have.
+	gpu->VAO = 0;
+	gpu->layout = layout;
+	glGenBuffers(1, &gpu->VBO);
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, gpu->VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices_size, vertices, GL_STATIC_DRAW);
+
+	gpu->EBO = 0;
+	gpu->vertex_format = MESH_VERTEX_FLOAT;
+	gpu->dequantize = glm::mat4(1.0f);
+	gpu->vertex_count = vertex_count;
+	gpu->index_count = 0;
+	gpu->index_type = GL_UNSIGNED_INT;
+	gpu->index_size = 0;
+	gpu->lods.clear();
+	gpu->meshlets.clear();
+	gpu->aabb_min = gpu->aabb_max = glm::vec3(0.0f);
+	if (indices != NULL && index_count > 0) {
+		glGenBuffers(1, &gpu->EBO);
+		gl_state_bind_buffer(GL_ARRAY_BUFFER, gpu->EBO);
+		glBufferData(GL_ARRAY_BUFFER, (size_t)index_count * index_size,
+			     indices, GL_STATIC_DRAW);
+		gpu->index_count = index_count;
+		gpu->index_size = index_size;
+		gpu->index_type =
+		    index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		if (lods != NULL && lod_count > 0) {
+			gpu->lods.assign(lods, lods + lod_count);
+		} else {
+			gpu->lods.push_back({0, index_count, 0.0f, 0});
+		}
+	}
+}
+
+unsigned int gpu_vertex_array_create(const GpuVertexStream *streams,
+				     uint32_t count,
+				     unsigned int index_buffer) {
+	unsigned int vao;
+	glGenVertexArrays(1, &vao);
+	gl_state_bind_vertex_array(vao);
+	if (index_buffer != 0) {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	}
+	for (uint32_t s = 0; s < count; s++) {
+		const MeshLayout &layout = streams[s].layout;
+		gl_state_bind_buffer(GL_ARRAY_BUFFER, streams[s].buffer);
+		for (uint32_t i = 0; i < layout.attribute_count; i++) {
+			const MeshAttribute &a = layout.attributes[i];
+			void *offset = (void *)(size_t)a.offset;
+			if (a.type == MESH_TYPE_UNSIGNED_INT) {
+				glVertexAttribIPointer(a.location, a.components,
+						       a.type, layout.stride,
+						       offset);
+			} else {
+				glVertexAttribPointer(
+				    a.location, a.components, a.type,
+				    a.normalized ? GL_TRUE : GL_FALSE,
+				    layout.stride, offset);
+			}
+			if (streams[s].divisor != 0) {
+				glVertexAttribDivisor(a.location,
+						      streams[s].divisor);
+			}
+			glEnableVertexAttribArray(a.location);
+		}
+	}
+	gl_state_bind_vertex_array(0);
+	return vao;
+}
+
+void gpu_mesh_create_vao(GpuMesh *gpu) {
+	GpuVertexStream stream = {gpu->VBO, gpu->layout, 0};
+	gpu->VAO = gpu_vertex_array_create(&stream, 1, gpu->EBO);
+}
+
+void gpu_mesh_update(GpuMesh *gpu, const void *vertices, size_t vertices_size,
+		     uint32_t vertex_count, const void *indices,
+		     uint32_t index_count, uint32_t index_size) {
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, gpu->VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices_size, vertices,
+		     GL_DYNAMIC_DRAW);
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, gpu->EBO);
+	glBufferData(GL_ARRAY_BUFFER, (size_t)index_count * index_size,
+		     indices, GL_DYNAMIC_DRAW);
+	gpu->vertex_count = vertex_count;
+	gpu->index_count = index_count;
+	gpu->index_size = index_size;
+	gpu->index_type = index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	gpu->lods.assign(1, {0, index_count, 0.0f, 0});
+}
+
+void gpu_mesh_set_format(GpuMesh *gpu, MeshVertexFormat format,
+			 const float aabb_min[3], const float aabb_max[3]) {
+	gpu->vertex_format = format;
+	gpu->dequantize = glm::mat4(1.0f);
+	gpu->aabb_min = glm::vec3(aabb_min[0], aabb_min[1], aabb_min[2]);
+	gpu->aabb_max = glm::vec3(aabb_max[0], aabb_max[1], aabb_max[2]);
+	if (format == MESH_VERTEX_QUANTIZED) {
+		glm::vec3 lo(aabb_min[0], aabb_min[1], aabb_min[2]);
+		glm::vec3 extent(aabb_max[0], aabb_max[1], aabb_max[2]);
+		extent -= lo;
+		for (int k = 0; k < 3; k++) {
+			extent[k] = extent[k] > 0.0f ? extent[k] : 1.0f;
+		}
+		gpu->dequantize = glm::translate(glm::mat4(1.0f), lo);
+		gpu->dequantize = glm::scale(gpu->dequantize, extent);
+	}
+}
+
+void gpu_mesh_set_meshlets(GpuMesh *gpu, const Meshlet *meshlets,
+			   uint32_t count) {
+	gpu->meshlets.assign(meshlets, meshlets + count);
+}
+
+size_t gpu_mesh_size(const GpuMesh &gpu) {
+	return (size_t)gpu.vertex_count * gpu.layout.stride +
+	       (size_t)gpu.index_count * gpu.index_size;
+}
+
+void gpu_mesh_draw(const GpuMesh &gpu, uint32_t lod) {
+	gl_state_bind_vertex_array(gpu.VAO);
+	if (gpu.EBO != 0) {
+		if (lod >= gpu.lods.size()) {
+			lod = gpu.lods.size() - 1;
+		}
+		const MeshLodRange &range = gpu.lods[lod];
+		glDrawElements(GL_TRIANGLES, range.index_count, gpu.index_type,
+			       (void *)((size_t)range.index_offset *
+					gpu.index_size));
+	} else {
+		glDrawArrays(GL_TRIANGLES, 0, gpu.vertex_count);
+	}
+}
+
+uint32_t gpu_mesh_draw_meshlets(const GpuMesh &gpu, const uint32_t *visible,
+				uint32_t count) {
+	std::vector<GLsizei> counts;
+	std::vector<const void *> offsets;
+	uint32_t end = ~0u;
+	for (uint32_t i = 0; i < count; i++) {
+		const Meshlet &m = gpu.meshlets[visible[i]];
+		if (m.index_offset == end) {
+			counts.back() += m.index_count;
+		} else {
+			counts.push_back(m.index_count);
+			offsets.push_back(
+			    (void *)((size_t)m.index_offset * gpu.index_size));
+		}
+		end = m.index_offset + m.index_count;
+	}
+	if (counts.empty()) {
+		return 0;
+	}
+	gl_state_bind_vertex_array(gpu.VAO);
+	glMultiDrawElements(GL_TRIANGLES, counts.data(), gpu.index_type,
+			    offsets.data(), counts.size());
+	return counts.size();
+}
+
+void gpu_mesh_draw_patches(const GpuMesh &gpu, uint32_t vertices_per_patch) {
+	gl_state_bind_vertex_array(gpu.VAO);
+	glPatchParameteri(GL_PATCH_VERTICES, vertices_per_patch);
+	glDrawArrays(GL_PATCHES, 0, gpu.vertex_count);
+}
+
+void gpu_mesh_destroy(GpuMesh *gpu) {
+	if (gpu->VAO != 0) {
+		glDeleteVertexArrays(1, &gpu->VAO);
+	}
+	glDeleteBuffers(1, &gpu->VBO);
+	if (gpu->EBO != 0) {
+		glDeleteBuffers(1, &gpu->EBO);
+	}
+	gl_state_forget(gpu->VAO);
+	gl_state_forget(gpu->VBO);
+	gl_state_forget(gpu->EBO);
+	gpu->VAO = gpu->VBO = gpu->EBO = 0;
+}
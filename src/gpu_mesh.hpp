@@ -0,0 +1,93 @@
+#ifndef _GPU_MESH_HPP
+#define _GPU_MESH_HPP
+
+#include "mesh.hpp"
+#include "mesh_quantize.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// A mesh resident in GL buffers. The VAO captures the attribute layout once,
+// drawing only needs to bind it.
+struct GpuMesh {
+	unsigned int VAO;
+	unsigned int VBO;
+	unsigned int EBO; // 0 for triangle lists
+	uint32_t vertex_count;
+	uint32_t index_count;
+	unsigned int index_type; // GL_UNSIGNED_SHORT / GL_UNSIGNED_INT
+	uint32_t index_size;
+	MeshLayout layout;
+	// Ranges of the index buffer, LOD0 first. A single range covering
+	// everything for meshes baked without LODs.
+	std::vector<MeshLodRange> lods;
+	// CPU copy of the LOD0 meshlet bounds, for culling.
+	std::vector<Meshlet> meshlets;
+	MeshVertexFormat vertex_format;
+	// Maps quantized positions back to object space, fold into the model
+	// matrix. Identity for MESH_VERTEX_FLOAT.
+	glm::mat4 dequantize;
+	// Object space bounds, for LOD selection.
+	glm::vec3 aabb_min;
+	glm::vec3 aabb_max;
+};
+
+// One buffer of a vertex array and the attributes read from it.
+struct GpuVertexStream {
+	unsigned int buffer;
+	MeshLayout layout;
+	uint32_t divisor; // 0 per vertex, 1 per instance
+};
+
+// Creates a vertex array reading each stream's attributes from its buffer,
+// e.g. positions and the rest of the vertex apart so a depth pass reads
+// positions only. The streams must use distinct locations, see
+// vertex_layouts_disjoint. index_buffer may be 0.
+unsigned int gpu_vertex_array_create(const GpuVertexStream *streams,
+				     uint32_t count,
+				     unsigned int index_buffer);
+
+// Creates and fills the buffers. Buffers are shared between contexts, so
+// this may run on a loader thread with a shared context; VAOs are not, call
+// gpu_mesh_create_vao on the context that draws.
+void gpu_mesh_upload(GpuMesh *gpu, const MeshLayout &layout,
+		     const void *vertices, size_t vertices_size,
+		     uint32_t vertex_count, const void *indices,
+		     uint32_t index_count, uint32_t index_size,
+		     const MeshLodRange *lods, uint32_t lod_count);
+
+// Creates the vertex array of the mesh's single stream.
+void gpu_mesh_create_vao(GpuMesh *gpu);
+
+// Replaces the contents of an uploaded indexed mesh, for geometry rebuilt on
+// the CPU. The old storage is orphaned so a draw still in flight keeps it.
+void gpu_mesh_update(GpuMesh *gpu, const void *vertices, size_t vertices_size,
+		     uint32_t vertex_count, const void *indices,
+		     uint32_t index_count, uint32_t index_size);
+
+void gpu_mesh_set_format(GpuMesh *gpu, MeshVertexFormat format,
+			 const float aabb_min[3], const float aabb_max[3]);
+
+void gpu_mesh_set_meshlets(GpuMesh *gpu, const Meshlet *meshlets,
+			   uint32_t count);
+
+// Bytes held in the vertex and index buffers.
+size_t gpu_mesh_size(const GpuMesh &gpu);
+
+// Draws lod, clamped to the levels the mesh has.
+void gpu_mesh_draw(const GpuMesh &gpu, uint32_t lod = 0);
+
+// Draws the listed meshlets, ascending, with one glMultiDrawElements;
+// neighbours in the index buffer are merged into one range. Returns the
+// number of ranges.
+uint32_t gpu_mesh_draw_meshlets(const GpuMesh &gpu, const uint32_t *visible,
+				uint32_t count);
+
+// Draws the vertices as GL_PATCHES of vertices_per_patch control points,
+// for the tessellation shaders.
+void gpu_mesh_draw_patches(const GpuMesh &gpu, uint32_t vertices_per_patch);
+
+void gpu_mesh_destroy(GpuMesh *gpu);
+
+#endif
@@ -0,0 +1,32 @@
+#include "gpu_timer.hpp"
+#include <GL/glew.h>
+
+GpuTimer::GpuTimer() {
+	glGenQueries(GPU_TIMER_QUERIES, this->queries);
+	this->frame = 0;
+	this->ms = 0.0f;
+}
+
+GpuTimer::~GpuTimer() { glDeleteQueries(GPU_TIMER_QUERIES, this->queries); }
+
+void GpuTimer::begin() {
+	glBeginQuery(GL_TIME_ELAPSED,
+		     this->queries[this->frame % GPU_TIMER_QUERIES]);
+}
+
+void GpuTimer::end() {
+	glEndQuery(GL_TIME_ELAPSED);
+	this->frame++;
+	if (this->frame < GPU_TIMER_QUERIES) {
+		return;
+	}
+	// The oldest query, the next one begin reuses.
+	unsigned int query = this->queries[this->frame % GPU_TIMER_QUERIES];
+	GLint available = 0;
+	glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available) {
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+		this->ms = ns / 1e6f;
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef _GPU_TIMER_HPP
+#define _GPU_TIMER_HPP
+
+#include <cstdint>
+
+// Queries in flight; results are read this many frames late so reading
+// never waits for the GPU.
+#define GPU_TIMER_QUERIES 4
+
+// GPU time spent on the commands between begin and end, once per frame,
+// with GL_TIME_ELAPSED queries.
+class GpuTimer {
+      private:
+	unsigned int queries[GPU_TIMER_QUERIES];
+	uint32_t frame;
+
+      public:
+	float ms; // latest available measurement
+
+	GpuTimer();
+	~GpuTimer();
+
+	void begin();
+	void end();
+};
+
+#endif
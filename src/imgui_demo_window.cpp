@@ -45,3 +45,120 @@ void imgui_demo_window(bool show_demo_window, glm::vec3 &camera_eye,
 	}
 	ImGui::End();
 }
+
+void imgui_stats_window(const RenderStats &stats, bool &hardware_tessellation,
+			uint32_t &lighting, uint32_t &instance_count,
+			uint32_t &draw_path, bool &cull_bvh) {
+	ImGui::Begin("Stats");
+	ImGui::CheckboxFlags("directional light", &lighting,
+			     SHADER_DIRECTIONAL_LIGHT);
+	ImGui::CheckboxFlags("phong specular", &lighting,
+			     SHADER_PHONG_SPECULAR);
+	ImGui::CheckboxFlags("attenuation", &lighting, SHADER_ATTENUATION);
+	const ShaderSetupStats &shaders = stats.shaders;
+	ImGui::Text("shaders %u, %u cached, %u compiling%s", shaders.programs,
+		    shaders.cached, shaders.pending,
+		    shaders.parallel ? " in parallel" : "");
+	ImGui::Text("issued in %.1f ms, startup took %.1f ms",
+		    shaders.issue_ms, shaders.ms);
+	if (shaders.watching) {
+		ImGui::Text("reloaded %u, %u from cache, %u failed to build",
+			    shaders.reloads, shaders.reloads_cached,
+			    shaders.failures);
+	}
+	ImGui::Text("uniform lookups by name %u", stats.uniform_lookups);
+	ImGui::Text("uniform block uploads %u bytes",
+		    stats.uniform_block_bytes);
+	ImGui::Text("GL state calls %u issued, %u elided",
+		    stats.gl_state.issued, stats.gl_state.elided);
+	const RenderQueueStats &queue = stats.queue;
+	ImGui::Text("queue %u packets, %u draws, %u programs, %u meshes",
+		    queue.packets, queue.draws, queue.programs, queue.meshes);
+	// Multi-draw is the last path, left out when the context lacks it.
+	int path = draw_path;
+	ImGui::Combo("draw path", &path, DRAW_PATH_NAMES,
+		     stats.multi_draw_supported ? DRAW_PATH_COUNT
+						: DRAW_PATH_MULTI_DRAW);
+	draw_path = path;
+	if (draw_path == DRAW_PATH_MULTI_DRAW) {
+		ImGui::Text("multi-draws %u, pool %u meshes, %.1f KB",
+			    queue.multi_draws, stats.mesh_pool.meshes,
+			    stats.mesh_pool.bytes / 1024.0f);
+	}
+	ImGui::Text("sort %.3f ms, submit %.3f ms", queue.sort_ms,
+		    queue.submit_ms);
+	const uint32_t no_instances = 0, max_instances = STATS_MAX_INSTANCES;
+	ImGui::SliderScalar("teapot copies", ImGuiDataType_U32, &instance_count,
+			    &no_instances, &max_instances);
+	if (instance_count > 0) {
+		ImGui::Text("copies %u drawn, %u culled, %u draws, %.1f KB",
+			    stats.instances, stats.instances_culled,
+			    stats.instance_draws,
+			    stats.instance_bytes / 1024.0f);
+		ImGui::Checkbox("cull copies with the BVH", &cull_bvh);
+		ImGui::Text("copies culled in %.3f ms (%s)",
+			    stats.instance_cull_ms,
+			    stats.instance_cull_bvh
+				? "bvh"
+				: cull_simd_name(cull_simd_best()));
+	}
+	const SceneBvhStats &bvh = stats.scene_bvh;
+	ImGui::Text("scene bvh %u nodes, depth %u, cost %.1f, %u visited",
+		    bvh.nodes, bvh.depth, stats.scene_bvh_cost, bvh.visited);
+	ImGui::Text("built in %.3f ms, light cube refit in %.3f ms",
+		    stats.scene_build_ms, stats.scene_move_ms);
+	if (stats.picked == SCENE_GROUND) {
+		ImGui::Text("cursor on the ground, %.2f away",
+			    stats.picked_distance);
+	} else if (stats.picked == SCENE_LIGHTCUBE) {
+		ImGui::Text("cursor on the light cube, %.2f away",
+			    stats.picked_distance);
+	} else if (stats.picked_triangle != BVH_NONE) {
+		ImGui::Text("cursor on copy %u, triangle %u, %.2f away",
+			    stats.picked - SCENE_COPIES, stats.picked_triangle,
+			    stats.picked_distance);
+	} else if (stats.picked != BVH_NONE) {
+		ImGui::Text("cursor on copy %u, %.2f away",
+			    stats.picked - SCENE_COPIES,
+			    stats.picked_distance);
+	}
+	if (stats.bezier) {
+		if (stats.tessellation_supported) {
+			ImGui::Checkbox("hardware tessellation",
+					&hardware_tessellation);
+		}
+		ImGui::Text("teapot buffers %.1f KB, %.2f ms GPU",
+			    stats.asset_buffer_bytes / 1024.0f,
+			    stats.asset_gpu_ms);
+		if (stats.bezier_hardware) {
+			ImGui::End();
+			return;
+		}
+		const BezierStats &patches = stats.bezier_patches;
+		ImGui::Text("teapot %u patches, %u triangles", patches.patches,
+			    patches.triangles);
+		ImGui::Text("levels %u .. %u", patches.min_level,
+			    patches.max_level);
+		ImGui::Text("retessellated %u, from cache %u",
+			    patches.regenerated, patches.cached);
+		ImGui::End();
+		return;
+	}
+	if (!stats.asset_resident) {
+		ImGui::Text("teapot loading");
+		ImGui::End();
+		return;
+	}
+	ImGui::Text("teapot loaded in %.1f ms, %.1f MB/s",
+		    stats.asset_load.latency_ms,
+		    stats.asset_load.bytes_per_second / 1e6f);
+	ImGui::Text("teapot buffers %.1f KB, %.2f ms GPU",
+		    stats.asset_buffer_bytes / 1024.0f, stats.asset_gpu_ms);
+	ImGui::Text("teapot lod %u of %u, %u triangles", stats.asset_lod,
+		    stats.asset_lod_count - 1, stats.asset_triangles);
+	ImGui::Text("lod error %.2f px", stats.asset_error_pixels);
+	ImGui::Text("meshlets %u, culled %u frustum %u cone, %u draws",
+		    stats.meshlets.total, stats.meshlets.frustum_culled,
+		    stats.meshlets.cone_culled, stats.asset_draws);
+	ImGui::End();
+}
@@ -1,6 +1,7 @@
 #ifndef _IMGUI_DEMO_WINDOW_HPP
 #define _IMGUI_DEMO_WINDOW_HPP
 
+#include "render_stats.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -9,4 +10,14 @@ void imgui_demo_window(bool show_demo_window, glm::vec3 &camera_eye,
 		       glm::vec3 &camera_center, float &camera_fov,
 		       glm::vec3 &lightcube_pos);
 
+// Upper end of the instance_count slider.
+#define STATS_MAX_INSTANCES 20000
+
+// lighting is a ShaderPermutation, instance_count the number of teapot
+// copies and draw_path a DrawPath. cull_bvh culls the copies through the
+// scene BVH rather than testing each.
+void imgui_stats_window(const RenderStats &stats, bool &hardware_tessellation,
+			uint32_t &lighting, uint32_t &instance_count,
+			uint32_t &draw_path, bool &cull_bvh);
+
 #endif
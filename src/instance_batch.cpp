@@ -0,0 +1,106 @@
+#include "instance_batch.hpp"
+#include "gl_state.hpp"
+#include <GL/glew.h>
+
+InstanceData instance_data(const glm::mat4 &model, uint32_t material) {
+	InstanceData instance;
+	for (int row = 0; row < 3; row++) {
+		for (int column = 0; column < 4; column++) {
+			instance.model[row][column] = model[column][row];
+		}
+	}
+	instance.material = material;
+	return instance;
+}
+
+InstanceBatch::InstanceBatch(const GpuMesh *mesh) {
+	this->mesh = mesh;
+	this->stats = {};
+	uint32_t count = mesh->lods.empty() ? 1 : mesh->lods.size();
+	this->levels.resize(count);
+	for (Level &level : this->levels) {
+		glGenBuffers(1, &level.buffer);
+		level.capacity = 0;
+		GpuVertexStream streams[] = {
+		    {mesh->VBO, mesh->layout, 0},
+		    {level.buffer, VERTEX_LAYOUT_INSTANCE, 1},
+		};
+		level.VAO = gpu_vertex_array_create(streams, 2, mesh->EBO);
+	}
+}
+
+InstanceBatch::~InstanceBatch() {
+	for (Level &level : this->levels) {
+		glDeleteVertexArrays(1, &level.VAO);
+		glDeleteBuffers(1, &level.buffer);
+		gl_state_forget(level.VAO);
+		gl_state_forget(level.buffer);
+	}
+}
+
+void InstanceBatch::clear() {
+	for (Level &level : this->levels) {
+		level.instances.clear();
+	}
+	this->stats.instances = 0;
+}
+
+void InstanceBatch::add(const glm::mat4 &model, uint32_t material,
+			uint32_t lod) {
+	if (lod >= this->levels.size()) {
+		lod = this->levels.size() - 1;
+	}
+	this->levels[lod].instances.push_back(instance_data(model, material));
+	this->stats.instances++;
+}
+
+void InstanceBatch::upload() {
+	this->stats.bytes = 0;
+	for (Level &level : this->levels) {
+		uint32_t count = level.instances.size();
+		if (count == 0) {
+			continue;
+		}
+		// Growing or orphaning hands the driver new storage, a draw
+		// of the previous frame may still read the old one.
+		if (count > level.capacity) {
+			level.capacity = count > 2 * level.capacity
+					     ? count
+					     : 2 * level.capacity;
+		}
+		size_t size = (size_t)count * sizeof(InstanceData);
+		gl_state_bind_buffer(GL_ARRAY_BUFFER, level.buffer);
+		glBufferData(GL_ARRAY_BUFFER,
+			     (size_t)level.capacity * sizeof(InstanceData),
+			     NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size,
+				level.instances.data());
+		this->stats.bytes += size;
+	}
+}
+
+uint32_t InstanceBatch::draw() const {
+	const GpuMesh &gpu = *this->mesh;
+	uint32_t draws = 0;
+	for (uint32_t lod = 0; lod < this->levels.size(); lod++) {
+		const Level &level = this->levels[lod];
+		GLsizei count = level.instances.size();
+		if (count == 0) {
+			continue;
+		}
+		gl_state_bind_vertex_array(level.VAO);
+		if (gpu.EBO != 0) {
+			const MeshLodRange &range = gpu.lods[lod];
+			glDrawElementsInstanced(
+			    GL_TRIANGLES, range.index_count, gpu.index_type,
+			    (void *)((size_t)range.index_offset *
+				     gpu.index_size),
+			    count);
+		} else {
+			glDrawArraysInstanced(GL_TRIANGLES, 0, gpu.vertex_count,
+					      count);
+		}
+		draws++;
+	}
+	return draws;
+}
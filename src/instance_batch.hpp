@@ -0,0 +1,53 @@
+#ifndef _INSTANCE_BATCH_HPP
+#define _INSTANCE_BATCH_HPP
+
+#include "gpu_mesh.hpp"
+#include "vertex_layout.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+struct InstanceBatchStats {
+	uint32_t instances; // added since clear
+	size_t bytes;	    // streamed by the last upload
+};
+
+// model must be affine.
+InstanceData instance_data(const glm::mat4 &model, uint32_t material);
+
+// Copies of one mesh, drawn with one instanced draw per LOD. Each LOD has a
+// buffer of InstanceData, refilled every frame, and a vertex array reading
+// the mesh's vertices per vertex and that buffer per instance.
+class InstanceBatch {
+      private:
+	struct Level {
+		unsigned int VAO;
+		unsigned int buffer;
+		uint32_t capacity; // instances the buffer has room for
+		std::vector<InstanceData> instances;
+	};
+
+	const GpuMesh *mesh;
+	std::vector<Level> levels;
+
+      public:
+	InstanceBatchStats stats;
+
+	// mesh must outlive the batch.
+	InstanceBatch(const GpuMesh *mesh);
+	~InstanceBatch();
+
+	void clear();
+
+	// lod is clamped to the mesh's levels.
+	void add(const glm::mat4 &model, uint32_t material, uint32_t lod);
+
+	// Streams the instances added since clear into the buffers.
+	void upload();
+
+	// Returns the number of draws, one per LOD with instances.
+	uint32_t draw() const;
+};
+
+#endif
@@ -0,0 +1,28 @@
+#include "lod_select.hpp"
+#include <cmath>
+
+float lod_pixels_per_unit(float distance, float fov_radians,
+			  float viewport_height) {
+	return viewport_height / (2.0f * distance * std::tan(fov_radians / 2));
+}
+
+uint32_t lod_select(const MeshLodRange *lods, uint32_t count,
+		    float pixels_per_unit, uint32_t current, float threshold) {
+	if (count == 0) {
+		return 0;
+	}
+	if (current >= count) {
+		current = count - 1;
+	}
+	// Refine as soon as the error shows, coarsen only with a margin.
+	while (current > 0 &&
+	       lods[current].error * pixels_per_unit > threshold) {
+		current--;
+	}
+	float coarsen = threshold * (1.0f - LOD_HYSTERESIS);
+	while (current + 1 < count &&
+	       lods[current + 1].error * pixels_per_unit <= coarsen) {
+		current++;
+	}
+	return current;
+}
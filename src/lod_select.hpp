@@ -0,0 +1,25 @@
+#ifndef _LOD_SELECT_HPP
+#define _LOD_SELECT_HPP
+
+#include "mesh.hpp"
+#include <cstdint>
+
+// Largest simplification error, in pixels, a selected LOD may show.
+#define LOD_PIXEL_THRESHOLD 1.0f
+
+// A coarser LOD is only picked once its error is this fraction below the
+// threshold, so a camera resting near a switching distance does not pop
+// between two levels every frame.
+#define LOD_HYSTERESIS 0.25f
+
+// Pixels covered by one object space unit at distance from the eye.
+float lod_pixels_per_unit(float distance, float fov_radians,
+			  float viewport_height);
+
+// Picks the coarsest level in lods (LOD0 first, errors increasing) whose
+// projected error stays within threshold, starting from the level drawn
+// last frame.
+uint32_t lod_select(const MeshLodRange *lods, uint32_t count,
+		    float pixels_per_unit, uint32_t current, float threshold);
+
+#endif
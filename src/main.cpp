@@ -1,10 +1,33 @@
+#include "asset_cache.hpp"
+#include "asset_stream.hpp"
 #include "basic_shader.hpp"
+#include "bezier_patch.hpp"
+#include "cull.hpp"
+#include "gl_state.hpp"
+#include "gpu_mesh.hpp"
+#include "gpu_timer.hpp"
 #include "imgui.h"
 #include "imgui_demo_window.hpp"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include "instance_batch.hpp"
+#include "lod_select.hpp"
+#include "mesh.hpp"
+#include "mesh_bvh.hpp"
+#include "mesh_pool.hpp"
+#include "mesh_quantize.hpp"
+#include "render_queue.hpp"
+#include "render_stats.hpp"
+#include "scene_bvh.hpp"
+#include "shader_manager.hpp"
+#include "thread_pool.hpp"
+#include "uniform_block.hpp"
+#include "vertex_layout.hpp"
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -12,24 +35,54 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #define WIDTH 1280
 #define HEIGHT 720
+// Copies of the teapot spawned by --instances, on a grid behind it.
+#define INSTANCE_SCALE 0.25f
+#define INSTANCE_SPACING 2.0f
+
 #define SHADOW_WIDTH 1280
 #define SHADOW_HEIGHT 720
 
-struct UMaterial {
-	unsigned int ambient;
-	unsigned int diffuse;
-	unsigned int specular;
-	unsigned int shininess;
+// Entries of the Materials block.
+enum Material { MATERIAL_COPPER, MATERIAL_WHITE_PLASTIC, MATERIAL_COUNT };
+static_assert(MATERIAL_COUNT <= UNIFORM_BLOCK_MAX_MATERIALS,
+	      "grow the Materials block");
+
+// Uniform locations, resolved once per program so that drawing does not
+// look names up. Everything else comes from the shared uniform blocks.
+struct UPhong {
+	int model;
+	int oct_normals;
+	int material_index;
+};
+
+struct ULightcube {
+	int model;
+};
+
+// Extra uniforms of the tessellation shaders.
+struct UBezier {
+	int pixels_per_unit;
+	int pixels_per_segment;
+};
+
+// Program to draw with and its handles, which are resolved again when the
+// program is rebuilt. Until a background program is ready this holds the
+// fallback.
+struct PhongProgram {
+	BasicShader *shader;
+	uint32_t generation;
+	UPhong u;
+	bool instanced; // a SHADER_INSTANCED variant
 };
 
-struct ULight {
-	unsigned int position;
-	unsigned int ambient;
-	unsigned int diffuse;
-	unsigned int specular;
+struct LightcubeProgram {
+	BasicShader *shader;
+	uint32_t generation;
+	ULightcube u;
 };
 
 void GLAPIENTRY MessageCallback(GLenum source, GLenum type, GLuint id,
@@ -45,58 +98,485 @@ static void glfw_error_callback(int error, const char *description) {
 	fprintf(stderr, "GLFW Error %d: %s\n", error, description);
 }
 
-void configurePhongShader(BasicShader *shader, glm::mat4 model, glm::mat4 view,
-			  glm::mat4 projection, glm::vec3 camera_eye,
-			  glm::vec3 lightcube_pos, float material[10]) {
-	// MVP
-	shader->setMat4("model", model);
-	shader->setMat4("view", view);
-	shader->setMat4("projection", projection);
-
-	// camera
-	shader->setVec3("camera_pos", camera_eye);
-
-	// material
-	shader->setVec3("material.ambient",
-			glm::vec3(material[0], material[1], material[2]));
-	shader->setVec3("material.diffuse",
-			glm::vec3(material[3], material[4], material[5]));
-	shader->setVec3("material.specular",
-			glm::vec3(material[6], material[7], material[8]));
-	shader->setFloat("material.shininess", 128.0f * material[9]);
-
-	// light
-	shader->setVec3("light.position", lightcube_pos);
-	shader->setVec3("light.ambient", glm::vec3(0.6f, 0.6f, 0.6f));
-	shader->setVec3("light.diffuse", glm::vec3(0.9f, 0.9f, 0.9f));
-	shader->setVec3("light.specular", glm::vec3(4.0f, 4.0f, 4.0f));
+UPhong resolvePhongUniforms(BasicShader *shader, bool instanced) {
+	UPhong u;
+	// Instanced variants read both per instance.
+	u.model = shader->uniform("model", !instanced);
+	// Only vertex_phong.glsl decodes normals.
+	u.oct_normals = shader->uniform("oct_normals", false);
+	u.material_index = shader->uniform("material_index", !instanced);
+	return u;
+}
+
+ULightcube resolveLightcubeUniforms(BasicShader *shader) {
+	ULightcube u;
+	u.model = shader->uniform("model");
+	return u;
+}
+
+UBezier resolveBezierUniforms(BasicShader *shader) {
+	UBezier u;
+	u.pixels_per_unit = shader->uniform("pixels_per_unit");
+	u.pixels_per_segment = shader->uniform("pixels_per_segment");
+	return u;
+}
+
+// Points program at wanted once that finished compiling, until then the
+// program it had keeps drawing. Returns true when the handles changed,
+// because it switched or its program was rebuilt.
+bool switchPhongProgram(PhongProgram *program, BasicShader *wanted) {
+	BasicShader *shader = wanted->ready ? wanted : program->shader;
+	if (shader == NULL || (program->shader == shader &&
+			       program->generation == shader->generation)) {
+		return false;
+	}
+	program->shader = shader;
+	program->generation = shader->generation;
+	program->u = resolvePhongUniforms(shader, program->instanced);
+	return true;
+}
+
+// material holds ambient 3, diffuse 3, specular 3, shininess 1.
+MaterialBlock materialBlock(const float material[10]) {
+	MaterialBlock block = {};
+	block.ambient = glm::vec3(material[0], material[1], material[2]);
+	block.diffuse = glm::vec3(material[3], material[4], material[5]);
+	block.specular = glm::vec3(material[6], material[7], material[8]);
+	block.shininess = 128.0f * material[9];
+	return block;
 }
 
-void configureLightcubeShader(BasicShader *shader, glm::mat4 model,
-			      glm::mat4 view, glm::mat4 projection,
-			      glm::vec3 lightcube_pos) {
-	shader->setMat4("model", model);
-	shader->setMat4("view", view);
-	shader->setMat4("projection", projection);
+LightsBlock lightsBlock(glm::vec3 lightcube_pos) {
+	LightsBlock block = {};
+	block.light.position = lightcube_pos;
+	block.light.ambient = glm::vec3(0.6f, 0.6f, 0.6f);
+	block.light.diffuse = glm::vec3(0.9f, 0.9f, 0.9f);
+	block.light.specular = glm::vec3(4.0f, 4.0f, 4.0f);
 
 	// Value for these are essentially copies of the values used
 	// in the light asset.
-	shader->setVec3("light.position", lightcube_pos);
-	shader->setVec3("light.ambient", glm::vec3(0.2f, 0.2f, 0.2f));
-	shader->setVec3("light.diffuse", glm::vec3(0.5f, 0.5f, 0.5f));
-	shader->setVec3("light.specular", glm::vec3(1.0f, 1.0f, 1.0f));
+	block.lightcube.position = lightcube_pos;
+	block.lightcube.ambient = glm::vec3(0.2f, 0.2f, 0.2f);
+	block.lightcube.diffuse = glm::vec3(0.5f, 0.5f, 0.5f);
+	block.lightcube.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+	return block;
+}
+
+// Draw of all of mesh, at full detail.
+RenderPacket meshPacket(const RenderPipeline *pipeline, const GpuMesh *mesh,
+			const glm::mat4 &model, Material material) {
+	RenderPacket packet = {};
+	packet.pipeline = pipeline;
+	packet.mesh = mesh;
+	packet.model = model;
+	packet.material = material;
+	return packet;
+}
+
+// Queues packet, a draw of an asset, at the LOD of its mesh that suits its
+// distance from the eye, LOD0 meshlet by meshlet; lod carries the selection
+// over from the previous frame. packet.model is the model matrix, the
+// dequantization is added here.
+void queueAsset(RenderQueue *queue, RenderPacket packet,
+		const glm::mat4 &view_projection, glm::vec3 camera_eye,
+		float camera_fov, float camera_near, uint32_t *lod,
+		std::vector<uint32_t> *visible_meshlets, RenderStats *stats) {
+	const GpuMesh &gpu = *packet.mesh;
+	glm::mat4 model = packet.model;
+	// Distance to the bounding sphere, the closest the surface can get to
+	// the eye.
+	glm::vec3 center = glm::vec3(
+	    model * glm::vec4(0.5f * (gpu.aabb_min + gpu.aabb_max), 1.0f));
+	float radius = 0.5f * glm::length(gpu.aabb_max - gpu.aabb_min);
+	float distance = glm::length(camera_eye - center) - radius;
+	distance = distance > camera_near ? distance : camera_near;
+	float pixels_per_unit = lod_pixels_per_unit(
+	    distance, glm::radians(camera_fov), (float)HEIGHT);
+	*lod = lod_select(gpu.lods.data(), gpu.lods.size(), pixels_per_unit,
+			  *lod, LOD_PIXEL_THRESHOLD);
+
+	stats->asset_lod = *lod;
+	stats->asset_lod_count = gpu.lods.size();
+	stats->asset_triangles = gpu.vertex_count / 3;
+	stats->asset_error_pixels = 0.0f;
+	stats->asset_draws = 1;
+	stats->meshlets = {};
+	if (!gpu.lods.empty()) {
+		const MeshLodRange &range = gpu.lods[*lod];
+		stats->asset_triangles = range.index_count / 3;
+		stats->asset_error_pixels = range.error * pixels_per_unit;
+	}
+	packet.model = model * gpu.dequantize;
+	packet.oct_normals = gpu.vertex_format == MESH_VERTEX_QUANTIZED;
+	packet.lod = *lod;
+	packet.draws = &stats->asset_draws;
+
+	// Full detail is drawn meshlet by meshlet, skipping the ones outside
+	// the view or facing away.
+	if (*lod == 0 && !gpu.meshlets.empty()) {
+		visible_meshlets->clear();
+		meshlet_cull(gpu.meshlets.data(), gpu.meshlets.size(), model,
+			     frustum_from_matrix(view_projection), camera_eye,
+			     visible_meshlets, &stats->meshlets);
+		stats->asset_triangles = 0;
+		for (uint32_t i : *visible_meshlets) {
+			stats->asset_triangles +=
+			    gpu.meshlets[i].index_count / 3;
+		}
+		if (visible_meshlets->empty()) {
+			stats->asset_draws = 0;
+			return;
+		}
+		packet.meshlets = visible_meshlets->data();
+		packet.meshlet_count = visible_meshlets->size();
+	}
+	queue->push(RENDER_LAYER_OPAQUE, packet);
+}
+
+// Parses one of DRAW_PATH_NAMES. Returns false for anything else.
+bool drawPathParse(const char *name, uint32_t *path) {
+	for (uint32_t i = 0; i < DRAW_PATH_COUNT; i++) {
+		if (strcmp(name, DRAW_PATH_NAMES[i]) == 0) {
+			*path = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Pools the teapot and the ground for DRAW_PATH_MULTI_DRAW. The ground is
+// encoded in the teapot's vertex format so both share the buffers. NULL when
+// the teapot cannot be pooled.
+MeshPool *createMeshPool(const GpuMesh &teapot, const MeshVertex *ground,
+			 uint32_t ground_vertices, uint32_t *pool_teapot,
+			 uint32_t *pool_ground) {
+	Mesh mesh;
+	const float *floats = (const float *)ground;
+	mesh.vertices.assign(floats,
+			     floats + ground_vertices * MESH_FLOATS_PER_VERTEX);
+	float aabb_min[3], aabb_max[3];
+	mesh_bounds(mesh, aabb_min, aabb_max);
+	std::vector<uint8_t> vertices;
+	mesh_encode_vertices(mesh, teapot.vertex_format, aabb_min, aabb_max,
+			     &vertices, NULL);
+	GpuMesh gpu = {};
+	gpu_mesh_upload(&gpu, mesh_layout(teapot.vertex_format),
+			vertices.data(), vertices.size(), ground_vertices,
+			NULL, 0, 0, NULL, 0);
+	gpu_mesh_set_format(&gpu, teapot.vertex_format, aabb_min, aabb_max);
+
+	MeshPool *pool = new MeshPool(teapot.layout);
+	bool pooled =
+	    pool->add(teapot, pool_teapot) && pool->add(gpu, pool_ground);
+	gpu_mesh_destroy(&gpu);
+	if (!pooled) {
+		delete pool;
+		return NULL;
+	}
+	return pool;
+}
+
+// Copies of the teapot on a grid behind it. Bounds are kept in the layout
+// the culling kernels read; LODs carry over between frames.
+struct InstanceGrid {
+	std::vector<glm::vec3> positions;
+	CullSpheres bounds; // world space
+	std::vector<uint32_t> visible;
+	std::vector<uint32_t> lods;
+};
+
+// Places count copies of gpu, keeping the grid when the count is unchanged.
+void layoutInstances(InstanceGrid *grid, const GpuMesh &gpu, uint32_t count) {
+	if (grid->positions.size() == count) {
+		return;
+	}
+	glm::vec3 center = 0.5f * (gpu.aabb_min + gpu.aabb_max);
+	float radius =
+	    INSTANCE_SCALE * 0.5f * glm::length(gpu.aabb_max - gpu.aabb_min);
+	uint32_t side = (uint32_t)std::ceil(std::sqrt((float)count));
+	*grid = {};
+	for (uint32_t i = 0; i < count; i++) {
+		glm::vec3 position(
+		    ((float)(i % side) - 0.5f * (side - 1)) * INSTANCE_SPACING,
+		    -1.0f, -4.0f - (float)(i / side) * INSTANCE_SPACING);
+		glm::vec3 c = position + INSTANCE_SCALE * center;
+		grid->positions.push_back(position);
+		grid->bounds.x.push_back(c.x);
+		grid->bounds.y.push_back(c.y);
+		grid->bounds.z.push_back(c.z);
+		grid->bounds.radius.push_back(radius);
+	}
+	grid->visible.resize(count);
+	grid->lods.resize(count, 0);
+}
+
+// The ground and the light cube, and the copies of a grid once the teapot
+// is resident, as SceneObjects in a BVH that culls and picks them together.
+struct Scene {
+	SceneBvh bvh;
+	glm::vec3 lightcube_pos;
+	std::vector<uint32_t> visible;
+	bool ground_visible;
+	bool lightcube_visible;
+};
+
+glm::mat4 groundModel() {
+	glm::mat4 model =
+	    glm::scale(glm::mat4(1.0f), glm::vec3(10.0f, 0.1f, 10.0f));
+	return glm::translate(model, glm::vec3(0.0f, -10.0f, 0.0f));
+}
+
+// Rebuilds the tree over the ground, the light cube and the first copies
+// of grid, boxes of gpu that may be NULL without copies.
+void buildScene(Scene *scene, const InstanceGrid &grid, uint32_t copies,
+		const GpuMesh *gpu, glm::vec3 lightcube_pos,
+		RenderStats *stats) {
+	double start = glfwGetTime();
+	std::vector<glm::vec3> min(SCENE_COPIES + copies);
+	std::vector<glm::vec3> max(SCENE_COPIES + copies);
+	// Both cubes span -0.5 to 0.5 before their model matrices, which
+	// only scale and translate.
+	glm::mat4 ground = groundModel();
+	min[SCENE_GROUND] =
+	    glm::vec3(ground * glm::vec4(glm::vec3(-0.5f), 1.0f));
+	max[SCENE_GROUND] =
+	    glm::vec3(ground * glm::vec4(glm::vec3(0.5f), 1.0f));
+	min[SCENE_LIGHTCUBE] = lightcube_pos - glm::vec3(0.5f);
+	max[SCENE_LIGHTCUBE] = lightcube_pos + glm::vec3(0.5f);
+	for (uint32_t i = 0; i < copies; i++) {
+		min[SCENE_COPIES + i] =
+		    grid.positions[i] + INSTANCE_SCALE * gpu->aabb_min;
+		max[SCENE_COPIES + i] =
+		    grid.positions[i] + INSTANCE_SCALE * gpu->aabb_max;
+	}
+	scene->bvh.build(min.data(), max.data(), min.size());
+	scene->lightcube_pos = lightcube_pos;
+	scene->visible.resize(min.size());
+	stats->scene_build_ms = (glfwGetTime() - start) * 1000.0;
+}
+
+// Refits the tree around the light cube when it was dragged.
+void moveLightcube(Scene *scene, glm::vec3 lightcube_pos,
+		   RenderStats *stats) {
+	if (lightcube_pos == scene->lightcube_pos) {
+		return;
+	}
+	double start = glfwGetTime();
+	scene->bvh.move(SCENE_LIGHTCUBE, lightcube_pos - glm::vec3(0.5f),
+			lightcube_pos + glm::vec3(0.5f));
+	scene->lightcube_pos = lightcube_pos;
+	stats->scene_move_ms = (glfwGetTime() - start) * 1000.0;
+}
+
+// Culls the scene against view_projection, writing the copies in view to
+// grid->visible and returning their number. Without bvh the copies are
+// tested one by one by the SIMD sphere test and the rest is drawn.
+uint32_t cullScene(Scene *scene, InstanceGrid *grid, uint32_t copies,
+		   bool bvh, const glm::mat4 &view_projection,
+		   RenderStats *stats) {
+	Frustum frustum = frustum_from_matrix(view_projection);
+	double start = glfwGetTime();
+	uint32_t visible = 0;
+	if (!bvh) {
+		scene->ground_visible = true;
+		scene->lightcube_visible = true;
+		if (copies > 0) {
+			visible = frustum_cull_spheres(frustum, grid->bounds,
+						       grid->visible.data());
+		}
+	} else {
+		scene->ground_visible = false;
+		scene->lightcube_visible = false;
+		uint32_t n = scene->bvh.cull(frustum, scene->visible.data());
+		for (uint32_t i = 0; i < n; i++) {
+			uint32_t object = scene->visible[i];
+			if (object == SCENE_GROUND) {
+				scene->ground_visible = true;
+			} else if (object == SCENE_LIGHTCUBE) {
+				scene->lightcube_visible = true;
+			} else {
+				grid->visible[visible++] =
+				    object - SCENE_COPIES;
+			}
+		}
+	}
+	stats->instance_cull_ms = (glfwGetTime() - start) * 1000.0;
+	stats->instance_cull_bvh = bvh;
+	stats->scene_bvh = scene->bvh.stats;
+	return visible;
 }
 
-int main() {
-	unsigned int VAO_asset, VBO_asset;
-	unsigned int VAO_lightcube, VBO_lightcube, EBO_lightcube;
-	unsigned int VAO_ground, VBO_ground, EBO_ground;
+// Casts a ray from the eye through the cursor into the scene; sets the
+// picked object, BVH_NONE when it misses or ImGui has the mouse. A copy is
+// picked by its triangles through the BVH of teapot, which may be NULL.
+void pickScene(Scene *scene, GLFWwindow *window,
+	       const glm::mat4 &view_projection, const InstanceGrid &grid,
+	       const Mesh *teapot, RenderStats *stats) {
+	stats->picked = BVH_NONE;
+	stats->picked_triangle = BVH_NONE;
+	if (ImGui::GetIO().WantCaptureMouse) {
+		return;
+	}
+	double x, y;
+	glfwGetCursorPos(window, &x, &y);
+	glm::vec2 ndc(2.0f * (float)x / WIDTH - 1.0f,
+		      1.0f - 2.0f * (float)y / HEIGHT);
+	glm::mat4 inverse = glm::inverse(view_projection);
+	glm::vec4 near = inverse * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+	glm::vec4 far = inverse * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(near) / near.w;
+	glm::vec3 direction = glm::vec3(far) / far.w - origin;
+	// direction spans the frustum, distances along it are in units of
+	// its length.
+	float distance;
+	if (!scene->bvh.raycast(origin, direction, 1.0f, &stats->picked,
+				&distance)) {
+		return;
+	}
+	stats->picked_distance = distance * glm::length(direction);
+	if (stats->picked < SCENE_COPIES || teapot == NULL ||
+	    teapot->bvh.empty()) {
+		return;
+	}
+	// A copy is the teapot scaled and moved, the same ray in its space
+	// keeps its distances. A miss through the box clears the pick, the
+	// objects behind it are not tried.
+	glm::vec3 position = grid.positions[stats->picked - SCENE_COPIES];
+	glm::vec3 local_origin = (origin - position) / INSTANCE_SCALE;
+	glm::vec3 local_direction = direction / INSTANCE_SCALE;
+	if (!mesh_bvh_raycast(*teapot, &local_origin.x, &local_direction.x,
+			      1.0f, &stats->picked_triangle, &distance)) {
+		stats->picked = BVH_NONE;
+		return;
+	}
+	stats->picked_distance = distance * glm::length(direction);
+}
+
+// Queues the first visible copies of gpu in grid->visible, each at the LOD
+// its distance needs: as one instanced packet, a packet per copy drawn with
+// lit or, given pool, a pooled packet per copy drawn with instanced.
+void queueInstances(RenderQueue *queue, DrawPath path,
+		    const RenderPipeline *lit, const RenderPipeline *instanced,
+		    InstanceBatch *batch, MeshPool *pool, uint32_t pool_mesh,
+		    const GpuMesh &gpu, uint32_t count, uint32_t visible,
+		    glm::vec3 camera_eye, float camera_fov, float camera_near,
+		    InstanceGrid *grid, RenderStats *stats) {
+	if (path == DRAW_PATH_INSTANCED) {
+		batch->clear();
+	}
+	RenderPacket packet =
+	    meshPacket(lit, &gpu, glm::mat4(1.0f), MATERIAL_COPPER);
+	packet.oct_normals = gpu.vertex_format == MESH_VERTEX_QUANTIZED;
+	if (path == DRAW_PATH_MULTI_DRAW) {
+		packet.pipeline = instanced;
+		packet.pool = pool;
+		packet.pool_mesh = pool_mesh;
+	}
+	stats->instances = visible;
+	stats->instances_culled = count - visible;
+	stats->instance_bytes = 0;
+	for (uint32_t v = 0; v < visible; v++) {
+		uint32_t i = grid->visible[v];
+		glm::vec3 c(grid->bounds.x[i], grid->bounds.y[i],
+			    grid->bounds.z[i]);
+		float radius = grid->bounds.radius[i];
+		float distance = glm::length(camera_eye - c) - radius;
+		distance = distance > camera_near ? distance : camera_near;
+		// LOD errors are in the units of the unscaled mesh.
+		float pixels_per_unit =
+		    INSTANCE_SCALE *
+		    lod_pixels_per_unit(distance, glm::radians(camera_fov),
+					(float)HEIGHT);
+		uint32_t &lod = grid->lods[i];
+		lod = lod_select(gpu.lods.data(), gpu.lods.size(),
+				 pixels_per_unit, lod, LOD_PIXEL_THRESHOLD);
+		glm::mat4 model =
+		    glm::translate(glm::mat4(1.0f), grid->positions[i]);
+		model = glm::scale(model, glm::vec3(INSTANCE_SCALE));
+		if (path == DRAW_PATH_INSTANCED) {
+			batch->add(model * gpu.dequantize, i % MATERIAL_COUNT,
+				   lod);
+			continue;
+		}
+		packet.model = model * gpu.dequantize;
+		packet.material = i % MATERIAL_COUNT;
+		packet.lod = lod;
+		queue->push(RENDER_LAYER_OPAQUE, packet);
+	}
+	// A draw, or a command of the multi-draw, per copy otherwise.
+	stats->instance_draws = stats->instances;
+	if (path != DRAW_PATH_INSTANCED) {
+		return;
+	}
+	batch->upload();
+	stats->instance_bytes = batch->stats.bytes;
+	stats->instance_draws = 0;
+	if (stats->instances == 0) {
+		return;
+	}
+	packet.pipeline = instanced;
+	packet.instances = batch;
+	packet.draws = &stats->instance_draws;
+	queue->push(RENDER_LAYER_OPAQUE, packet);
+}
+
+// Retessellates the patches of tessellator for the current eye and uploads
+// the result to gpu when any patch changed level.
+void updateBezier(BezierTessellator *tessellator, GpuMesh *gpu,
+		const glm::mat4 &model, glm::vec3 camera_eye,
+		float camera_fov) {
+	glm::vec3 eye = glm::vec3(glm::inverse(model) *
+				  glm::vec4(camera_eye, 1.0f));
+	float pixels_per_unit =
+	    lod_pixels_per_unit(1.0f, glm::radians(camera_fov), (float)HEIGHT);
+	if (!tessellator->update(glm::value_ptr(eye), pixels_per_unit)) {
+		return;
+	}
+	const Mesh &mesh = tessellator->mesh;
+	size_t vertices_size = mesh.vertices.size() * sizeof(float);
+	if (gpu->VBO == 0) {
+		gpu_mesh_upload(gpu, mesh_layout_float(), mesh.vertices.data(),
+				vertices_size, mesh.vertexCount(),
+				mesh.indices.data(), mesh.indices.size(),
+				sizeof(uint32_t), NULL, 0);
+		gpu_mesh_create_vao(gpu);
+	} else {
+		gpu_mesh_update(gpu, mesh.vertices.data(), vertices_size,
+				mesh.vertexCount(), mesh.indices.data(),
+				mesh.indices.size(), sizeof(uint32_t));
+	}
+}
+
+int main(int argc, char **argv) {
 	unsigned int vertexShader, fragmentShader, program;
-	unsigned int u_Model, u_View, u_Projection;
-	unsigned int u_cameraPos;
 
-	struct UMaterial u_Material;
-	struct ULight u_Light;
+	MeshVertexFormat vertex_format = MESH_VERTEX_QUANTIZED;
+	bool bezier = false;
+	uint32_t instance_count = 0;
+	uint32_t draw_path = DRAW_PATH_INSTANCED;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc &&
+		    mesh_vertex_format_parse(argv[i + 1], &vertex_format)) {
+			i++;
+		} else if (strcmp(argv[i], "--bezier") == 0) {
+			bezier = true;
+		} else if (strcmp(argv[i], "--instances") == 0 &&
+			   i + 1 < argc) {
+			instance_count = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--draw-path") == 0 &&
+			   i + 1 < argc &&
+			   drawPathParse(argv[i + 1], &draw_path)) {
+			i++;
+		} else {
+			fprintf(stderr,
+				"usage: %s [--vertex-format float|quantized] "
+				"[--bezier] [--instances N] "
+				"[--draw-path instanced|per-object|"
+				"multi-draw]\n",
+				argv[0]);
+			return -1;
+		}
+	}
 
 	glfwSetErrorCallback(glfw_error_callback);
 	if (!glfwInit()) {
@@ -114,42 +594,62 @@ int main() {
 	glEnable(GL_DEBUG_OUTPUT);
 	glDebugMessageCallback(MessageCallback, 0);
 
-	glEnable(GL_DEPTH_TEST);
+	gl_state_set(GL_DEPTH_TEST, true);
 
-	glGenVertexArrays(1, &VAO_asset);
-	glGenBuffers(1, &VBO_asset);
-	glBindVertexArray(VAO_asset);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_asset);
+	ThreadPool pool;
+	AssetCache asset_cache(ASSET_CACHE_DIR);
 
-	FILE *asset_file = fopen("../assets/teapot_bezier0.norm.txt", "r");
-	if (asset_file == NULL) {
-		fprintf(stderr, "failed to open asset file\n");
-		return -1;
+	// The first frames render without the teapot, it appears once the
+	// streamer made it resident. With --bezier it is tessellated from its
+	// patches instead, at the density the camera needs: by the tessellation
+	// shaders when the context has them, otherwise on the CPU. The stats
+	// window switches between the two.
+	AssetStreamer *streamer =
+	    new AssetStreamer(window, &pool, &asset_cache, vertex_format);
+	StreamedAsset *teapot = NULL;
+	std::vector<BezierPatch> patches;
+	BezierTessellator *bezier_teapot = NULL;
+	GpuMesh bezier_gpu = {};
+	GpuMesh bezier_patches_gpu = {};
+	bool tessellation_supported =
+	    GLEW_VERSION_4_0 || GLEW_ARB_tessellation_shader;
+	bool hardware_tessellation = false;
+	bool multi_draw_supported = mesh_pool_supported();
+	if (draw_path == DRAW_PATH_MULTI_DRAW && !multi_draw_supported) {
+		fprintf(stderr, "no multi-draw indirect, drawing per object\n");
+		draw_path = DRAW_PATH_PER_OBJECT;
 	}
-	int asset_triangle_count;
-	fscanf(asset_file, "%d", &asset_triangle_count);
-	float *asset_vertices =
-	    (float *)malloc(18 * sizeof(float) * asset_triangle_count);
-	for (int i = 0; i < asset_triangle_count * 18; i += 6) {
-		fscanf(asset_file, "%f %f %f", &asset_vertices[i],
-		       &asset_vertices[i + 1], &asset_vertices[i + 2]);
-		fscanf(asset_file, "%f %f %f", &asset_vertices[i + 3],
-		       &asset_vertices[i + 4], &asset_vertices[i + 5]);
+	if (bezier) {
+		if (!bezier_load("../assets/teapot.bpt", &patches)) {
+			return -1;
+		}
+		bezier_teapot = new BezierTessellator(patches);
+		if (tessellation_supported) {
+			gpu_mesh_upload(&bezier_patches_gpu,
+					bezier_patch_layout(), patches.data(),
+					patches.size() * sizeof(BezierPatch),
+					16 * patches.size(), NULL, 0, 0, NULL,
+					0);
+			gpu_mesh_create_vao(&bezier_patches_gpu);
+			hardware_tessellation = true;
+		}
+	} else {
+		teapot = streamer->request("../assets/teapot_bezier0.mesh",
+					   "../assets/teapot_bezier0.norm.txt");
 	}
-	glBufferData(GL_ARRAY_BUFFER, 18 * sizeof(float) * asset_triangle_count,
-		     asset_vertices, GL_STATIC_DRAW);
-	float vertices_cube[] = {
+
+	PositionVertex vertices_cube[] = {
 	    // Front face
-	    -0.5f, -0.5f, 0.5f, // Vertex 0
-	    0.5f, -0.5f, 0.5f,	// Vertex 1
-	    0.5f, 0.5f, 0.5f,	// Vertex 2
-	    -0.5f, 0.5f, 0.5f,	// Vertex 3
+	    {-0.5f, -0.5f, 0.5f}, // Vertex 0
+	    {0.5f, -0.5f, 0.5f},  // Vertex 1
+	    {0.5f, 0.5f, 0.5f},	  // Vertex 2
+	    {-0.5f, 0.5f, 0.5f},  // Vertex 3
 
 	    // Back face
-	    -0.5f, -0.5f, -0.5f, // Vertex 4
-	    0.5f, -0.5f, -0.5f,	 // Vertex 5
-	    0.5f, 0.5f, -0.5f,	 // Vertex 6
-	    -0.5f, 0.5f, -0.5f,	 // Vertex 7
+	    {-0.5f, -0.5f, -0.5f}, // Vertex 4
+	    {0.5f, -0.5f, -0.5f},  // Vertex 5
+	    {0.5f, 0.5f, -0.5f},   // Vertex 6
+	    {-0.5f, 0.5f, -0.5f},  // Vertex 7
 	};
 
 	unsigned int indices_cube[] = {
@@ -178,73 +678,70 @@ int main() {
 	    6, 5, 1  // Triangle 2
 	};
 
-	float vertices_cube2[] = {
+	MeshVertex vertices_cube2[] = {
 	    // front face
-	    -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, // Vertex 0
-	    0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f,  // Vertex 1
-	    0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f,	  // Vertex 2
-	    0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f,	  // Vertex 2
-	    -0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f,  // Vertex 3
-	    -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, // Vertex 0
+	    {{-0.5f, -0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},	// Vertex 0
+	    {{0.5f, -0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},	// Vertex 1
+	    {{0.5f, 0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},	// Vertex 2
+	    {{0.5f, 0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},	// Vertex 2
+	    {{-0.5f, 0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},	// Vertex 3
+	    {{-0.5f, -0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},	// Vertex 0
 
 	    // back face
-	    -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f, // Vertex 4
-	    0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f,  // Vertex 5
-	    0.5f, 0.5f, -0.5f, 0.0f, 0.0f, -1.0f,   // Vertex 6
-	    0.5f, 0.5f, -0.5f, 0.0f, 0.0f, -1.0f,   // Vertex 6
-	    -0.5f, 0.5f, -0.5f, 0.0f, 0.0f, -1.0f,  // Vertex 7
-	    -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f, // Vertex 4
+	    {{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}}, // Vertex 4
+	    {{0.5f, -0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}},  // Vertex 5
+	    {{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}},	  // Vertex 6
+	    {{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}},	  // Vertex 6
+	    {{-0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}},  // Vertex 7
+	    {{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}}, // Vertex 4
 
 	    // top face
-	    -0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f,  // Vertex 3
-	    0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f,	  // Vertex 2
-	    0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f,  // Vertex 6
-	    0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f,  // Vertex 6
-	    -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f, // Vertex 7
-	    -0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f,  // Vertex 3
+	    {{-0.5f, 0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},	// Vertex 3
+	    {{0.5f, 0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},	// Vertex 2
+	    {{0.5f, 0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},	// Vertex 6
+	    {{0.5f, 0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},	// Vertex 6
+	    {{-0.5f, 0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},	// Vertex 7
+	    {{-0.5f, 0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},	// Vertex 3
 
 	    // bottom face
-	    -0.5f, -0.5f, 0.5f, 0.0f, -1.0f, 0.0f,  // Vertex 0
-	    0.5f, -0.5f, 0.5f, 0.0f, -1.0f, 0.0f,   // Vertex 1
-	    0.5f, -0.5f, -0.5f, 0.0f, -1.0f, 0.0f,  // Vertex 5
-	    0.5f, -0.5f, -0.5f, 0.0f, -1.0f, 0.0f,  // Vertex 5
-	    -0.5f, -0.5f, -0.5f, 0.0f, -1.0f, 0.0f, // Vertex 4
-	    -0.5f, -0.5f, 0.5f, 0.0f, -1.0f, 0.0f,  // Vertex 0
+	    {{-0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}},  // Vertex 0
+	    {{0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}},	  // Vertex 1
+	    {{0.5f, -0.5f, -0.5f}, {0.0f, -1.0f, 0.0f}},  // Vertex 5
+	    {{0.5f, -0.5f, -0.5f}, {0.0f, -1.0f, 0.0f}},  // Vertex 5
+	    {{-0.5f, -0.5f, -0.5f}, {0.0f, -1.0f, 0.0f}}, // Vertex 4
+	    {{-0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}},  // Vertex 0
 
 	    // left face
-	    -0.5f, -0.5f, 0.5f, -1.0f, 0.0f, 0.0f,  // Vertex 0
-	    -0.5f, 0.5f, 0.5f, -1.0f, 0.0f, 0.0f,   // Vertex 3
-	    -0.5f, 0.5f, -0.5f, -1.0f, 0.0f, 0.0f,  // Vertex 7
-	    -0.5f, 0.5f, -0.5f, -1.0f, 0.0f, 0.0f,  // Vertex 7
-	    -0.5f, -0.5f, -0.5f, -1.0f, 0.0f, 0.0f, // Vertex 4
-	    -0.5f, -0.5f, 0.5f, -1.0f, 0.0f, 0.0f,  // Vertex 0
+	    {{-0.5f, -0.5f, 0.5f}, {-1.0f, 0.0f, 0.0f}},  // Vertex 0
+	    {{-0.5f, 0.5f, 0.5f}, {-1.0f, 0.0f, 0.0f}},	  // Vertex 3
+	    {{-0.5f, 0.5f, -0.5f}, {-1.0f, 0.0f, 0.0f}},  // Vertex 7
+	    {{-0.5f, 0.5f, -0.5f}, {-1.0f, 0.0f, 0.0f}},  // Vertex 7
+	    {{-0.5f, -0.5f, -0.5f}, {-1.0f, 0.0f, 0.0f}}, // Vertex 4
+	    {{-0.5f, -0.5f, 0.5f}, {-1.0f, 0.0f, 0.0f}},  // Vertex 0
 
 	    // Right face
-	    0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 0.0f,  // Vertex 1
-	    0.5f, 0.5f, 0.5f, 1.0f, 0.0f, 0.0f,	  // Vertex 2
-	    0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f,  // Vertex 6
-	    0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f,  // Vertex 6
-	    0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f, // Vertex 5
-	    0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 0.0f,  // Vertex 1
+	    {{0.5f, -0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}},	// Vertex 1
+	    {{0.5f, 0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}},	// Vertex 2
+	    {{0.5f, 0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},	// Vertex 6
+	    {{0.5f, 0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},	// Vertex 6
+	    {{0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},	// Vertex 5
+	    {{0.5f, -0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}},	// Vertex 1
 	};
 
-	glGenVertexArrays(1, &VAO_lightcube);
-	glBindVertexArray(VAO_lightcube);
-	glGenBuffers(1, &VBO_lightcube);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_lightcube);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_cube), vertices_cube,
-		     GL_STATIC_DRAW);
-	glGenBuffers(1, &EBO_lightcube);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_lightcube);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices_cube),
-		     indices_cube, GL_STATIC_DRAW);
-
-	glGenVertexArrays(1, &VAO_ground);
-	glBindVertexArray(VAO_ground);
-	glGenBuffers(1, &VBO_ground);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_ground);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_cube2), vertices_cube2,
-		     GL_STATIC_DRAW);
+	// Triangle lists of both cubes, the layouts come from the vertex
+	// structs.
+	GpuMesh lightcube_gpu = {}, ground_gpu = {};
+	gpu_mesh_upload(&lightcube_gpu, VERTEX_LAYOUT_POSITION, vertices_cube,
+			sizeof(vertices_cube),
+			sizeof(vertices_cube) / sizeof(vertices_cube[0]),
+			indices_cube, sizeof(indices_cube) / sizeof(uint32_t),
+			sizeof(uint32_t), NULL, 0);
+	gpu_mesh_create_vao(&lightcube_gpu);
+	uint32_t ground_vertices = sizeof(vertices_cube2) / sizeof(MeshVertex);
+	gpu_mesh_upload(&ground_gpu, VERTEX_LAYOUT_MESH, vertices_cube2,
+			sizeof(vertices_cube2), ground_vertices, NULL, 0, 0,
+			NULL, 0);
+	gpu_mesh_create_vao(&ground_gpu);
 
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -268,15 +765,34 @@ int main() {
 	glm::vec3 camera_eye = glm::vec3(0.0f, 4.0f, 8.0f);
 	glm::vec3 camera_center = glm::vec3(0.0f, 0.0f, 0.0f);
 	float camera_fov = 45.0f;
+	float camera_near = 0.01f;
+	float camera_far = 100.0f;
 	glm::vec3 lightcube_pos = glm::vec3(2.0f, 2.0f, 3.5f);
 
-	BasicShader *shader_phong =
-	    new BasicShader("../src/shaders/vertex_phong.glsl",
-			    "../src/shaders/fragment_blinn_phong.glsl");
+	// Every program is compiled in the background, the first frames draw
+	// with the fallback.
+	ShaderManager *shaders = new ShaderManager("../src/shaders");
+	bool shaders_reported = false; // the startup line was printed
+	// Point light with attenuation; the stats window switches to other
+	// variants of fragment_lit.glsl.
+	uint32_t lighting = SHADER_ATTENUATION;
+	shaders->variant("../src/shaders/vertex_phong.glsl",
+			 "../src/shaders/fragment_lit.glsl", lighting);
 
 	BasicShader *shader_lightcube =
-	    new BasicShader("../src/shaders/vertex_lightcube.glsl",
-			    "../src/shaders/fragment_lightcube.glsl");
+	    shaders->add("../src/shaders/vertex_lightcube.glsl",
+			 "../src/shaders/fragment_lightcube.glsl");
+
+	PhongProgram phong = {};
+	switchPhongProgram(&phong, shaders->fallback);
+	LightcubeProgram lightcube = {};
+
+	UniformBlock *camera_block =
+	    new UniformBlock(UNIFORM_BLOCK_CAMERA, sizeof(CameraBlock));
+	UniformBlock *lights_block =
+	    new UniformBlock(UNIFORM_BLOCK_LIGHTS, sizeof(LightsBlock));
+	UniformBlock *materials_block =
+	    new UniformBlock(UNIFORM_BLOCK_MATERIALS, sizeof(MaterialsBlock));
 
 	float copper[10] = {// ambient 3, diffuse 3, specular 3, shininess 1
 			    0.19125, 0.0735,   0.0225,	 0.7038,   0.27048,
@@ -286,9 +802,45 @@ int main() {
 	    // ambient 3, diffuse 3, specular 3, shininess 1
 	    0.0, 0.0, 0.0, 0.55, 0.55, 0.55, 0.70, 0.70, 0.70, 0.25};
 
+	// Materials do not change, one upload covers all frames.
+	MaterialsBlock materials = {};
+	materials.materials[MATERIAL_COPPER] = materialBlock(copper);
+	materials.materials[MATERIAL_WHITE_PLASTIC] =
+	    materialBlock(white_plastic);
+	materials_block->update(&materials, sizeof(materials));
+
 	BasicShader *shader_depthmap =
-	    new BasicShader("../src/shaders/vertex_simple_depth.glsl",
-			    "../src/shaders/fragment_empty.glsl");
+	    shaders->add("../src/shaders/vertex_simple_depth.glsl",
+			 "../src/shaders/fragment_empty.glsl");
+
+	// The patches are tessellated on the CPU until a program is ready.
+	bool bezier_shaders = bezier_teapot != NULL && tessellation_supported;
+	PhongProgram bezier_program = {};
+	UBezier u_bezier = {};
+
+	// Copies of the streamed teapot, set by --instances and the stats
+	// window; the batch is made once the teapot is resident.
+	PhongProgram instanced_program = {};
+	instanced_program.instanced = true;
+	InstanceBatch *instances = NULL;
+	InstanceGrid instance_grid;
+	// Culls the ground, the light cube and the copies; rebuilt when the
+	// number of copies changes, refitted when the light cube moves.
+	Scene scene = {};
+	bool cull_bvh = true;
+
+	// The teapot and the ground share buffers on DRAW_PATH_MULTI_DRAW,
+	// pooled once the teapot is resident.
+	MeshPool *mesh_pool = NULL;
+	uint32_t pool_teapot = 0, pool_ground = 0;
+
+	GpuTimer *asset_timer = new GpuTimer();
+	RenderQueue *queue = new RenderQueue();
+	RenderStats stats = {};
+	stats.tessellation_supported = tessellation_supported;
+	stats.multi_draw_supported = multi_draw_supported;
+	uint32_t asset_lod = 0;
+	std::vector<uint32_t> visible_meshlets;
 
 	while (!glfwWindowShouldClose(window)) {
 		ImGui_ImplOpenGL3_NewFrame();
@@ -297,6 +849,61 @@ int main() {
 
 		glfwPollEvents();
 
+		// Counted over the previous frame.
+		stats.uniform_lookups = BasicShader::string_lookups;
+		BasicShader::string_lookups = 0;
+
+		// Programs that finished compiling take over from the ones
+		// drawing so far, the fallback or the previous variant. A
+		// variant picked for the first time is added here.
+		if (shaders->update() > 0 && shaders->stats.pending == 0 &&
+		    !shaders_reported) {
+			// Cold runs compile every program, warm ones load
+			// the binaries.
+			const ShaderSetupStats &s = shaders->stats;
+			printf("shaders: %u programs, startup took %.1f ms, "
+			       "%u from the binary cache\n",
+			       s.programs, s.ms, s.cached);
+			shaders_reported = true;
+		}
+		switchPhongProgram(
+		    &phong, shaders->variant("../src/shaders/vertex_phong.glsl",
+					     "../src/shaders/fragment_lit.glsl",
+					     lighting));
+		BasicShader *lightcube_shader = shader_lightcube->ready
+						    ? shader_lightcube
+						    : shaders->fallback;
+		if (lightcube.shader != lightcube_shader ||
+		    lightcube.generation != lightcube_shader->generation) {
+			lightcube.shader = lightcube_shader;
+			lightcube.generation = lightcube_shader->generation;
+			lightcube.u =
+			    resolveLightcubeUniforms(lightcube_shader);
+		}
+		if (bezier_shaders &&
+		    switchPhongProgram(
+			&bezier_program,
+			shaders->variant(
+			    "../src/shaders/vertex_bezier.glsl",
+			    "../src/shaders/tess_control_bezier.glsl",
+			    "../src/shaders/tess_eval_bezier.glsl",
+			    "../src/shaders/fragment_lit.glsl", lighting))) {
+			u_bezier = resolveBezierUniforms(bezier_program.shader);
+		}
+		if (instance_count > 0 || draw_path == DRAW_PATH_MULTI_DRAW) {
+			switchPhongProgram(
+			    &instanced_program,
+			    shaders->variant(
+				"../src/shaders/vertex_phong.glsl",
+				"../src/shaders/fragment_lit.glsl",
+				lighting | SHADER_INSTANCED));
+		}
+		stats.shaders = shaders->stats;
+		stats.uniform_block_bytes = UniformBlock::bytes_uploaded;
+		UniformBlock::bytes_uploaded = 0;
+		stats.gl_state = gl_state_stats();
+		gl_state_reset_stats();
+
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glClearColor(0.04313725, 0.1803921, 0.1607843, 1.0);
 
@@ -307,68 +914,202 @@ int main() {
 				   glm::vec3(0.0f, 1.0f, 0.0f));
 		projection = glm::perspective(glm::radians(camera_fov),
 					      (float)WIDTH / (float)HEIGHT,
-					      0.01f, 100.0f);
+					      camera_near, camera_far);
 
-		shader_phong->use();
-		configurePhongShader(shader_phong, model, view, projection,
-				     camera_eye, lightcube_pos, copper);
+		// Shared by every draw below; the light only uploads when
+		// it moved.
+		CameraBlock camera = {};
+		camera.view = view;
+		camera.projection = projection;
+		camera.camera_pos = camera_eye;
+		camera_block->update(&camera, sizeof(camera));
+		LightsBlock lights = lightsBlock(lightcube_pos);
+		lights_block->update(&lights, sizeof(lights));
 
-		glBindVertexArray(VAO_asset);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO_asset);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-				      6 * sizeof(float), NULL);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-				      6 * sizeof(float),
-				      (void *)(3 * sizeof(float)));
-		glEnableVertexAttribArray(0);
-		glEnableVertexAttribArray(1);
+		// Draws are queued as packets and submitted in key order.
+		RenderPipeline lit = {phong.shader, phong.u.model,
+				      phong.u.oct_normals,
+				      phong.u.material_index};
+		RenderPipeline light = {lightcube.shader, lightcube.u.model, -1,
+					-1};
+		RenderPipeline bezier = {};
+		RenderPipeline instanced = {
+		    instanced_program.shader, instanced_program.u.model,
+		    instanced_program.u.oct_normals,
+		    instanced_program.u.material_index};
+		queue->begin(view, camera_far);
 
-		glDrawArrays(GL_TRIANGLES, 0, 3 * asset_triangle_count);
+		streamer->update();
+		stats.bezier = bezier_teapot != NULL;
+		stats.bezier_hardware =
+		    hardware_tessellation && bezier_program.shader != NULL;
+		if (bezier_teapot != NULL && stats.bezier_hardware) {
+			BasicShader *shader = bezier_program.shader;
+			bezier = {shader, bezier_program.u.model,
+				  bezier_program.u.oct_normals,
+				  bezier_program.u.material_index};
+			shader->use();
+			shader->setFloat(
+			    u_bezier.pixels_per_unit,
+			    lod_pixels_per_unit(1.0f, glm::radians(camera_fov),
+						(float)HEIGHT));
+			shader->setFloat(u_bezier.pixels_per_segment,
+					 BEZIER_PIXELS_PER_SEGMENT);
+			RenderPacket packet =
+			    meshPacket(&bezier, &bezier_patches_gpu, model,
+				       MATERIAL_COPPER);
+			packet.patch_vertices = 16;
+			packet.timer = asset_timer;
+			queue->push(RENDER_LAYER_OPAQUE, packet);
+			stats.asset_buffer_bytes =
+			    gpu_mesh_size(bezier_patches_gpu);
+		} else if (bezier_teapot != NULL) {
+			updateBezier(bezier_teapot, &bezier_gpu, model,
+				     camera_eye, camera_fov);
+			RenderPacket packet = meshPacket(
+			    &lit, &bezier_gpu, model, MATERIAL_COPPER);
+			packet.timer = asset_timer;
+			queue->push(RENDER_LAYER_OPAQUE, packet);
+			stats.bezier_patches = bezier_teapot->stats;
+			stats.asset_buffer_bytes = gpu_mesh_size(bezier_gpu);
+		}
+		stats.asset_resident =
+		    teapot != NULL && teapot->state == ASSET_RESIDENT;
+		if (stats.asset_resident && mesh_pool == NULL &&
+		    draw_path == DRAW_PATH_MULTI_DRAW) {
+			mesh_pool = createMeshPool(
+			    teapot->gpu, vertices_cube2,
+			    sizeof(vertices_cube2) / sizeof(MeshVertex),
+			    &pool_teapot, &pool_ground);
+			if (mesh_pool == NULL) {
+				fprintf(stderr, "teapot cannot be pooled, "
+						"drawing per object\n");
+				draw_path = DRAW_PATH_PER_OBJECT;
+			}
+		}
+		// Pooled meshes wait for the INSTANCED program.
+		bool pooled = draw_path == DRAW_PATH_MULTI_DRAW &&
+			      mesh_pool != NULL &&
+			      instanced_program.shader != NULL;
+		if (stats.asset_resident) {
+			const GpuMesh &gpu = teapot->gpu;
+			RenderPacket packet =
+			    meshPacket(&lit, &gpu, model, MATERIAL_COPPER);
+			packet.timer = asset_timer;
+			if (pooled) {
+				packet.pipeline = &instanced;
+				packet.pool = mesh_pool;
+				packet.pool_mesh = pool_teapot;
+				packet.timer = NULL;
+			}
+			queueAsset(queue, packet, projection * view, camera_eye,
+				   camera_fov, camera_near, &asset_lod,
+				   &visible_meshlets, &stats);
+			stats.asset_load = teapot->stats;
+			stats.asset_buffer_bytes = gpu_mesh_size(gpu);
+		}
+
+		uint32_t copies = stats.asset_resident ? instance_count : 0;
+		if (copies > 0) {
+			layoutInstances(&instance_grid, teapot->gpu, copies);
+		}
+		if (scene.bvh.size() != SCENE_COPIES + copies) {
+			buildScene(&scene, instance_grid, copies,
+				   copies > 0 ? &teapot->gpu : NULL,
+				   lightcube_pos, &stats);
+		}
+		moveLightcube(&scene, lightcube_pos, &stats);
+		uint32_t visible =
+		    cullScene(&scene, &instance_grid, copies, cull_bvh,
+			      projection * view, &stats);
+		stats.scene_bvh_cost = scene.bvh.cost();
+		pickScene(&scene, window, projection * view, instance_grid,
+			  copies > 0 ? &teapot->bvh : NULL, &stats);
+
+		stats.instances = 0;
+		stats.instances_culled = 0;
+		DrawPath path = (DrawPath)draw_path;
+		if (path == DRAW_PATH_MULTI_DRAW && !pooled) {
+			path = DRAW_PATH_PER_OBJECT;
+		}
+		if (copies > 0 && (path == DRAW_PATH_PER_OBJECT ||
+				   instanced_program.shader != NULL)) {
+			if (instances == NULL && path == DRAW_PATH_INSTANCED) {
+				instances = new InstanceBatch(&teapot->gpu);
+			}
+			queueInstances(queue, path, &lit, &instanced,
+				       instances, mesh_pool, pool_teapot,
+				       teapot->gpu, copies, visible, camera_eye,
+				       camera_fov, camera_near, &instance_grid,
+				       &stats);
+		}
 
 		// ground
+		model = groundModel();
+		RenderPacket ground = meshPacket(&lit, &ground_gpu, model,
+						 MATERIAL_WHITE_PLASTIC);
+		if (pooled) {
+			ground.pipeline = &instanced;
+			ground.model =
+			    model * mesh_pool->mesh(pool_ground).dequantize;
+			ground.oct_normals = teapot->gpu.vertex_format ==
+					     MESH_VERTEX_QUANTIZED;
+			ground.pool = mesh_pool;
+			ground.pool_mesh = pool_ground;
+		}
+		if (scene.ground_visible) {
+			queue->push(RENDER_LAYER_OPAQUE, ground);
+		}
 
-		model =
-		    glm::scale(glm::mat4(1.0f), glm::vec3(10.0f, 0.1f, 10.0f));
-		model = glm::translate(model, glm::vec3(0.0f, -10.0f, 0.0f));
-		configurePhongShader(shader_phong, model, view, projection,
-				     camera_eye, lightcube_pos, white_plastic);
-
-		glBindVertexArray(VAO_ground);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO_ground);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-				      6 * sizeof(float), NULL);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-				      6 * sizeof(float),
-				      (void *)(3 * sizeof(float)));
-		glEnableVertexAttribArray(0);
-		glEnableVertexAttribArray(1);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-
-		model = glm::translate(glm::mat4(1.0f), lightcube_pos);
-		shader_lightcube->use();
-		configureLightcubeShader(shader_lightcube, model, view,
-					 projection, lightcube_pos);
-
-		glBindVertexArray(VAO_lightcube);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO_lightcube);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_lightcube);
-
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-				      3 * sizeof(float), NULL);
-		glEnableVertexAttribArray(0);
-		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+		if (scene.lightcube_visible) {
+			model = glm::translate(glm::mat4(1.0f), lightcube_pos);
+			queue->push(RENDER_LAYER_OPAQUE,
+				    meshPacket(&light, &lightcube_gpu, model,
+					       MATERIAL_COPPER));
+		}
+
+		queue->submit();
+		stats.asset_gpu_ms = asset_timer->ms;
+		stats.queue = queue->stats;
+		if (mesh_pool != NULL) {
+			stats.mesh_pool = mesh_pool->stats;
+		}
 
 		// ImGui::ShowDemoWindow(&show_demo_window);
 		if (show_demo_window) {
 			imgui_demo_window(show_demo_window, camera_eye,
 					  camera_center, camera_fov,
 					  lightcube_pos);
+			imgui_stats_window(stats, hardware_tessellation,
+					   lighting, instance_count, draw_path,
+					   cull_bvh);
 		}
 		ImGui::Render();
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 		glfwSwapBuffers(window);
 	}
 
+	delete instances;
+	delete mesh_pool;
+	delete streamer;
+	delete shaders;
+	delete asset_timer;
+	delete queue;
+	delete camera_block;
+	delete lights_block;
+	delete materials_block;
+	gpu_mesh_destroy(&lightcube_gpu);
+	gpu_mesh_destroy(&ground_gpu);
+	if (bezier_teapot != NULL) {
+		if (bezier_gpu.VBO != 0) {
+			gpu_mesh_destroy(&bezier_gpu);
+		}
+		if (bezier_patches_gpu.VBO != 0) {
+			gpu_mesh_destroy(&bezier_patches_gpu);
+		}
+		delete bezier_teapot;
+	}
+
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
@@ -0,0 +1,92 @@
+#include "mesh.hpp"
+#include "vertex_layout.hpp"
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+
+MeshLayout mesh_layout_float() { return VERTEX_LAYOUT_MESH; }
+
+uint32_t mesh_index_size(const Mesh &mesh) {
+	return mesh.vertexCount() <= 0x10000 ? 2 : 4;
+}
+
+void mesh_pack_indices(const Mesh &mesh, std::vector<uint8_t> *out,
+		       std::vector<MeshLodRange> *ranges) {
+	std::vector<const std::vector<uint32_t> *> levels;
+	levels.push_back(&mesh.indices);
+	for (const MeshLod &lod : mesh.lods) {
+		levels.push_back(&lod.indices);
+	}
+	uint32_t index_size = mesh_index_size(mesh);
+	size_t total = 0;
+	for (const std::vector<uint32_t> *level : levels) {
+		total += level->size();
+	}
+	out->resize(total * index_size);
+	if (ranges != NULL) {
+		ranges->clear();
+	}
+
+	size_t offset = 0;
+	for (size_t l = 0; l < levels.size(); l++) {
+		const std::vector<uint32_t> &indices = *levels[l];
+		if (index_size == 4) {
+			memcpy(out->data() + offset * 4, indices.data(),
+			       indices.size() * 4);
+		} else {
+			uint16_t *dst = (uint16_t *)out->data() + offset;
+			for (size_t i = 0; i < indices.size(); i++) {
+				dst[i] = indices[i];
+			}
+		}
+		if (ranges != NULL) {
+			float error = l == 0 ? 0.0f : mesh.lods[l - 1].error;
+			ranges->push_back({(uint32_t)offset,
+					   (uint32_t)indices.size(), error, 0});
+		}
+		offset += indices.size();
+	}
+}
+
+void mesh_bounds(const Mesh &mesh, float aabb_min[3], float aabb_max[3]) {
+	for (int k = 0; k < 3; k++) {
+		aabb_min[k] = FLT_MAX;
+		aabb_max[k] = -FLT_MAX;
+	}
+	for (size_t i = 0; i < mesh.vertices.size();
+	     i += MESH_FLOATS_PER_VERTEX) {
+		for (int k = 0; k < 3; k++) {
+			float v = mesh.vertices[i + k];
+			aabb_min[k] = v < aabb_min[k] ? v : aabb_min[k];
+			aabb_max[k] = v > aabb_max[k] ? v : aabb_max[k];
+		}
+	}
+}
+
+bool mesh_load_norm_txt(const char *path, Mesh *mesh) {
+	FILE *asset_file = fopen(path, "r");
+	if (asset_file == NULL) {
+		fprintf(stderr, "failed to open asset file %s\n", path);
+		return false;
+	}
+	int triangle_count;
+	if (fscanf(asset_file, "%d", &triangle_count) != 1 ||
+	    triangle_count < 0) {
+		fprintf(stderr, "malformed asset file %s\n", path);
+		fclose(asset_file);
+		return false;
+	}
+	mesh->indices.clear();
+	mesh->vertices.resize(3 * MESH_FLOATS_PER_VERTEX * triangle_count);
+	float *v = mesh->vertices.data();
+	for (size_t i = 0; i < mesh->vertices.size(); i += 6) {
+		if (fscanf(asset_file, "%f %f %f %f %f %f", &v[i], &v[i + 1],
+			   &v[i + 2], &v[i + 3], &v[i + 4], &v[i + 5]) != 6) {
+			fprintf(stderr, "truncated asset file %s\n", path);
+			fclose(asset_file);
+			return false;
+		}
+	}
+	fclose(asset_file);
+	return true;
+}
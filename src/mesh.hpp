@@ -0,0 +1,108 @@
+#ifndef _MESH_HPP
+#define _MESH_HPP
+
+#include <cstdint>
+#include <vector>
+
+// Interleaved position (vec3) + normal (vec3), the layout of the .norm.txt
+// assets and of vertex_phong.glsl's inputs.
+#define MESH_FLOATS_PER_VERTEX 6
+
+// Attribute component types. The values are the matching GL enums so a
+// layout read from disk can be handed to glVertexAttribPointer as is, without
+// making the asset code depend on the GL headers.
+#define MESH_TYPE_SHORT 0x1402
+#define MESH_TYPE_UNSIGNED_SHORT 0x1403
+#define MESH_TYPE_UNSIGNED_INT 0x1405 // integer inputs, never normalized
+#define MESH_TYPE_FLOAT 0x1406
+
+#define MESH_MAX_ATTRIBUTES 4
+
+struct MeshAttribute {
+	uint32_t location;
+	uint32_t components;
+	uint32_t type;
+	uint32_t normalized;
+	uint32_t offset;
+};
+
+struct MeshLayout {
+	uint32_t stride;
+	uint32_t attribute_count;
+	MeshAttribute attributes[MESH_MAX_ATTRIBUTES];
+};
+
+// A coarser level of detail over the same vertices as Mesh::indices.
+struct MeshLod {
+	std::vector<uint32_t> indices;
+	float error; // object space distance to the full detail mesh
+};
+
+// Where a level of detail lives in the packed index buffer; also the record
+// stored in .mesh files.
+struct MeshLodRange {
+	uint32_t index_offset; // in indices, not bytes
+	uint32_t index_count;
+	float error;
+	uint32_t reserved;
+};
+
+// A small cluster of consecutive triangles in Mesh::indices with the bounds
+// needed to cull it on its own; also the record stored in .mesh files.
+struct Meshlet {
+	float center[3]; // bounding sphere, object space
+	float radius;
+	float cone_axis[3]; // average facing of the triangles
+	float cone_cutoff;  // 1 when the normals spread too far to cull
+	uint32_t index_offset; // in Mesh::indices
+	uint32_t index_count;
+};
+
+// A node of a 4-wide bounding volume hierarchy over the triangles of a mesh,
+// the boxes of its children side by side so all four are tested at once;
+// also the record stored in .mesh files. Unused slots have an empty box.
+struct MeshBvhNode {
+	float min[3][4]; // x, y and z of the four boxes
+	float max[3][4];
+	// A child node, or with count the first of count entries of
+	// Mesh::bvh_triangles.
+	uint32_t child[4];
+	uint32_t count[4]; // 0 for a child node
+};
+
+#define MESH_BVH_EMPTY 0xffffffffu // child of an unused slot
+
+struct Mesh {
+	std::vector<float> vertices;   // MESH_FLOATS_PER_VERTEX per vertex
+	std::vector<uint32_t> indices; // empty for plain triangle lists
+	std::vector<MeshLod> lods;     // coarser levels, finest first
+	std::vector<Meshlet> meshlets; // partition of indices, may be empty
+	std::vector<MeshBvhNode> bvh;  // over LOD0, root first, may be empty
+	std::vector<uint32_t> bvh_triangles; // LOD0 triangles of bvh's leaves
+
+	uint32_t vertexCount() const {
+		return vertices.size() / MESH_FLOATS_PER_VERTEX;
+	}
+
+	uint32_t triangleCount() const {
+		return (indices.empty() ? vertexCount() : indices.size()) / 3;
+	}
+};
+
+MeshLayout mesh_layout_float();
+
+// 2 when every index fits in 16 bits, otherwise 4.
+uint32_t mesh_index_size(const Mesh &mesh);
+
+// Copies the indices followed by those of every LOD into out at
+// mesh_index_size() bytes each, ready for GL_ELEMENT_ARRAY_BUFFER. ranges,
+// if not NULL, receives one entry per level starting with the full mesh.
+void mesh_pack_indices(const Mesh &mesh, std::vector<uint8_t> *out,
+		       std::vector<MeshLodRange> *ranges);
+
+void mesh_bounds(const Mesh &mesh, float aabb_min[3], float aabb_max[3]);
+
+// Reads the text format described in assets/how-to-read.txt.
+bool mesh_load_norm_txt(const char *path, Mesh *mesh);
+
+#endif
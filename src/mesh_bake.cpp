@@ -0,0 +1,78 @@
+#include "mesh_bake.hpp"
+#include "mesh_bvh.hpp"
+#include "mesh_meshlet.hpp"
+#include "mesh_optimize.hpp"
+#include "mesh_simplify.hpp"
+#include "mesh_weld.hpp"
+#include <cstdio>
+
+MeshBakeOptions mesh_bake_defaults() {
+	MeshBakeOptions options;
+	options.weld = true;
+	options.weld_epsilon = MESH_WELD_EPSILON;
+	options.lods = true;
+	options.meshlets = true;
+	options.optimize = true;
+	options.cache_size = MESH_VERTEX_CACHE_SIZE;
+	options.overdraw_threshold = MESH_OVERDRAW_THRESHOLD;
+	options.bvh = true;
+	return options;
+}
+
+static void print_cache_stats(const char *name, const char *stage,
+			      const Mesh &mesh, uint32_t cache_size) {
+	MeshCacheStats stats = mesh_analyze_vertex_cache(mesh, cache_size);
+	printf("%s: %-9s ACMR %.3f ATVR %.3f (cache %u)\n", name, stage,
+	       stats.acmr, stats.atvr, cache_size);
+}
+
+void mesh_bake(const char *name, Mesh *mesh, const MeshBakeOptions &options,
+	       ThreadPool *pool) {
+	if (options.weld) {
+		MeshWeldStats weld_stats;
+		mesh_weld(mesh, options.weld_epsilon, &weld_stats);
+		mesh_weld_print(name, weld_stats);
+	}
+	// Simplify before optimizing so the passes below reorder every LOD
+	// and vertex fetch lays out the vertices LOD0 first.
+	if (options.lods && !mesh->indices.empty()) {
+		mesh_generate_lods(mesh);
+		printf("%s: lod 0 %u triangles\n", name, mesh->triangleCount());
+		for (size_t i = 0; i < mesh->lods.size(); i++) {
+			const MeshLod &lod = mesh->lods[i];
+			printf("%s: lod %zu %zu triangles, error %g\n", name,
+			       i + 1, lod.indices.size() / 3, lod.error);
+		}
+	}
+	if (options.meshlets && !mesh->indices.empty()) {
+		mesh_build_meshlets(mesh, MESH_MESHLET_MAX_VERTICES,
+				    MESH_MESHLET_MAX_TRIANGLES);
+		uint32_t cones = 0;
+		for (const Meshlet &meshlet : mesh->meshlets) {
+			cones += meshlet.cone_cutoff < 1.0f;
+		}
+		printf("%s: %zu meshlets, %.1f triangles each, %u with a normal "
+		       "cone\n",
+		       name, mesh->meshlets.size(),
+		       (float)mesh->triangleCount() / mesh->meshlets.size(),
+		       cones);
+	}
+	if (options.optimize && !mesh->indices.empty()) {
+		print_cache_stats(name, "input", *mesh, options.cache_size);
+		mesh_optimize_vertex_cache(mesh, options.cache_size);
+		print_cache_stats(name, "vcache", *mesh, options.cache_size);
+		mesh_optimize_overdraw(mesh, options.cache_size,
+				       options.overdraw_threshold);
+		mesh_optimize_vertex_fetch(mesh);
+		print_cache_stats(name, "overdraw", *mesh, options.cache_size);
+	}
+	// Last, it refers to triangles by their final position.
+	if (options.bvh) {
+		MeshBvhStats stats;
+		mesh_build_bvh(mesh, pool, &stats);
+		printf("%s: bvh %u nodes, %u leaves, depth %u, cost %.1f, "
+		       "%.1f KB, built in %.1f ms\n",
+		       name, stats.nodes, stats.leaves, stats.depth, stats.cost,
+		       stats.bytes / 1024.0f, stats.ms);
+	}
+}
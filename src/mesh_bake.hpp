@@ -0,0 +1,31 @@
+#ifndef _MESH_BAKE_HPP
+#define _MESH_BAKE_HPP
+
+#include "mesh.hpp"
+#include "thread_pool.hpp"
+#include <cstdint>
+
+// Bump whenever a pass changes its output, so cached bakes are redone.
+#define MESH_BAKE_VERSION 1
+
+// Processing applied to a freshly parsed mesh before it is written to a
+// .mesh file or, for unbaked assets, uploaded directly.
+struct MeshBakeOptions {
+	bool weld;
+	float weld_epsilon;
+	bool lods;
+	bool meshlets;
+	bool optimize;
+	uint32_t cache_size;
+	float overdraw_threshold;
+	bool bvh;
+};
+
+MeshBakeOptions mesh_bake_defaults();
+
+// Runs the enabled passes in order and prints their statistics under name.
+// The BVH is built across pool.
+void mesh_bake(const char *name, Mesh *mesh, const MeshBakeOptions &options,
+	       ThreadPool *pool);
+
+#endif
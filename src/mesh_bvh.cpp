@@ -0,0 +1,519 @@
+#include "mesh_bvh.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+struct Box {
+	float min[3];
+	float max[3];
+};
+
+// A triangle as the build sorts it, its box moved along so that binning
+// and partitioning read memory in order.
+struct Ref {
+	Box box;
+	uint32_t triangle;
+};
+
+// Binary tree the build produces before it is collapsed. Inner nodes have
+// count 0 and their children at first and first + 1; leaves hold count
+// triangles from first on in Builder::refs.
+struct BuildNode {
+	Box box;
+	uint32_t first;
+	uint32_t count;
+};
+
+// Boxes of the triangles whose centers fall in a bin, and of the centers.
+struct Bin {
+	Box box;
+	Box centers;
+	uint32_t count;
+};
+
+struct Builder {
+	ThreadPool *pool;
+	ThreadPool::Group group;
+	std::vector<Ref> refs;
+	// Sized for the 2n - 1 nodes a binary tree over n triangles can
+	// have, so tasks allocate children without moving the others.
+	std::vector<BuildNode> nodes;
+	std::atomic<uint32_t> node_count;
+};
+
+static const Box EMPTY_BOX = {{FLT_MAX, FLT_MAX, FLT_MAX},
+			      {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+
+static inline void box_grow(Box *box, const Box &other) {
+	for (int k = 0; k < 3; k++) {
+		box->min[k] = std::min(box->min[k], other.min[k]);
+		box->max[k] = std::max(box->max[k], other.max[k]);
+	}
+}
+
+static inline void box_grow(Box *box, const float *point) {
+	for (int k = 0; k < 3; k++) {
+		box->min[k] = std::min(box->min[k], point[k]);
+		box->max[k] = std::max(box->max[k], point[k]);
+	}
+}
+
+static inline float half_area(const Box &box) {
+	float d[3];
+	for (int k = 0; k < 3; k++) {
+		d[k] = std::max(box.max[k] - box.min[k], 0.0f);
+	}
+	return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+}
+
+static inline const float *position(const Mesh &mesh, uint32_t triangle,
+				    int corner) {
+	uint32_t v = 3 * triangle + corner;
+	if (!mesh.indices.empty()) {
+		v = mesh.indices[v];
+	}
+	return &mesh.vertices[(size_t)v * MESH_FLOATS_PER_VERTEX];
+}
+
+// Large ranges are split into a few chunks per thread.
+static uint32_t chunk_count(const Builder &b, uint32_t count) {
+	return count > MESH_BVH_PARALLEL_TRIANGLES ? b.pool->size() * 4 : 1;
+}
+
+// Calls fn(chunk, first, end) for every chunk of the range, in parallel when
+// there is more than one.
+template <typename Fn>
+static void for_chunks(Builder *b, uint32_t first, uint32_t count,
+		       uint32_t chunks, const Fn &fn) {
+	auto run = [&](size_t c) {
+		uint32_t begin = first + (uint64_t)count * c / chunks;
+		uint32_t end = first + (uint64_t)count * (c + 1) / chunks;
+		fn(c, begin, end);
+	};
+	if (chunks == 1) {
+		run(0);
+	} else {
+		b->pool->parallelFor(chunks, run);
+	}
+}
+
+static inline float center(const Box &box, int axis) {
+	return 0.5f * (box.min[axis] + box.max[axis]);
+}
+
+static inline void grow_center(Box *centers, const Box &box) {
+	for (int k = 0; k < 3; k++) {
+		float c = center(box, k);
+		centers->min[k] = std::min(centers->min[k], c);
+		centers->max[k] = std::max(centers->max[k], c);
+	}
+}
+
+// Bins are scale wide along axis, the last one also takes the far end.
+static inline int bin_of(const Box &box, const Box &centers, float scale,
+			 int axis, int bin_count) {
+	int bin = (int)((center(box, axis) - centers.min[axis]) * scale);
+	return std::min(bin, bin_count - 1);
+}
+
+// Grows box around the triangles of [begin, end) and centers around their
+// centers.
+static void bound_chunk(const Builder &b, uint32_t begin, uint32_t end,
+			Box *box, Box *centers) {
+	for (uint32_t i = begin; i < end; i++) {
+		box_grow(box, b.refs[i].box);
+		grow_center(centers, b.refs[i].box);
+	}
+}
+
+// Adds the triangles of [begin, end) to the bins along axis.
+static void bin_chunk(const Builder &b, uint32_t begin, uint32_t end,
+		      const Box &centers, float scale, int axis, int bin_count,
+		      Bin *bins) {
+	for (uint32_t i = begin; i < end; i++) {
+		const Box &box = b.refs[i].box;
+		Bin &bin = bins[bin_of(box, centers, scale, axis, bin_count)];
+		box_grow(&bin.box, box);
+		grow_center(&bin.centers, box);
+		bin.count++;
+	}
+}
+
+// References to the triangles in [begin, end), in order.
+static void bound_triangles(const Mesh &mesh, uint32_t begin, uint32_t end,
+			    Builder *b) {
+	for (uint32_t t = begin; t < end; t++) {
+		Ref &ref = b->refs[t];
+		ref.box = EMPTY_BOX;
+		for (int c = 0; c < 3; c++) {
+			box_grow(&ref.box, position(mesh, t, c));
+		}
+		ref.triangle = t;
+	}
+}
+
+// Builds the subtree of the count triangles from first on, whose boxes
+// span box and centers centers, into node index.
+static void build_node(Builder *b, uint32_t index, uint32_t first,
+		       uint32_t count, const Box &box, const Box &centers) {
+	BuildNode &node = b->nodes[index];
+	node.box = box;
+	node.first = first;
+	node.count = count;
+	if (count == 1) {
+		return;
+	}
+
+	// Bin along the axis the centers spread most on, as in Wald's
+	// binned builder; the bins also bound both sides of every split.
+	int axis = 0;
+	for (int k = 1; k < 3; k++) {
+		if (centers.max[k] - centers.min[k] >
+		    centers.max[axis] - centers.min[axis]) {
+			axis = k;
+		}
+	}
+	// Small ranges need fewer bins.
+	int bin_count = std::min(count, (uint32_t)MESH_BVH_BINS);
+	float scale = bin_count / (centers.max[axis] - centers.min[axis]);
+	if (!std::isfinite(scale)) {
+		// The centers coincide, no split separates them.
+		if (count <= MESH_BVH_MAX_LEAF_TRIANGLES) {
+			return;
+		}
+		uint32_t half = count / 2;
+		uint32_t children = b->node_count.fetch_add(2);
+		node.first = children;
+		node.count = 0;
+		build_node(b, children, first, half, box, centers);
+		build_node(b, children + 1, first + half, count - half, box,
+			   centers);
+		return;
+	}
+	Bin bins[MESH_BVH_BINS];
+	for (int i = 0; i < bin_count; i++) {
+		bins[i] = {EMPTY_BOX, EMPTY_BOX, 0};
+	}
+	uint32_t chunks = chunk_count(*b, count);
+	if (chunks == 1) {
+		bin_chunk(*b, first, first + count, centers, scale, axis,
+			  bin_count, bins);
+	} else {
+		std::vector<Bin> chunk_bins(chunks * MESH_BVH_BINS, bins[0]);
+		for_chunks(b, first, count, chunks,
+			   [&](size_t c, uint32_t begin, uint32_t end) {
+				   bin_chunk(*b, begin, end, centers, scale,
+					     axis, bin_count,
+					     &chunk_bins[c * MESH_BVH_BINS]);
+			   });
+		for (uint32_t c = 0; c < chunks; c++) {
+			for (int i = 0; i < bin_count; i++) {
+				const Bin &other =
+				    chunk_bins[c * MESH_BVH_BINS + i];
+				box_grow(&bins[i].box, other.box);
+				box_grow(&bins[i].centers, other.centers);
+				bins[i].count += other.count;
+			}
+		}
+	}
+
+	// Sweep from both ends; the split after bin i costs the areas of
+	// both sides weighted by their triangles.
+	float right_cost[MESH_BVH_BINS];
+	Box right = EMPTY_BOX;
+	uint32_t right_count = 0;
+	for (int i = bin_count - 1; i > 0; i--) {
+		box_grow(&right, bins[i].box);
+		right_count += bins[i].count;
+		right_cost[i] = half_area(right) * right_count;
+	}
+	Box left = EMPTY_BOX;
+	uint32_t left_count = 0;
+	int best_bin = -1;
+	float best_cost = FLT_MAX;
+	for (int i = 0; i < bin_count - 1; i++) {
+		box_grow(&left, bins[i].box);
+		left_count += bins[i].count;
+		if (left_count == 0 || left_count == count) {
+			continue;
+		}
+		float cost = half_area(left) * left_count + right_cost[i + 1];
+		if (cost < best_cost) {
+			best_cost = cost;
+			best_bin = i;
+		}
+	}
+	float area = std::max(half_area(box), FLT_MIN);
+	float split_cost = MESH_BVH_TRAVERSAL_COST + best_cost / area;
+	if (count <= MESH_BVH_MAX_LEAF_TRIANGLES &&
+	    (float)count <= split_cost) {
+		return;
+	}
+	auto is_left = [&](const Ref &ref) {
+		return bin_of(ref.box, centers, scale, axis, bin_count) <=
+		       best_bin;
+	};
+	std::vector<Ref>::iterator begin = b->refs.begin() + first;
+	uint32_t mid =
+	    std::partition(begin, begin + count, is_left) - b->refs.begin();
+	Bin sides[2] = {{EMPTY_BOX, EMPTY_BOX, 0}, {EMPTY_BOX, EMPTY_BOX, 0}};
+	for (int i = 0; i < bin_count; i++) {
+		Bin &side = sides[i > best_bin];
+		box_grow(&side.box, bins[i].box);
+		box_grow(&side.centers, bins[i].centers);
+	}
+
+	uint32_t children = b->node_count.fetch_add(2);
+	node.first = children;
+	node.count = 0;
+	if (count > MESH_BVH_PARALLEL_TRIANGLES) {
+		Bin left_side = sides[0];
+		b->pool->submit(&b->group, [b, children, first, mid,
+					    left_side] {
+			build_node(b, children, first, mid - first,
+				   left_side.box, left_side.centers);
+		});
+	} else {
+		build_node(b, children, first, mid - first, sides[0].box,
+			   sides[0].centers);
+	}
+	build_node(b, children + 1, mid, first + count - mid, sides[1].box,
+		   sides[1].centers);
+}
+
+// Writes the 4-wide node for binary node index and the ones below it,
+// depth first. Each takes up to four descendants, opening the largest inner
+// child until there are four.
+static uint32_t collapse(const Builder &b, uint32_t index, uint32_t depth,
+			 std::vector<MeshBvhNode> *out, MeshBvhStats *stats) {
+	const BuildNode &node = b.nodes[index];
+	uint32_t slots[4];
+	int n = 0;
+	if (node.count > 0) {
+		slots[n++] = index;
+	} else {
+		slots[n++] = node.first;
+		slots[n++] = node.first + 1;
+	}
+	while (n < 4) {
+		int open = -1;
+		float open_area = -1.0f;
+		for (int i = 0; i < n; i++) {
+			const BuildNode &child = b.nodes[slots[i]];
+			if (child.count == 0 &&
+			    half_area(child.box) > open_area) {
+				open = i;
+				open_area = half_area(child.box);
+			}
+		}
+		if (open < 0) {
+			break;
+		}
+		uint32_t first = b.nodes[slots[open]].first;
+		slots[open] = first;
+		slots[n++] = first + 1;
+	}
+
+	uint32_t wide_index = out->size();
+	out->push_back({});
+	stats->depth = std::max(stats->depth, depth);
+	stats->cost += MESH_BVH_TRAVERSAL_COST * half_area(node.box);
+	MeshBvhNode wide;
+	for (int i = 0; i < 4; i++) {
+		const Box &box = i < n ? b.nodes[slots[i]].box : EMPTY_BOX;
+		for (int k = 0; k < 3; k++) {
+			wide.min[k][i] = box.min[k];
+			wide.max[k][i] = box.max[k];
+		}
+		wide.child[i] = MESH_BVH_EMPTY;
+		wide.count[i] = 0;
+	}
+	for (int i = 0; i < n; i++) {
+		const BuildNode &child = b.nodes[slots[i]];
+		if (child.count > 0) {
+			wide.child[i] = child.first;
+			wide.count[i] = child.count;
+			stats->leaves++;
+			stats->cost += half_area(child.box) * child.count;
+		} else {
+			wide.child[i] =
+			    collapse(b, slots[i], depth + 1, out, stats);
+		}
+	}
+	(*out)[wide_index] = wide;
+	return wide_index;
+}
+
+void mesh_build_bvh(Mesh *mesh, ThreadPool *pool, MeshBvhStats *stats) {
+	std::chrono::steady_clock::time_point start =
+	    std::chrono::steady_clock::now();
+	uint32_t count = mesh->triangleCount();
+	mesh->bvh.clear();
+	mesh->bvh_triangles.clear();
+	MeshBvhStats s = {};
+	if (count == 0) {
+		if (stats != NULL) {
+			*stats = s;
+		}
+		return;
+	}
+
+	Builder b;
+	b.pool = pool;
+	b.refs.resize(count);
+	b.nodes.resize(2 * (size_t)count - 1);
+	b.node_count = 1;
+	for_chunks(&b, 0, count, chunk_count(b, count),
+		   [&b, mesh](size_t, uint32_t begin, uint32_t end) {
+			   bound_triangles(*mesh, begin, end, &b);
+		   });
+	uint32_t chunks = chunk_count(b, count);
+	std::vector<Box> partial(2 * chunks, EMPTY_BOX);
+	for_chunks(&b, 0, count, chunks,
+		   [&b, &partial](size_t c, uint32_t begin, uint32_t end) {
+			   bound_chunk(b, begin, end, &partial[2 * c],
+				       &partial[2 * c + 1]);
+		   });
+	Box box = EMPTY_BOX, centers = EMPTY_BOX;
+	for (uint32_t c = 0; c < chunks; c++) {
+		box_grow(&box, partial[2 * c]);
+		box_grow(&centers, partial[2 * c + 1]);
+	}
+	build_node(&b, 0, 0, count, box, centers);
+	pool->wait(&b.group);
+
+	collapse(b, 0, 1, &mesh->bvh, &s);
+	mesh->bvh_triangles.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		mesh->bvh_triangles[i] = b.refs[i].triangle;
+	}
+	s.nodes = mesh->bvh.size();
+	s.cost /= std::max(half_area(b.nodes[0].box), FLT_MIN);
+	s.bytes = mesh->bvh.size() * sizeof(MeshBvhNode) +
+		  mesh->bvh_triangles.size() * sizeof(uint32_t);
+	std::chrono::duration<float, std::milli> ms =
+	    std::chrono::steady_clock::now() - start;
+	s.ms = ms.count();
+	if (stats != NULL) {
+		*stats = s;
+	}
+}
+
+// Möller-Trumbore; t is the distance along direction.
+static bool ray_triangle(const float origin[3], const float direction[3],
+			 const float *a, const float *b, const float *c,
+			 float *t) {
+	float e1[3], e2[3], s[3];
+	for (int k = 0; k < 3; k++) {
+		e1[k] = b[k] - a[k];
+		e2[k] = c[k] - a[k];
+		s[k] = origin[k] - a[k];
+	}
+	float p[3] = {direction[1] * e2[2] - direction[2] * e2[1],
+		      direction[2] * e2[0] - direction[0] * e2[2],
+		      direction[0] * e2[1] - direction[1] * e2[0]};
+	float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+	if (std::fabs(det) < 1e-12f) {
+		return false;
+	}
+	float inverse = 1.0f / det;
+	float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+	if (u < 0.0f || u > 1.0f) {
+		return false;
+	}
+	float q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2],
+		      s[0] * e1[1] - s[1] * e1[0]};
+	float v = (direction[0] * q[0] + direction[1] * q[1] +
+		   direction[2] * q[2]) *
+		  inverse;
+	if (v < 0.0f || u + v > 1.0f) {
+		return false;
+	}
+	*t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse;
+	return *t >= 0.0f;
+}
+
+bool mesh_bvh_raycast(const Mesh &mesh, const float origin[3],
+		      const float direction[3], float max_distance,
+		      uint32_t *triangle, float *distance) {
+	if (mesh.bvh.empty()) {
+		return false;
+	}
+	float inverse[3];
+	for (int k = 0; k < 3; k++) {
+		inverse[k] = 1.0f / direction[k];
+	}
+	bool hit = false;
+	float best = max_distance;
+	// Nodes the ray enters, nearer ones on top.
+	std::vector<std::pair<uint32_t, float>> stack;
+	stack.push_back({0, 0.0f});
+	while (!stack.empty()) {
+		std::pair<uint32_t, float> top = stack.back();
+		stack.pop_back();
+		if (top.second > best) {
+			continue;
+		}
+		const MeshBvhNode &node = mesh.bvh[top.first];
+		// The four boxes together, the loop vectorizes.
+		float enter[4], exit[4];
+		for (int i = 0; i < 4; i++) {
+			enter[i] = 0.0f;
+			exit[i] = best;
+			for (int k = 0; k < 3; k++) {
+				float t0 =
+				    (node.min[k][i] - origin[k]) * inverse[k];
+				float t1 =
+				    (node.max[k][i] - origin[k]) * inverse[k];
+				enter[i] = std::max(enter[i], std::min(t0, t1));
+				exit[i] = std::min(exit[i], std::max(t0, t1));
+			}
+		}
+		int order[4], n = 0;
+		for (int i = 0; i < 4; i++) {
+			if (node.child[i] != MESH_BVH_EMPTY &&
+			    enter[i] <= exit[i]) {
+				order[n++] = i;
+			}
+		}
+		std::sort(order, order + n, [&enter](int a, int b) {
+			return enter[a] < enter[b];
+		});
+		// Leaves are tested nearest first, child nodes pushed so the
+		// nearest is popped first.
+		for (int j = 0; j < n; j++) {
+			int i = order[j];
+			if (node.count[i] == 0 || enter[i] > best) {
+				continue;
+			}
+			for (uint32_t r = 0; r < node.count[i]; r++) {
+				uint32_t tri =
+				    mesh.bvh_triangles[node.child[i] + r];
+				float t;
+				if (ray_triangle(origin, direction,
+						 position(mesh, tri, 0),
+						 position(mesh, tri, 1),
+						 position(mesh, tri, 2), &t) &&
+				    t < best) {
+					best = t;
+					*triangle = tri;
+					hit = true;
+				}
+			}
+		}
+		for (int j = n - 1; j >= 0; j--) {
+			int i = order[j];
+			if (node.count[i] == 0) {
+				stack.push_back({node.child[i], enter[i]});
+			}
+		}
+	}
+	if (hit) {
+		*distance = best;
+	}
+	return hit;
+}
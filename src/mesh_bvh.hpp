@@ -0,0 +1,43 @@
+#ifndef _MESH_BVH_HPP
+#define _MESH_BVH_HPP
+
+#include "mesh.hpp"
+#include "thread_pool.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Bins along the widest axis of the triangle centers a split is chosen
+// from.
+#define MESH_BVH_BINS 16
+// Triangles a leaf may hold; larger ranges are always split.
+#define MESH_BVH_MAX_LEAF_TRIANGLES 8
+// Cost of visiting a node relative to intersecting a triangle.
+#define MESH_BVH_TRAVERSAL_COST 1.0f
+// Ranges above this are binned in chunks across the pool, and their halves
+// built as separate tasks.
+#define MESH_BVH_PARALLEL_TRIANGLES 16384
+
+struct MeshBvhStats {
+	uint32_t nodes;
+	uint32_t leaves;
+	uint32_t depth;
+	float cost;   // SAH cost of the 4-wide tree, in triangle tests per ray
+	size_t bytes; // nodes and triangle references
+	float ms;
+};
+
+// Builds mesh->bvh over the LOD0 triangles. Splits are picked by the surface
+// area heuristic between MESH_BVH_BINS bins of the triangle centers, large
+// ranges are binned and split across pool. The binary tree that gives is
+// collapsed into 4-wide nodes. Run it after the passes that reorder
+// triangles. stats may be NULL.
+void mesh_build_bvh(Mesh *mesh, ThreadPool *pool, MeshBvhStats *stats);
+
+// The LOD0 triangle of mesh the ray hits first within max_distance, found
+// through mesh.bvh. direction need not be normalized, distance is in its
+// units. False when it misses.
+bool mesh_bvh_raycast(const Mesh &mesh, const float origin[3],
+		      const float direction[3], float max_distance,
+		      uint32_t *triangle, float *distance);
+
+#endif
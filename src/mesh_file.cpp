@@ -0,0 +1,340 @@
+#include "mesh_file.hpp"
+#include "vertex_layout.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+MeshFile::MeshFile() {
+	this->fd = -1;
+	this->map = NULL;
+	this->map_size = 0;
+	this->header = NULL;
+}
+
+MeshFile::~MeshFile() { this->close(); }
+
+// Checks the sections against the header, so nothing read through the counts
+// in it lands outside the mapping. Prints why not under path.
+static bool contents_valid(const MeshFile &file, const char *path) {
+	const MeshFileHeader *h = file.header;
+	if (h->vertex_format != MESH_VERTEX_FLOAT &&
+	    h->vertex_format != MESH_VERTEX_QUANTIZED) {
+		fprintf(stderr, "mesh file %s: unknown vertex format %u\n",
+			path, h->vertex_format);
+		return false;
+	}
+	uint64_t vertices_size = 0;
+	if (file.vertices(&vertices_size) == NULL ||
+	    vertices_size != (uint64_t)h->vertex_count * h->layout.stride) {
+		fprintf(stderr, "mesh file %s: vertices do not match the "
+				"header\n",
+			path);
+		return false;
+	}
+	uint64_t indices_size = 0;
+	const void *indices = file.indices(&indices_size);
+	// Triangle lists have neither indices nor an index size.
+	bool unindexed = indices == NULL && h->index_count == 0 &&
+			 h->index_size == 0;
+	if (!unindexed &&
+	    (indices == NULL || (h->index_size != 2 && h->index_size != 4) ||
+	     indices_size != (uint64_t)h->index_count * h->index_size)) {
+		fprintf(stderr, "mesh file %s: indices do not match the "
+				"header\n",
+			path);
+		return false;
+	}
+	uint32_t lod_count = 0;
+	const MeshLodRange *lods = file.lods(&lod_count);
+	for (uint32_t i = 0; i < lod_count; i++) {
+		if (lods[i].index_offset > h->index_count ||
+		    lods[i].index_count >
+			h->index_count - lods[i].index_offset) {
+			fprintf(stderr, "mesh file %s: lod %u out of range\n",
+				path, i);
+			return false;
+		}
+	}
+	uint32_t meshlet_count = 0;
+	const Meshlet *meshlets = file.meshlets(&meshlet_count);
+	for (uint32_t i = 0; i < meshlet_count; i++) {
+		const Meshlet &m = meshlets[i];
+		if (m.index_offset > h->index_count ||
+		    m.index_count > h->index_count - m.index_offset) {
+			fprintf(stderr, "mesh file %s: meshlet %u out of "
+					"range\n",
+				path, i);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool MeshFile::open(const char *path) {
+	this->close();
+	this->fd = ::open(path, O_RDONLY);
+	if (this->fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(this->fd, &st) != 0 ||
+	    (size_t)st.st_size < sizeof(MeshFileHeader)) {
+		fprintf(stderr, "mesh file %s: too small\n", path);
+		this->close();
+		return false;
+	}
+	this->map_size = st.st_size;
+	this->map =
+	    mmap(NULL, this->map_size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+	if (this->map == MAP_FAILED) {
+		this->map = NULL;
+		fprintf(stderr, "mesh file %s: mmap failed\n", path);
+		this->close();
+		return false;
+	}
+	// The blobs are consumed front to back by glBufferData, let the
+	// kernel read ahead instead of faulting page by page.
+	madvise(this->map, this->map_size, MADV_SEQUENTIAL);
+	madvise(this->map, this->map_size, MADV_WILLNEED);
+
+	const MeshFileHeader *h = (const MeshFileHeader *)this->map;
+	if (memcmp(h->magic, MESH_FILE_MAGIC, sizeof(h->magic)) != 0) {
+		fprintf(stderr, "mesh file %s: bad magic\n", path);
+		this->close();
+		return false;
+	}
+	if (h->version != MESH_FILE_VERSION) {
+		fprintf(stderr, "mesh file %s: version %u, expected %u\n", path,
+			h->version, MESH_FILE_VERSION);
+		this->close();
+		return false;
+	}
+	if (!vertex_layout_valid(h->layout)) {
+		fprintf(stderr, "mesh file %s: bad vertex layout\n", path);
+		this->close();
+		return false;
+	}
+	size_t table_end = sizeof(MeshFileHeader) +
+			   (size_t)h->section_count * sizeof(MeshFileSection);
+	if (table_end > this->map_size) {
+		fprintf(stderr, "mesh file %s: truncated section table\n",
+			path);
+		this->close();
+		return false;
+	}
+	const MeshFileSection *sections =
+	    (const MeshFileSection *)(h + 1);
+	for (uint32_t i = 0; i < h->section_count; i++) {
+		if (sections[i].offset > this->map_size ||
+		    sections[i].size > this->map_size - sections[i].offset) {
+			fprintf(stderr, "mesh file %s: truncated section %u\n",
+				path, sections[i].kind);
+			this->close();
+			return false;
+		}
+	}
+	this->header = h;
+	if (!contents_valid(*this, path)) {
+		this->close();
+		return false;
+	}
+	return true;
+}
+
+void MeshFile::close() {
+	if (this->map != NULL) {
+		munmap(this->map, this->map_size);
+	}
+	if (this->fd >= 0) {
+		::close(this->fd);
+	}
+	this->fd = -1;
+	this->map = NULL;
+	this->map_size = 0;
+	this->header = NULL;
+}
+
+const void *MeshFile::section(uint32_t kind, uint64_t *size) const {
+	if (this->header == NULL) {
+		return NULL;
+	}
+	const MeshFileSection *sections =
+	    (const MeshFileSection *)(this->header + 1);
+	for (uint32_t i = 0; i < this->header->section_count; i++) {
+		if (sections[i].kind == kind) {
+			if (size != NULL) {
+				*size = sections[i].size;
+			}
+			return (const char *)this->map + sections[i].offset;
+		}
+	}
+	return NULL;
+}
+
+// Children come after their parent in depth first order, which also rules
+// out cycles.
+static bool bvh_valid(const Mesh &mesh) {
+	uint32_t node_count = mesh.bvh.size();
+	uint32_t reference_count = mesh.bvh_triangles.size();
+	for (uint32_t n = 0; n < node_count; n++) {
+		const MeshBvhNode &node = mesh.bvh[n];
+		for (int i = 0; i < 4; i++) {
+			uint32_t child = node.child[i];
+			if (child == MESH_BVH_EMPTY) {
+				continue;
+			}
+			if (node.count[i] == 0
+				? child <= n || child >= node_count
+				: child > reference_count ||
+				      node.count[i] > reference_count - child) {
+				return false;
+			}
+		}
+	}
+	uint32_t triangle_count = mesh.triangleCount();
+	for (uint32_t triangle : mesh.bvh_triangles) {
+		if (triangle >= triangle_count) {
+			return false;
+		}
+	}
+	uint32_t vertex_count = mesh.vertexCount();
+	for (uint32_t index : mesh.indices) {
+		if (index >= vertex_count) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool mesh_file_read_bvh(const MeshFile &file, Mesh *mesh) {
+	*mesh = Mesh();
+	const MeshFileHeader *h = file.header;
+	uint32_t node_count = 0, reference_count = 0;
+	const MeshBvhNode *nodes = file.bvh(&node_count);
+	const uint32_t *references = file.bvhTriangles(&reference_count);
+	if (nodes == NULL || node_count == 0 || references == NULL) {
+		return false;
+	}
+	mesh_decode_vertices(file.vertices(NULL), h->vertex_count,
+			     (MeshVertexFormat)h->vertex_format, h->aabb_min,
+			     h->aabb_max, mesh);
+	const void *indices = file.indices(NULL);
+	if (indices != NULL) {
+		// LOD0 comes first; without ranges every index is LOD0.
+		uint32_t lod_count = 0;
+		const MeshLodRange *lods = file.lods(&lod_count);
+		uint32_t count = lod_count > 0 ? lods[0].index_count
+					       : h->index_count;
+		uint32_t first = lod_count > 0 ? lods[0].index_offset : 0;
+		mesh->indices.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			mesh->indices[i] =
+			    h->index_size == 2
+				? ((const uint16_t *)indices)[first + i]
+				: ((const uint32_t *)indices)[first + i];
+		}
+	}
+	mesh->bvh.assign(nodes, nodes + node_count);
+	mesh->bvh_triangles.assign(references, references + reference_count);
+	if (!bvh_valid(*mesh)) {
+		*mesh = Mesh();
+		return false;
+	}
+	return true;
+}
+
+struct Blob {
+	uint32_t kind;
+	const void *data;
+	uint64_t size;
+};
+
+static uint64_t align_up(uint64_t v) {
+	const uint64_t mask = MESH_FILE_ALIGNMENT - 1;
+	return (v + mask) & ~mask;
+}
+
+bool mesh_file_write(const char *path, const Mesh &mesh,
+		     MeshVertexFormat format, MeshQuantizeError *error) {
+	MeshFileHeader header = {};
+	memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+	header.version = MESH_FILE_VERSION;
+	header.vertex_count = mesh.vertexCount();
+	header.vertex_format = format;
+	header.layout = mesh_layout(format);
+	mesh_bounds(mesh, header.aabb_min, header.aabb_max);
+
+	std::vector<uint8_t> vertices;
+	mesh_encode_vertices(mesh, format, header.aabb_min, header.aabb_max,
+			     &vertices, error);
+	std::vector<Blob> blobs;
+	blobs.push_back(
+	    {MESH_SECTION_VERTICES, vertices.data(), vertices.size()});
+
+	std::vector<uint8_t> indices;
+	std::vector<MeshLodRange> lods;
+	if (!mesh.indices.empty()) {
+		header.index_size = mesh_index_size(mesh);
+		mesh_pack_indices(mesh, &indices, &lods);
+		header.index_count = indices.size() / header.index_size;
+		blobs.push_back(
+		    {MESH_SECTION_INDICES, indices.data(), indices.size()});
+		blobs.push_back({MESH_SECTION_LODS, lods.data(),
+				 lods.size() * sizeof(MeshLodRange)});
+	}
+	if (!mesh.meshlets.empty()) {
+		blobs.push_back({MESH_SECTION_MESHLETS, mesh.meshlets.data(),
+				 mesh.meshlets.size() * sizeof(Meshlet)});
+	}
+	if (!mesh.bvh.empty()) {
+		blobs.push_back({MESH_SECTION_BVH_NODES, mesh.bvh.data(),
+				 mesh.bvh.size() * sizeof(MeshBvhNode)});
+		blobs.push_back({MESH_SECTION_BVH_TRIANGLES,
+				 mesh.bvh_triangles.data(),
+				 mesh.bvh_triangles.size() * sizeof(uint32_t)});
+	}
+	header.section_count = blobs.size();
+
+	std::vector<MeshFileSection> sections(blobs.size());
+	uint64_t offset = align_up(sizeof(header) +
+				   sections.size() * sizeof(MeshFileSection));
+	for (size_t i = 0; i < blobs.size(); i++) {
+		sections[i] = {blobs[i].kind, 0, offset, blobs[i].size};
+		offset = align_up(offset + blobs[i].size);
+	}
+
+	// Write next to the destination and rename, so a reader never mmaps
+	// a half written file.
+	std::string tmp_path = std::string(path) + ".tmp";
+	FILE *f = fopen(tmp_path.c_str(), "wb");
+	if (f == NULL) {
+		fprintf(stderr, "failed to open %s for writing\n",
+			tmp_path.c_str());
+		return false;
+	}
+	static const char padding[MESH_FILE_ALIGNMENT] = {};
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	ok = ok && fwrite(sections.data(), sizeof(MeshFileSection),
+			  sections.size(), f) == sections.size();
+	uint64_t written =
+	    sizeof(header) + sections.size() * sizeof(MeshFileSection);
+	for (size_t i = 0; ok && i < blobs.size(); i++) {
+		size_t pad = sections[i].offset - written;
+		ok = fwrite(padding, 1, pad, f) == pad;
+		ok = ok && fwrite(blobs[i].data, 1, blobs[i].size, f) ==
+			       blobs[i].size;
+		written = sections[i].offset + blobs[i].size;
+	}
+	ok = (fclose(f) == 0) && ok;
+	if (!ok || rename(tmp_path.c_str(), path) != 0) {
+		fprintf(stderr, "failed to write %s\n", path);
+		unlink(tmp_path.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,122 @@
+#ifndef _MESH_FILE_HPP
+#define _MESH_FILE_HPP
+
+#include "mesh.hpp"
+#include "mesh_quantize.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Baked mesh container (.mesh). Little-endian, laid out so that the file can
+// be mmap'd and its blobs handed straight to glBufferData:
+//
+//	MeshFileHeader
+//	MeshFileSection[section_count]
+//	blobs, each starting on a MESH_FILE_ALIGNMENT boundary
+//
+// Bump MESH_FILE_VERSION whenever the meaning of a section changes; readers
+// reject other versions and the asset has to be re-baked.
+#define MESH_FILE_MAGIC "CUBEMESH"
+#define MESH_FILE_VERSION 5
+#define MESH_FILE_ALIGNMENT 64
+
+enum MeshSectionKind : uint32_t {
+	MESH_SECTION_VERTICES = 1,
+	MESH_SECTION_INDICES = 2,
+	MESH_SECTION_LODS = 3, // MeshLodRange[], LOD0 first
+	MESH_SECTION_MESHLETS = 4, // Meshlet[] over LOD0
+	MESH_SECTION_BVH_NODES = 5, // MeshBvhNode[] over LOD0, root first
+	MESH_SECTION_BVH_TRIANGLES = 6, // uint32_t[] triangles of the leaves
+};
+
+struct MeshFileSection {
+	uint32_t kind;
+	uint32_t reserved;
+	uint64_t offset; // from the start of the file
+	uint64_t size;	 // bytes
+};
+
+struct MeshFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t section_count;
+	uint32_t vertex_count;
+	uint32_t index_count; // all LODs
+	uint32_t index_size; // 0 for triangle lists, otherwise 2 or 4
+	uint32_t vertex_format; // MeshVertexFormat
+	float aabb_min[3]; // dequantization range of quantized positions
+	float aabb_max[3];
+	MeshLayout layout;
+};
+
+static_assert(sizeof(MeshFileSection) == 24, "MeshFileSection layout");
+static_assert(sizeof(MeshFileHeader) == 144, "MeshFileHeader layout");
+static_assert(sizeof(MeshLodRange) == 16, "MeshLodRange layout");
+static_assert(sizeof(Meshlet) == 40, "Meshlet layout");
+static_assert(sizeof(MeshBvhNode) == 128, "MeshBvhNode layout");
+
+class MeshFile {
+      private:
+	int fd;
+	void *map;
+	size_t map_size;
+
+      public:
+	const MeshFileHeader *header;
+
+	MeshFile();
+	~MeshFile();
+
+	bool open(const char *path);
+
+	void close();
+
+	// Returns NULL when the file has no section of that kind.
+	const void *section(uint32_t kind, uint64_t *size) const;
+
+	const void *vertices(uint64_t *size) const {
+		return section(MESH_SECTION_VERTICES, size);
+	}
+
+	const void *indices(uint64_t *size) const {
+		return section(MESH_SECTION_INDICES, size);
+	}
+
+	const MeshLodRange *lods(uint32_t *count) const {
+		uint64_t size = 0;
+		const void *data = section(MESH_SECTION_LODS, &size);
+		*count = size / sizeof(MeshLodRange);
+		return (const MeshLodRange *)data;
+	}
+
+	const Meshlet *meshlets(uint32_t *count) const {
+		uint64_t size = 0;
+		const void *data = section(MESH_SECTION_MESHLETS, &size);
+		*count = size / sizeof(Meshlet);
+		return (const Meshlet *)data;
+	}
+
+	const MeshBvhNode *bvh(uint32_t *count) const {
+		uint64_t size = 0;
+		const void *data = section(MESH_SECTION_BVH_NODES, &size);
+		*count = size / sizeof(MeshBvhNode);
+		return (const MeshBvhNode *)data;
+	}
+
+	const uint32_t *bvhTriangles(uint32_t *count) const {
+		uint64_t size = 0;
+		const void *data = section(MESH_SECTION_BVH_TRIANGLES, &size);
+		*count = size / sizeof(uint32_t);
+		return (const uint32_t *)data;
+	}
+};
+
+// Reads the LOD0 triangles of file and their BVH into mesh, with decoded
+// vertices, for ray queries on the CPU. False when the file has no BVH or
+// it does not fit the triangles.
+bool mesh_file_read_bvh(const MeshFile &file, Mesh *mesh);
+
+// error may be NULL.
+bool mesh_file_write(const char *path, const Mesh &mesh,
+		     MeshVertexFormat format, MeshQuantizeError *error);
+
+#endif
@@ -0,0 +1,220 @@
+#include "mesh_meshlet.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+static inline const float *position(const Mesh &mesh, uint32_t v) {
+	return &mesh.vertices[(size_t)v * MESH_FLOATS_PER_VERTEX];
+}
+
+// Unit face normals, zero for degenerate triangles; triangle t at 3 * t.
+static std::vector<float> face_normals(const Mesh &mesh) {
+	const std::vector<uint32_t> &indices = mesh.indices;
+	std::vector<float> normals(indices.size());
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		const float *a = position(mesh, indices[i]);
+		const float *b = position(mesh, indices[i + 1]);
+		const float *c = position(mesh, indices[i + 2]);
+		float e1[3], e2[3];
+		for (int k = 0; k < 3; k++) {
+			e1[k] = b[k] - a[k];
+			e2[k] = c[k] - a[k];
+		}
+		float *n = &normals[i];
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+		float length =
+		    std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (int k = 0; k < 3; k++) {
+			n[k] = length > 0.0f ? n[k] / length : 0.0f;
+		}
+	}
+	return normals;
+}
+
+static void compute_bounds(const Mesh &mesh, const std::vector<float> &normals,
+			   Meshlet *meshlet) {
+	const uint32_t *indices = &mesh.indices[meshlet->index_offset];
+	float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+	float hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	float axis[3] = {0.0f, 0.0f, 0.0f};
+	for (uint32_t i = 0; i < meshlet->index_count; i++) {
+		const float *p = position(mesh, indices[i]);
+		for (int k = 0; k < 3; k++) {
+			lo[k] = std::min(lo[k], p[k]);
+			hi[k] = std::max(hi[k], p[k]);
+		}
+	}
+	for (uint32_t i = 0; i < meshlet->index_count; i += 3) {
+		const float *n = &normals[meshlet->index_offset + i];
+		for (int k = 0; k < 3; k++) {
+			axis[k] += n[k];
+		}
+	}
+
+	// Sphere around the box center; within a few percent of the minimal
+	// sphere for the compact clusters built here.
+	float radius2 = 0.0f;
+	for (int k = 0; k < 3; k++) {
+		meshlet->center[k] = 0.5f * (lo[k] + hi[k]);
+	}
+	for (uint32_t i = 0; i < meshlet->index_count; i++) {
+		const float *p = position(mesh, indices[i]);
+		float d2 = 0.0f;
+		for (int k = 0; k < 3; k++) {
+			d2 += (p[k] - meshlet->center[k]) *
+			      (p[k] - meshlet->center[k]);
+		}
+		radius2 = std::max(radius2, d2);
+	}
+	meshlet->radius = std::sqrt(radius2);
+
+	float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] +
+				 axis[2] * axis[2]);
+	float min_dot = 1.0f;
+	for (int k = 0; k < 3; k++) {
+		axis[k] = length > 0.0f ? axis[k] / length : 0.0f;
+		meshlet->cone_axis[k] = axis[k];
+	}
+	for (uint32_t i = 0; i < meshlet->index_count; i += 3) {
+		const float *n = &normals[meshlet->index_offset + i];
+		if (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f) {
+			continue;
+		}
+		float dot = n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2];
+		min_dot = std::min(min_dot, dot);
+	}
+	// Every normal lies within acos(min_dot) of the axis. The meshlet
+	// faces away from any eye whose direction to it is more than
+	// asin(min_dot) off the axis, see meshlet_cull.
+	meshlet->cone_cutoff = 1.0f;
+	if (length > 0.0f && min_dot > MESH_MESHLET_MIN_CONE_DOT) {
+		meshlet->cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+	}
+}
+
+void mesh_build_meshlets(Mesh *mesh, uint32_t max_vertices,
+			 uint32_t max_triangles) {
+	mesh->meshlets.clear();
+	const std::vector<uint32_t> &indices = mesh->indices;
+	uint32_t vertex_count = mesh->vertexCount();
+	uint32_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0) {
+		return;
+	}
+	std::vector<float> normals = face_normals(*mesh);
+
+	// Triangles using each vertex, in CSR form.
+	std::vector<uint32_t> offsets(vertex_count + 1, 0);
+	for (uint32_t v : indices) {
+		offsets[v + 1]++;
+	}
+	for (uint32_t v = 0; v < vertex_count; v++) {
+		offsets[v + 1] += offsets[v];
+	}
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++) {
+		adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	// in_meshlet[v] == stamp while v is part of the meshlet being built.
+	std::vector<uint32_t> in_meshlet(vertex_count, 0);
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<uint32_t> triangles;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	uint32_t cursor = 0;
+
+	for (uint32_t stamp = 1;; stamp++) {
+		while (cursor < triangle_count && emitted[cursor]) {
+			cursor++;
+		}
+		if (cursor == triangle_count) {
+			break;
+		}
+		triangles.clear();
+		candidates.clear();
+		uint32_t used = 0;
+		float facing[3] = {0.0f, 0.0f, 0.0f};
+
+		uint32_t next = cursor;
+		while (true) {
+			const uint32_t *t = &indices[3 * next];
+			emitted[next] = true;
+			triangles.push_back(next);
+			for (int k = 0; k < 3; k++) {
+				facing[k] += normals[3 * next + k];
+				if (in_meshlet[t[k]] == stamp) {
+					continue;
+				}
+				in_meshlet[t[k]] = stamp;
+				used++;
+				for (uint32_t a = offsets[t[k]];
+				     a < offsets[t[k] + 1]; a++) {
+					if (!emitted[adjacency[a]]) {
+						candidates.push_back(
+						    adjacency[a]);
+					}
+				}
+			}
+			if (triangles.size() == max_triangles) {
+				break;
+			}
+
+			// Fewest new vertices first, then the closest facing.
+			int64_t best = -1;
+			uint32_t best_new = 4;
+			float best_dot = -FLT_MAX;
+			size_t live = 0;
+			for (uint32_t c : candidates) {
+				if (emitted[c]) {
+					continue;
+				}
+				candidates[live++] = c;
+				const uint32_t *ct = &indices[3 * c];
+				uint32_t fresh = 0;
+				for (int k = 0; k < 3; k++) {
+					fresh += in_meshlet[ct[k]] != stamp;
+				}
+				if (used + fresh > max_vertices) {
+					continue;
+				}
+				const float *n = &normals[3 * c];
+				float dot = n[0] * facing[0] +
+					    n[1] * facing[1] + n[2] * facing[2];
+				if (fresh < best_new ||
+				    (fresh == best_new && dot > best_dot)) {
+					best = c;
+					best_new = fresh;
+					best_dot = dot;
+				}
+			}
+			candidates.resize(live);
+			if (best < 0) {
+				break;
+			}
+			next = best;
+		}
+
+		// Keep the input order inside the meshlet.
+		std::sort(triangles.begin(), triangles.end());
+		Meshlet meshlet = {};
+		meshlet.index_offset = output.size();
+		meshlet.index_count = 3 * triangles.size();
+		for (uint32_t t : triangles) {
+			output.insert(output.end(), indices.begin() + 3 * t,
+				      indices.begin() + 3 * t + 3);
+		}
+		mesh->meshlets.push_back(meshlet);
+	}
+
+	mesh->indices.swap(output);
+	normals = face_normals(*mesh);
+	for (Meshlet &meshlet : mesh->meshlets) {
+		compute_bounds(*mesh, normals, &meshlet);
+	}
+}
@@ -0,0 +1,23 @@
+#ifndef _MESH_MESHLET_HPP
+#define _MESH_MESHLET_HPP
+
+#include "mesh.hpp"
+#include <cstdint>
+
+// Meshlet limits, the usual sizes for mesh shader hardware; small enough
+// that the bounds stay tight, large enough to keep the draw count down.
+#define MESH_MESHLET_MAX_VERTICES 64
+#define MESH_MESHLET_MAX_TRIANGLES 124
+
+// Cone spread beyond which a meshlet is never cone culled: the cosine of the
+// largest angle between a triangle normal and the cone axis.
+#define MESH_MESHLET_MIN_CONE_DOT 0.1f
+
+// Partitions mesh->indices into mesh->meshlets. Meshlets grow greedily over
+// shared vertices, preferring triangles facing the same way so that the
+// normal cones stay narrow. Run it before the mesh_optimize passes, which
+// then reorder within and between meshlets.
+void mesh_build_meshlets(Mesh *mesh, uint32_t max_vertices,
+			 uint32_t max_triangles);
+
+#endif
@@ -0,0 +1,412 @@
+#include "mesh_optimize.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// FIFO post-transform cache. A vertex is resident while fewer than
+// cache_size misses happened since it was loaded.
+struct FifoCache {
+	std::vector<uint32_t> loaded; // miss counter when loaded, 0 = never
+	uint32_t misses;
+	uint32_t size;
+
+	FifoCache(uint32_t vertex_count, uint32_t cache_size)
+	    : loaded(vertex_count, 0), misses(0), size(cache_size) {}
+
+	void reset() {
+		// Push every vertex out without touching the whole array.
+		this->misses += this->size;
+	}
+
+	// Returns the number of misses (0 or 1).
+	uint32_t access(uint32_t v) {
+		if (this->loaded[v] != 0 &&
+		    this->misses - this->loaded[v] < this->size) {
+			return 0;
+		}
+		this->misses++;
+		this->loaded[v] = this->misses;
+		return 1;
+	}
+};
+
+MeshCacheStats mesh_analyze_vertex_cache(const Mesh &mesh,
+					 uint32_t cache_size) {
+	MeshCacheStats stats = {0.0f, 0.0f};
+	if (mesh.indices.empty()) {
+		return stats;
+	}
+	FifoCache cache(mesh.vertexCount(), cache_size);
+	uint32_t misses = 0;
+	for (uint32_t v : mesh.indices) {
+		misses += cache.access(v);
+	}
+	stats.acmr = (float)misses / mesh.triangleCount();
+	stats.atvr = (float)misses / mesh.vertexCount();
+	return stats;
+}
+
+// Triangles using each vertex, in CSR form.
+struct Adjacency {
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> triangles;
+
+	Adjacency(const std::vector<uint32_t> &indices, uint32_t vertex_count) {
+		offsets.assign(vertex_count + 1, 0);
+		for (uint32_t v : indices) {
+			offsets[v + 1]++;
+		}
+		for (uint32_t v = 0; v < vertex_count; v++) {
+			offsets[v + 1] += offsets[v];
+		}
+		triangles.resize(indices.size());
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++) {
+			triangles[fill[indices[i]]++] = i / 3;
+		}
+	}
+};
+
+// The passes below optimize the full mesh and every LOD the same way.
+static std::vector<std::vector<uint32_t> *> index_levels(Mesh *mesh) {
+	std::vector<std::vector<uint32_t> *> levels;
+	levels.push_back(&mesh->indices);
+	for (MeshLod &lod : mesh->lods) {
+		levels.push_back(&lod.indices);
+	}
+	return levels;
+}
+
+static void optimize_vertex_cache(std::vector<uint32_t> *index_buffer,
+				  uint32_t vertex_count, uint32_t cache_size) {
+	const std::vector<uint32_t> &indices = *index_buffer;
+	uint32_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0) {
+		return;
+	}
+	Adjacency adjacency(indices, vertex_count);
+
+	std::vector<uint32_t> live(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; v++) {
+		live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+	}
+	std::vector<uint32_t> cache_time(vertex_count, 0);
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<uint32_t> dead_end;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	uint32_t time = cache_size + 1;
+	uint32_t cursor = 0;
+	int64_t fanning = indices[0];
+	while (fanning >= 0) {
+		// Emit every remaining triangle around the fanning vertex.
+		candidates.clear();
+		for (uint32_t a = adjacency.offsets[fanning];
+		     a < adjacency.offsets[fanning + 1]; a++) {
+			uint32_t t = adjacency.triangles[a];
+			if (emitted[t]) {
+				continue;
+			}
+			for (int k = 0; k < 3; k++) {
+				uint32_t v = indices[3 * t + k];
+				output.push_back(v);
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cache_time[v] > cache_size) {
+					cache_time[v] = time++;
+				}
+			}
+			emitted[t] = true;
+		}
+
+		// Next fanning vertex: the candidate that stays in the cache
+		// longest while its remaining triangles are emitted.
+		fanning = -1;
+		int64_t best = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) {
+				continue;
+			}
+			int64_t priority = 0;
+			if (time - cache_time[v] + 2 * live[v] <= cache_size) {
+				priority = time - cache_time[v];
+			}
+			if (priority > best) {
+				best = priority;
+				fanning = v;
+			}
+		}
+		if (fanning >= 0) {
+			continue;
+		}
+		// Dead end: back up through recently used vertices, then
+		// continue with the next vertex in input order.
+		while (!dead_end.empty() && fanning < 0) {
+			uint32_t v = dead_end.back();
+			dead_end.pop_back();
+			if (live[v] > 0) {
+				fanning = v;
+			}
+		}
+		while (fanning < 0 && cursor < vertex_count) {
+			if (live[cursor] > 0) {
+				fanning = cursor;
+			}
+			cursor++;
+		}
+	}
+	index_buffer->swap(output);
+}
+
+// Optimizes each meshlet's range on its own, renumbered to local vertex ids
+// so the per call state stays meshlet sized.
+static void optimize_meshlets_vertex_cache(Mesh *mesh, uint32_t cache_size) {
+	std::vector<uint32_t> local(mesh->vertexCount(), ~0u);
+	std::vector<uint32_t> global;
+	std::vector<uint32_t> range;
+	for (const Meshlet &meshlet : mesh->meshlets) {
+		uint32_t *indices = &mesh->indices[meshlet.index_offset];
+		global.clear();
+		range.resize(meshlet.index_count);
+		for (uint32_t i = 0; i < meshlet.index_count; i++) {
+			if (local[indices[i]] == ~0u) {
+				local[indices[i]] = global.size();
+				global.push_back(indices[i]);
+			}
+			range[i] = local[indices[i]];
+		}
+		optimize_vertex_cache(&range, global.size(), cache_size);
+		for (uint32_t i = 0; i < meshlet.index_count; i++) {
+			indices[i] = global[range[i]];
+		}
+		for (uint32_t v : global) {
+			local[v] = ~0u;
+		}
+	}
+}
+
+void mesh_optimize_vertex_cache(Mesh *mesh, uint32_t cache_size) {
+	std::vector<std::vector<uint32_t> *> levels = index_levels(mesh);
+	for (size_t l = 0; l < levels.size(); l++) {
+		if (l == 0 && !mesh->meshlets.empty()) {
+			optimize_meshlets_vertex_cache(mesh, cache_size);
+		} else {
+			optimize_vertex_cache(levels[l], mesh->vertexCount(),
+					      cache_size);
+		}
+	}
+}
+
+struct Cluster {
+	uint32_t start; // first triangle
+	uint32_t end;
+	float sort_key;
+};
+
+// Splits [start, end) at points where a fresh cache costs little: the
+// sub-cluster's ACMR must not exceed threshold times the ACMR the whole range
+// gets in one go.
+static void split_cluster(const std::vector<uint32_t> &indices,
+			  FifoCache *cache, uint32_t start, uint32_t end,
+			  float threshold, std::vector<Cluster> *clusters) {
+	cache->reset();
+	uint32_t misses = 0;
+	for (uint32_t i = 3 * start; i < 3 * end; i++) {
+		misses += cache->access(indices[i]);
+	}
+	float limit = threshold * misses / (end - start);
+
+	cache->reset();
+	uint32_t cluster_start = start;
+	misses = 0;
+	for (uint32_t t = start; t < end; t++) {
+		for (int k = 0; k < 3; k++) {
+			misses += cache->access(indices[3 * t + k]);
+		}
+		float acmr = (float)misses / (t + 1 - cluster_start);
+		if (t + 1 == end || acmr <= limit) {
+			clusters->push_back({cluster_start, t + 1, 0.0f});
+			cluster_start = t + 1;
+			misses = 0;
+			cache->reset();
+		}
+	}
+}
+
+// Sorts clusters by area weighted dot(centroid - mesh centroid, average
+// normal), outward facing first.
+static void sort_clusters(const Mesh &mesh,
+			  const std::vector<uint32_t> &indices,
+			  std::vector<Cluster> *clusters) {
+	const std::vector<float> &vertices = mesh.vertices;
+	uint32_t triangle_count = indices.size() / 3;
+	std::vector<float> area(triangle_count);
+	std::vector<float> centroid(3 * triangle_count);
+	std::vector<float> normal(3 * triangle_count);
+	float mesh_centroid[3] = {0.0f, 0.0f, 0.0f};
+	float mesh_area = 0.0f;
+	for (uint32_t t = 0; t < triangle_count; t++) {
+		const float *a =
+		    &vertices[indices[3 * t] * MESH_FLOATS_PER_VERTEX];
+		const float *b =
+		    &vertices[indices[3 * t + 1] * MESH_FLOATS_PER_VERTEX];
+		const float *c =
+		    &vertices[indices[3 * t + 2] * MESH_FLOATS_PER_VERTEX];
+		float e1[3], e2[3];
+		for (int k = 0; k < 3; k++) {
+			e1[k] = b[k] - a[k];
+			e2[k] = c[k] - a[k];
+			centroid[3 * t + k] = (a[k] + b[k] + c[k]) / 3.0f;
+		}
+		float *n = &normal[3 * t];
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+		area[t] = 0.5f * std::sqrt(n[0] * n[0] + n[1] * n[1] +
+					   n[2] * n[2]);
+		for (int k = 0; k < 3; k++) {
+			mesh_centroid[k] += centroid[3 * t + k] * area[t];
+		}
+		mesh_area += area[t];
+	}
+	for (int k = 0; k < 3; k++) {
+		mesh_centroid[k] /= mesh_area > 0.0f ? mesh_area : 1.0f;
+	}
+
+	for (Cluster &cluster : *clusters) {
+		float c[3] = {0.0f, 0.0f, 0.0f};
+		float n[3] = {0.0f, 0.0f, 0.0f};
+		float cluster_area = 0.0f;
+		for (uint32_t t = cluster.start; t < cluster.end; t++) {
+			for (int k = 0; k < 3; k++) {
+				c[k] += centroid[3 * t + k] * area[t];
+				n[k] += normal[3 * t + k];
+			}
+			cluster_area += area[t];
+		}
+		float n_length = std::sqrt(n[0] * n[0] + n[1] * n[1] +
+					   n[2] * n[2]);
+		if (cluster_area <= 0.0f || n_length <= 0.0f) {
+			continue;
+		}
+		for (int k = 0; k < 3; k++) {
+			cluster.sort_key += (c[k] / cluster_area -
+					     mesh_centroid[k]) *
+					    n[k] / n_length;
+		}
+	}
+	std::stable_sort(clusters->begin(), clusters->end(),
+			 [](const Cluster &a, const Cluster &b) {
+				 return a.sort_key > b.sort_key;
+			 });
+}
+
+static void optimize_overdraw(const Mesh &mesh,
+			      std::vector<uint32_t> *index_buffer,
+			      uint32_t cache_size, float threshold) {
+	const std::vector<uint32_t> &indices = *index_buffer;
+	uint32_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0) {
+		return;
+	}
+
+	// Hard boundaries: triangles whose vertices all miss the cache start
+	// a new cluster, reordering there costs nothing.
+	FifoCache cache(mesh.vertexCount(), cache_size);
+	std::vector<uint32_t> hard;
+	for (uint32_t t = 0; t < triangle_count; t++) {
+		uint32_t misses = 0;
+		for (int k = 0; k < 3; k++) {
+			misses += cache.access(indices[3 * t + k]);
+		}
+		if (t == 0 || misses == 3) {
+			hard.push_back(t);
+		}
+	}
+	hard.push_back(triangle_count);
+
+	std::vector<Cluster> clusters;
+	for (size_t i = 0; i + 1 < hard.size(); i++) {
+		split_cluster(indices, &cache, hard[i], hard[i + 1], threshold,
+			      &clusters);
+	}
+
+	sort_clusters(mesh, indices, &clusters);
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (const Cluster &cluster : clusters) {
+		output.insert(output.end(), indices.begin() + 3 * cluster.start,
+			      indices.begin() + 3 * cluster.end);
+	}
+	index_buffer->swap(output);
+}
+
+// Meshlets are the clusters; they move as a whole so they stay intact.
+static void optimize_meshlets_overdraw(Mesh *mesh) {
+	std::vector<Cluster> clusters;
+	for (const Meshlet &meshlet : mesh->meshlets) {
+		uint32_t start = meshlet.index_offset / 3;
+		clusters.push_back(
+		    {start, start + meshlet.index_count / 3, 0.0f});
+	}
+	sort_clusters(*mesh, mesh->indices, &clusters);
+
+	std::vector<uint32_t> output;
+	output.reserve(mesh->indices.size());
+	std::vector<Meshlet> meshlets;
+	meshlets.reserve(mesh->meshlets.size());
+	for (const Cluster &cluster : clusters) {
+		// Meshlets are sorted by offset, find it back by its start.
+		Meshlet meshlet = *std::lower_bound(
+		    mesh->meshlets.begin(), mesh->meshlets.end(),
+		    3 * cluster.start, [](const Meshlet &m, uint32_t offset) {
+			    return m.index_offset < offset;
+		    });
+		meshlet.index_offset = output.size();
+		output.insert(output.end(),
+			      mesh->indices.begin() + 3 * cluster.start,
+			      mesh->indices.begin() + 3 * cluster.end);
+		meshlets.push_back(meshlet);
+	}
+	mesh->indices.swap(output);
+	mesh->meshlets.swap(meshlets);
+}
+
+void mesh_optimize_overdraw(Mesh *mesh, uint32_t cache_size,
+			    float threshold) {
+	std::vector<std::vector<uint32_t> *> levels = index_levels(mesh);
+	for (size_t l = 0; l < levels.size(); l++) {
+		if (l == 0 && !mesh->meshlets.empty()) {
+			optimize_meshlets_overdraw(mesh);
+		} else {
+			optimize_overdraw(*mesh, levels[l], cache_size,
+					  threshold);
+		}
+	}
+}
+
+void mesh_optimize_vertex_fetch(Mesh *mesh) {
+	uint32_t vertex_count = mesh->vertexCount();
+	std::vector<uint32_t> remap(vertex_count, ~0u);
+	std::vector<float> vertices;
+	vertices.reserve(mesh->vertices.size());
+	uint32_t next = 0;
+	for (std::vector<uint32_t> *indices : index_levels(mesh)) {
+		for (uint32_t &v : *indices) {
+			if (remap[v] == ~0u) {
+				remap[v] = next++;
+				const float *src =
+				    &mesh->vertices[(size_t)v *
+						    MESH_FLOATS_PER_VERTEX];
+				vertices.insert(vertices.end(), src,
+						src + MESH_FLOATS_PER_VERTEX);
+			}
+			v = remap[v];
+		}
+	}
+	mesh->vertices.swap(vertices);
+}
@@ -0,0 +1,43 @@
+#ifndef _MESH_OPTIMIZE_HPP
+#define _MESH_OPTIMIZE_HPP
+
+#include "mesh.hpp"
+#include <cstdint>
+
+// Post-transform cache size the passes optimize for and the statistics
+// simulate; a conservative guess that suits desktop GPUs and llvmpipe.
+#define MESH_VERTEX_CACHE_SIZE 16
+
+// Largest ACMR increase, as a factor, the overdraw pass may trade for a
+// better cluster order.
+#define MESH_OVERDRAW_THRESHOLD 1.05f
+
+struct MeshCacheStats {
+	float acmr; // vertex shader invocations per triangle, 0.5 .. 3
+	float atvr; // vertex shader invocations per vertex, 1 is ideal
+};
+
+// All passes work on indexed meshes, run mesh_weld first. They apply to the
+// full mesh and to each of its LODs. Meshlets stay intact: the vertex cache
+// pass works inside each of them and the overdraw pass moves them as whole
+// clusters.
+
+// Reorders triangles for the post-transform vertex cache (Sander et al.,
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw",
+// Tipsify).
+void mesh_optimize_vertex_cache(Mesh *mesh, uint32_t cache_size);
+
+// Cuts the triangle order into clusters at vertex cache restarts, splits
+// them further while the ACMR stays within threshold and sorts the clusters
+// so that outward facing ones, which likely occlude the rest, come first.
+void mesh_optimize_overdraw(Mesh *mesh, uint32_t cache_size,
+			    float threshold);
+
+// Renumbers vertices in the order the index buffer first uses them so that
+// vertex fetch walks the vertex buffer linearly. Drops unused vertices.
+void mesh_optimize_vertex_fetch(Mesh *mesh);
+
+MeshCacheStats mesh_analyze_vertex_cache(const Mesh &mesh,
+					 uint32_t cache_size);
+
+#endif
@@ -0,0 +1,218 @@
+#include "mesh_pool.hpp"
+#include "gl_state.hpp"
+#include "instance_batch.hpp"
+#include <GL/glew.h>
+#include <cstdio>
+
+// Moves the first used bytes of buffer into a new buffer of size bytes and
+// deletes buffer, which may be 0.
+static unsigned int grow_buffer(unsigned int buffer, size_t used,
+				size_t size) {
+	unsigned int grown;
+	glGenBuffers(1, &grown);
+	gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+	if (buffer != 0) {
+		if (used > 0) {
+			gl_state_bind_buffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER,
+					    GL_COPY_WRITE_BUFFER, 0, 0, used);
+		}
+		glDeleteBuffers(1, &buffer);
+		gl_state_forget(buffer);
+	}
+	return grown;
+}
+
+MeshPool::MeshPool(const MeshLayout &layout) {
+	this->layout = layout;
+	this->VAO = 0;
+	this->VBO = 0;
+	this->EBO = 0;
+	glGenBuffers(1, &this->instance_buffer);
+	glGenBuffers(1, &this->command_buffer);
+	this->vertex_count = this->vertex_capacity = 0;
+	this->index_count = this->index_capacity = 0;
+	this->stats = {};
+}
+
+MeshPool::~MeshPool() {
+	unsigned int buffers[] = {this->VBO, this->EBO, this->instance_buffer,
+				  this->command_buffer};
+	for (unsigned int buffer : buffers) {
+		if (buffer != 0) {
+			glDeleteBuffers(1, &buffer);
+			gl_state_forget(buffer);
+		}
+	}
+	if (this->VAO != 0) {
+		glDeleteVertexArrays(1, &this->VAO);
+		gl_state_forget(this->VAO);
+	}
+}
+
+void MeshPool::grow(uint32_t vertex_count, uint32_t index_count) {
+	// Doubling keeps the copies linear in the pooled size.
+	if (vertex_count > this->vertex_capacity) {
+		uint32_t capacity = 2 * this->vertex_capacity;
+		capacity = capacity > vertex_count ? capacity : vertex_count;
+		this->VBO = grow_buffer(
+		    this->VBO, (size_t)this->vertex_count * this->layout.stride,
+		    (size_t)capacity * this->layout.stride);
+		this->vertex_capacity = capacity;
+	}
+	if (index_count > this->index_capacity) {
+		uint32_t capacity = 2 * this->index_capacity;
+		capacity = capacity > index_count ? capacity : index_count;
+		this->EBO = grow_buffer(this->EBO,
+					(size_t)this->index_count *
+					    sizeof(uint32_t),
+					(size_t)capacity * sizeof(uint32_t));
+		this->index_capacity = capacity;
+	}
+	if (this->VAO != 0) {
+		glDeleteVertexArrays(1, &this->VAO);
+		gl_state_forget(this->VAO);
+	}
+	GpuVertexStream streams[] = {
+	    {this->VBO, this->layout, 0},
+	    {this->instance_buffer, VERTEX_LAYOUT_INSTANCE, 1},
+	};
+	this->VAO = gpu_vertex_array_create(streams, 2, this->EBO);
+}
+
+bool MeshPool::add(const GpuMesh &gpu, uint32_t *mesh) {
+	if (!vertex_layouts_equal(gpu.layout, this->layout)) {
+		fprintf(stderr, "mesh pool: mesh has another vertex layout\n");
+		return false;
+	}
+	std::vector<uint32_t> indices;
+	if (gpu.EBO != 0) {
+		indices.resize(gpu.index_count);
+		gl_state_bind_buffer(GL_COPY_READ_BUFFER, gpu.EBO);
+		if (gpu.index_size == 2) {
+			std::vector<uint16_t> shorts(gpu.index_count);
+			glGetBufferSubData(GL_COPY_READ_BUFFER, 0,
+					   shorts.size() * sizeof(uint16_t),
+					   shorts.data());
+			indices.assign(shorts.begin(), shorts.end());
+		} else {
+			glGetBufferSubData(GL_COPY_READ_BUFFER, 0,
+					   indices.size() * sizeof(uint32_t),
+					   indices.data());
+		}
+	} else {
+		indices.resize(gpu.vertex_count);
+		for (uint32_t i = 0; i < gpu.vertex_count; i++) {
+			indices[i] = i;
+		}
+	}
+
+	uint32_t vertex_end = this->vertex_count + gpu.vertex_count;
+	uint32_t index_end = this->index_count + indices.size();
+	if (vertex_end > this->vertex_capacity ||
+	    index_end > this->index_capacity) {
+		this->grow(vertex_end, index_end);
+	}
+	size_t stride = this->layout.stride;
+	gl_state_bind_buffer(GL_COPY_READ_BUFFER, gpu.VBO);
+	gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, this->VBO);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+			    (size_t)this->vertex_count * stride,
+			    (size_t)gpu.vertex_count * stride);
+	gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, this->EBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER,
+			(size_t)this->index_count * sizeof(uint32_t),
+			indices.size() * sizeof(uint32_t), indices.data());
+
+	PoolMesh pooled;
+	pooled.first_index = this->index_count;
+	pooled.base_vertex = this->vertex_count;
+	pooled.lods = gpu.lods;
+	if (pooled.lods.empty()) {
+		pooled.lods.push_back({0, (uint32_t)indices.size(), 0.0f, 0});
+	}
+	pooled.dequantize = gpu.dequantize;
+	*mesh = this->meshes.size();
+	this->meshes.push_back(pooled);
+	this->vertex_count = vertex_end;
+	this->index_count = index_end;
+	this->stats.meshes = this->meshes.size();
+	this->stats.bytes = (size_t)vertex_end * stride +
+			    (size_t)index_end * sizeof(uint32_t);
+	return true;
+}
+
+const PoolMesh &MeshPool::mesh(uint32_t mesh) const {
+	return this->meshes[mesh];
+}
+
+void MeshPool::addDraw(uint32_t mesh, uint32_t lod, const glm::mat4 &model,
+		       uint32_t material) {
+	const PoolMesh &pooled = this->meshes[mesh];
+	if (lod >= pooled.lods.size()) {
+		lod = pooled.lods.size() - 1;
+	}
+	const MeshLodRange &range = pooled.lods[lod];
+	Command command = {range.index_count, 1,
+			   pooled.first_index + range.index_offset,
+			   (int32_t)pooled.base_vertex,
+			   (uint32_t)this->instances.size()};
+	this->commands.push_back(command);
+	this->instances.push_back(instance_data(model, material));
+}
+
+uint32_t MeshPool::addMeshlets(uint32_t mesh, const GpuMesh &source,
+			       const uint32_t *visible, uint32_t count,
+			       const glm::mat4 &model, uint32_t material) {
+	if (count == 0) {
+		return 0;
+	}
+	const PoolMesh &pooled = this->meshes[mesh];
+	uint32_t instance = this->instances.size();
+	this->instances.push_back(instance_data(model, material));
+	size_t first = this->commands.size();
+	uint32_t end = ~0u;
+	for (uint32_t i = 0; i < count; i++) {
+		const Meshlet &m = source.meshlets[visible[i]];
+		if (m.index_offset == end) {
+			this->commands.back().count += m.index_count;
+		} else {
+			Command command = {m.index_count, 1,
+					   pooled.first_index + m.index_offset,
+					   (int32_t)pooled.base_vertex,
+					   instance};
+			this->commands.push_back(command);
+		}
+		end = m.index_offset + m.index_count;
+	}
+	return this->commands.size() - first;
+}
+
+uint32_t MeshPool::draw() {
+	uint32_t count = this->commands.size();
+	if (count == 0) {
+		return 0;
+	}
+	// Both are rewritten every draw, orphaning keeps a draw in flight
+	// on the old storage.
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, this->instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER,
+		     this->instances.size() * sizeof(InstanceData),
+		     this->instances.data(), GL_STREAM_DRAW);
+	gl_state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, this->command_buffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, count * sizeof(Command),
+		     this->commands.data(), GL_STREAM_DRAW);
+	gl_state_bind_vertex_array(this->VAO);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, count,
+				    0);
+	this->commands.clear();
+	this->instances.clear();
+	return count;
+}
+
+bool mesh_pool_supported() {
+	// The base instance of a command needs ARB_base_instance.
+	return GLEW_VERSION_4_3 ||
+	       (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+}
@@ -0,0 +1,91 @@
+#ifndef _MESH_POOL_HPP
+#define _MESH_POOL_HPP
+
+#include "gpu_mesh.hpp"
+#include "vertex_layout.hpp"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Where a mesh lives in a MeshPool's buffers.
+struct PoolMesh {
+	uint32_t first_index;
+	uint32_t base_vertex;
+	// Ranges relative to first_index, as in the GpuMesh it came from.
+	std::vector<MeshLodRange> lods;
+	glm::mat4 dequantize; // of the source GpuMesh
+};
+
+struct MeshPoolStats {
+	uint32_t meshes;
+	size_t bytes; // vertex and index storage in use
+};
+
+// Static meshes of one vertex layout in a shared vertex and index buffer,
+// drawn together by glMultiDrawElementsIndirect. Each command draws a range
+// of one mesh; its base instance selects an InstanceData holding the model
+// matrix and material, so the INSTANCED lit shaders draw it unchanged. Needs
+// GL 4.3 or ARB_multi_draw_indirect, see mesh_pool_supported.
+class MeshPool {
+      private:
+	// Same fields as DrawElementsIndirectCommand.
+	struct Command {
+		uint32_t count;
+		uint32_t instance_count;
+		uint32_t first_index;
+		int32_t base_vertex;
+		uint32_t base_instance;
+	};
+
+	MeshLayout layout;
+	unsigned int VBO;
+	unsigned int EBO; // 32-bit indices
+	unsigned int instance_buffer;
+	unsigned int command_buffer;
+	uint32_t vertex_count;
+	uint32_t vertex_capacity;
+	uint32_t index_count;
+	uint32_t index_capacity;
+	std::vector<PoolMesh> meshes;
+	std::vector<Command> commands;
+	std::vector<InstanceData> instances;
+
+	void grow(uint32_t vertex_count, uint32_t index_count);
+
+      public:
+	// Reads the pooled vertices and the instance stream; replaced when
+	// the pool grows.
+	unsigned int VAO;
+	MeshPoolStats stats;
+
+	MeshPool(const MeshLayout &layout);
+	~MeshPool();
+
+	// Copies gpu's vertices and indices into the pool, a triangle list
+	// gets sequential indices. Fails for another vertex layout. The
+	// buffers of gpu are only read, it may be destroyed afterwards.
+	bool add(const GpuMesh &gpu, uint32_t *mesh);
+
+	const PoolMesh &mesh(uint32_t mesh) const;
+
+	// Records a draw of lod, clamped to the mesh's levels. model maps the
+	// pooled vertices, fold in PoolMesh::dequantize.
+	void addDraw(uint32_t mesh, uint32_t lod, const glm::mat4 &model,
+		     uint32_t material);
+
+	// Records the listed LOD0 meshlets of source, the GpuMesh the mesh
+	// was added from, neighbours merged into one command. Returns the
+	// number of commands.
+	uint32_t addMeshlets(uint32_t mesh, const GpuMesh &source,
+			     const uint32_t *visible, uint32_t count,
+			     const glm::mat4 &model, uint32_t material);
+
+	// Draws the recorded commands with one glMultiDrawElementsIndirect
+	// and clears them. Returns the number of commands.
+	uint32_t draw();
+};
+
+// True when the context can draw a MeshPool.
+bool mesh_pool_supported();
+
+#endif
@@ -0,0 +1,191 @@
+#include "mesh_quantize.hpp"
+#include "vertex_layout.hpp"
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+struct QuantizedVertex {
+	uint16_t position[3];
+	uint16_t padding;
+	int16_t normal[2];
+};
+
+constexpr MeshLayout QUANTIZED_LAYOUT = vertex_layout<QuantizedVertex>({
+    VERTEX_ATTRIBUTE(QuantizedVertex, position, 0, true),
+    VERTEX_ATTRIBUTE(QuantizedVertex, normal, 1, true),
+});
+
+static_assert(sizeof(QuantizedVertex) == 12, "QuantizedVertex layout");
+static_assert(vertex_layout_valid(QUANTIZED_LAYOUT), "QuantizedVertex layout");
+
+MeshLayout mesh_layout(MeshVertexFormat format) {
+	if (format == MESH_VERTEX_FLOAT) {
+		return mesh_layout_float();
+	}
+	return QUANTIZED_LAYOUT;
+}
+
+bool mesh_vertex_format_parse(const char *name, MeshVertexFormat *format) {
+	if (strcmp(name, "float") == 0) {
+		*format = MESH_VERTEX_FLOAT;
+	} else if (strcmp(name, "quantized") == 0) {
+		*format = MESH_VERTEX_QUANTIZED;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+const char *mesh_vertex_format_name(MeshVertexFormat format) {
+	return format == MESH_VERTEX_QUANTIZED ? "quantized" : "float";
+}
+
+static inline float sign_not_zero(float v) {
+	return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+static inline float snorm16_decode(int16_t q) {
+	return std::fmax(q / 32767.0f, -1.0f);
+}
+
+// Same as oct_decode() in vertex_phong.glsl.
+static void oct_decode(const int16_t e[2], float n[3]) {
+	n[0] = snorm16_decode(e[0]);
+	n[1] = snorm16_decode(e[1]);
+	n[2] = 1.0f - std::fabs(n[0]) - std::fabs(n[1]);
+	float t = std::fmax(-n[2], 0.0f);
+	n[0] += n[0] >= 0.0f ? -t : t;
+	n[1] += n[1] >= 0.0f ? -t : t;
+	float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	for (int k = 0; k < 3; k++) {
+		n[k] /= length;
+	}
+}
+
+// atan2 keeps its precision for the tiny angles acos would round away.
+static float angle_degrees(const float a[3], const float b[3]) {
+	double cx = (double)a[1] * b[2] - (double)a[2] * b[1];
+	double cy = (double)a[2] * b[0] - (double)a[0] * b[2];
+	double cz = (double)a[0] * b[1] - (double)a[1] * b[0];
+	double d = (double)a[0] * b[0] + (double)a[1] * b[1] +
+		   (double)a[2] * b[2];
+	return std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), d) *
+	       57.29577951308232;
+}
+
+// Octahedral projection, rounded to whichever of the four surrounding snorm16
+// values decodes closest to n (Cigolle et al., "A Survey of Efficient
+// Representations for Independent Unit Vectors").
+static void oct_encode(const float n[3], int16_t out[2], float *error) {
+	float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+	float u = l1 > 0.0f ? n[0] / l1 : 0.0f;
+	float v = l1 > 0.0f ? n[1] / l1 : 0.0f;
+	if (n[2] < 0.0f) {
+		float pu = u;
+		u = (1.0f - std::fabs(v)) * sign_not_zero(pu);
+		v = (1.0f - std::fabs(pu)) * sign_not_zero(v);
+	}
+	float best = INFINITY;
+	for (int i = 0; i < 4; i++) {
+		int16_t q[2];
+		q[0] = (int16_t)((i & 1 ? std::ceil(u * 32767.0f)
+					: std::floor(u * 32767.0f)));
+		q[1] = (int16_t)((i & 2 ? std::ceil(v * 32767.0f)
+					: std::floor(v * 32767.0f)));
+		float d[3];
+		oct_decode(q, d);
+		float e = angle_degrees(n, d);
+		if (e < best) {
+			best = e;
+			out[0] = q[0];
+			out[1] = q[1];
+		}
+	}
+	*error = best;
+}
+
+void mesh_encode_vertices(const Mesh &mesh, MeshVertexFormat format,
+			  const float aabb_min[3], const float aabb_max[3],
+			  std::vector<uint8_t> *out, MeshQuantizeError *error) {
+	uint32_t vertex_count = mesh.vertexCount();
+	MeshQuantizeError e = {0.0f, 0.0f, 0.0f, 0.0f};
+	if (format == MESH_VERTEX_FLOAT) {
+		out->resize(mesh.vertices.size() * sizeof(float));
+		memcpy(out->data(), mesh.vertices.data(), out->size());
+		if (error != NULL) {
+			*error = e;
+		}
+		return;
+	}
+
+	float extent[3];
+	for (int k = 0; k < 3; k++) {
+		extent[k] = aabb_max[k] - aabb_min[k];
+		extent[k] = extent[k] > 0.0f ? extent[k] : 1.0f;
+	}
+	out->resize(vertex_count * sizeof(QuantizedVertex));
+	QuantizedVertex *dst = (QuantizedVertex *)out->data();
+	double position_sum = 0.0, normal_sum = 0.0;
+	for (uint32_t i = 0; i < vertex_count; i++) {
+		const float *v = &mesh.vertices[i * MESH_FLOATS_PER_VERTEX];
+		float d2 = 0.0f;
+		for (int k = 0; k < 3; k++) {
+			float t = (v[k] - aabb_min[k]) / extent[k];
+			t = std::fmin(std::fmax(t, 0.0f), 1.0f);
+			dst[i].position[k] =
+			    (uint16_t)std::lround(t * 65535.0f);
+			float p = aabb_min[k] +
+				  dst[i].position[k] / 65535.0f * extent[k];
+			d2 += (p - v[k]) * (p - v[k]);
+		}
+		dst[i].padding = 0;
+		float normal_error;
+		oct_encode(v + 3, dst[i].normal, &normal_error);
+
+		e.position_max = std::fmax(e.position_max, std::sqrt(d2));
+		e.normal_max = std::fmax(e.normal_max, normal_error);
+		position_sum += d2;
+		normal_sum += normal_error * normal_error;
+	}
+	if (vertex_count > 0) {
+		e.position_rms = std::sqrt(position_sum / vertex_count);
+		e.normal_rms = std::sqrt(normal_sum / vertex_count);
+	}
+	if (error != NULL) {
+		*error = e;
+	}
+}
+
+void mesh_decode_vertices(const void *data, uint32_t vertex_count,
+			  MeshVertexFormat format, const float aabb_min[3],
+			  const float aabb_max[3], Mesh *mesh) {
+	mesh->vertices.resize((size_t)vertex_count * MESH_FLOATS_PER_VERTEX);
+	if (format == MESH_VERTEX_FLOAT) {
+		memcpy(mesh->vertices.data(), data,
+		       mesh->vertices.size() * sizeof(float));
+		return;
+	}
+	float extent[3];
+	for (int k = 0; k < 3; k++) {
+		extent[k] = aabb_max[k] - aabb_min[k];
+		extent[k] = extent[k] > 0.0f ? extent[k] : 1.0f;
+	}
+	const QuantizedVertex *src = (const QuantizedVertex *)data;
+	for (uint32_t i = 0; i < vertex_count; i++) {
+		float *v = &mesh->vertices[i * MESH_FLOATS_PER_VERTEX];
+		for (int k = 0; k < 3; k++) {
+			v[k] = aabb_min[k] +
+			       src[i].position[k] / 65535.0f * extent[k];
+		}
+		oct_decode(src[i].normal, v + 3);
+	}
+}
+
+void mesh_quantize_error_print(const char *name,
+			       const MeshQuantizeError &error) {
+	printf("%s: quantization error position max %.3g rms %.3g, "
+	       "normal max %.3g rms %.3g degrees\n",
+	       name, error.position_max, error.position_rms, error.normal_max,
+	       error.normal_rms);
+}
@@ -0,0 +1,47 @@
+#ifndef _MESH_QUANTIZE_HPP
+#define _MESH_QUANTIZE_HPP
+
+#include "mesh.hpp"
+#include <cstdint>
+#include <vector>
+
+enum MeshVertexFormat : uint32_t {
+	// vec3 position + vec3 normal as floats, 24 bytes
+	MESH_VERTEX_FLOAT = 0,
+	// position as unorm16x3 inside the mesh AABB (2 bytes padding),
+	// normal octahedral encoded as snorm16x2, 12 bytes
+	MESH_VERTEX_QUANTIZED = 1,
+};
+
+struct MeshQuantizeError {
+	float position_max; // object space units
+	float position_rms;
+	float normal_max; // degrees
+	float normal_rms;
+};
+
+MeshLayout mesh_layout(MeshVertexFormat format);
+
+// Parses "float" / "quantized". Returns false for anything else.
+bool mesh_vertex_format_parse(const char *name, MeshVertexFormat *format);
+
+const char *mesh_vertex_format_name(MeshVertexFormat format);
+
+// Encodes the vertices for the GPU. Quantized positions are relative to the
+// AABB: the renderer folds translate(aabb_min) * scale(aabb_max - aabb_min)
+// into the model matrix and vertex_phong.glsl decodes the normals. error
+// may be NULL.
+void mesh_encode_vertices(const Mesh &mesh, MeshVertexFormat format,
+			  const float aabb_min[3], const float aabb_max[3],
+			  std::vector<uint8_t> *out, MeshQuantizeError *error);
+
+// The inverse of mesh_encode_vertices: replaces mesh->vertices with
+// vertex_count vertices decoded from data.
+void mesh_decode_vertices(const void *data, uint32_t vertex_count,
+			  MeshVertexFormat format, const float aabb_min[3],
+			  const float aabb_max[3], Mesh *mesh);
+
+void mesh_quantize_error_print(const char *name,
+			       const MeshQuantizeError &error);
+
+#endif
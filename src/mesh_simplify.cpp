@@ -0,0 +1,409 @@
+#include "mesh_simplify.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+// Weight of open border planes relative to surface planes; borders are where
+// simplification artifacts show first.
+#define SIMPLIFY_BORDER_WEIGHT 10.0
+
+// Cost of a unit normal difference, as a fraction of the mesh diagonal.
+#define SIMPLIFY_NORMAL_WEIGHT 0.02
+
+enum VertexKind : uint8_t {
+	KIND_MANIFOLD,
+	KIND_BORDER,
+	KIND_LOCKED,
+};
+
+// Symmetric 4x4 matrix accumulating squared plane distances, weighted by
+// area. w is the total weight, so eval() / w is a squared distance.
+struct Quadric {
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2, w;
+
+	void addPlane(double a, double b, double c, double d, double weight) {
+		a2 += weight * a * a;
+		ab += weight * a * b;
+		ac += weight * a * c;
+		ad += weight * a * d;
+		b2 += weight * b * b;
+		bc += weight * b * c;
+		bd += weight * b * d;
+		c2 += weight * c * c;
+		cd += weight * c * d;
+		d2 += weight * d * d;
+		w += weight;
+	}
+
+	void add(const Quadric &q) {
+		a2 += q.a2;
+		ab += q.ab;
+		ac += q.ac;
+		ad += q.ad;
+		b2 += q.b2;
+		bc += q.bc;
+		bd += q.bd;
+		c2 += q.c2;
+		cd += q.cd;
+		d2 += q.d2;
+		w += q.w;
+	}
+
+	double eval(const float *p) const {
+		double x = p[0], y = p[1], z = p[2];
+		double r = a2 * x * x + b2 * y * y + c2 * z * z + d2;
+		r += 2.0 * (ab * x * y + ac * x * z + bc * y * z);
+		r += 2.0 * (ad * x + bd * y + cd * z);
+		return r > 0.0 ? r : 0.0;
+	}
+};
+
+struct Collapse {
+	uint32_t from;
+	uint32_t to;
+	double cost;	 // squared distance plus the normal term
+	double distance; // squared distance alone
+};
+
+static inline const float *position(const Mesh &mesh, uint32_t v) {
+	return &mesh.vertices[(size_t)v * MESH_FLOATS_PER_VERTEX];
+}
+
+static void triangle_normal(const float *a, const float *b, const float *c,
+			    double n[3]) {
+	double e1[3], e2[3];
+	for (int k = 0; k < 3; k++) {
+		e1[k] = b[k] - a[k];
+		e2[k] = c[k] - a[k];
+	}
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static inline uint64_t edge_key(uint32_t a, uint32_t b) {
+	return ((uint64_t)a << 32) | b;
+}
+
+static inline bool is_border(const std::unordered_set<uint64_t> &edges,
+			     uint32_t a, uint32_t b) {
+	return edges.count(edge_key(a, b)) == 0 ||
+	       edges.count(edge_key(b, a)) == 0;
+}
+
+// Directed wedge edges; an edge without its twin is an open border.
+static void collect_edges(const std::vector<uint32_t> &indices,
+			  const std::vector<uint32_t> &wedge,
+			  std::unordered_set<uint64_t> *edges) {
+	edges->clear();
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		for (int k = 0; k < 3; k++) {
+			uint32_t a = wedge[indices[i + k]];
+			uint32_t b = wedge[indices[i + (k + 1) % 3]];
+			edges->insert(edge_key(a, b));
+		}
+	}
+}
+
+// Vertices at the same position (seams between different normals) share a
+// wedge id; topology is evaluated on wedges so seams do not look like
+// borders.
+static std::vector<uint32_t> build_wedges(const Mesh &mesh) {
+	uint32_t vertex_count = mesh.vertexCount();
+	std::vector<uint32_t> wedge(vertex_count);
+	std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+	for (uint32_t v = 0; v < vertex_count; v++) {
+		uint32_t bits[3];
+		memcpy(bits, position(mesh, v), sizeof(bits));
+		uint64_t h = bits[0] * 0x9e3779b97f4a7c15ull;
+		h ^= bits[1] * 0xc2b2ae3d27d4eb4full + (h << 6) + (h >> 2);
+		h ^= bits[2] * 0x165667b19e3779f9ull + (h << 6) + (h >> 2);
+		std::vector<uint32_t> &bucket = buckets[h];
+		wedge[v] = v;
+		for (uint32_t o : bucket) {
+			if (memcmp(position(mesh, o), position(mesh, v),
+				   3 * sizeof(float)) == 0) {
+				wedge[v] = wedge[o];
+				break;
+			}
+		}
+		bucket.push_back(v);
+	}
+	return wedge;
+}
+
+float mesh_simplify(const Mesh &mesh, const std::vector<uint32_t> &indices,
+		    uint32_t target_index_count, std::vector<uint32_t> *out) {
+	uint32_t vertex_count = mesh.vertexCount();
+	std::vector<uint32_t> current = indices;
+	if (current.size() <= target_index_count) {
+		*out = current;
+		return 0.0f;
+	}
+
+	float aabb_min[3], aabb_max[3];
+	mesh_bounds(mesh, aabb_min, aabb_max);
+	double diagonal = 0.0;
+	for (int k = 0; k < 3; k++) {
+		diagonal += (aabb_max[k] - aabb_min[k]) *
+			    (aabb_max[k] - aabb_min[k]);
+	}
+	double normal_weight = SIMPLIFY_NORMAL_WEIGHT * std::sqrt(diagonal);
+
+	std::vector<uint32_t> wedge = build_wedges(mesh);
+	std::vector<uint32_t> wedge_size(vertex_count, 0);
+	for (uint32_t v = 0; v < vertex_count; v++) {
+		wedge_size[wedge[v]]++;
+	}
+
+	std::unordered_set<uint64_t> edges;
+	collect_edges(current, wedge, &edges);
+	std::vector<uint8_t> kind(vertex_count, KIND_MANIFOLD);
+	std::vector<Quadric> quadrics(vertex_count, Quadric());
+	for (size_t i = 0; i < current.size(); i += 3) {
+		const float *p[3];
+		for (int k = 0; k < 3; k++) {
+			p[k] = position(mesh, current[i + k]);
+		}
+		double n[3];
+		triangle_normal(p[0], p[1], p[2], n);
+		double length = std::sqrt(n[0] * n[0] + n[1] * n[1] +
+					  n[2] * n[2]);
+		if (length == 0.0) {
+			continue;
+		}
+		for (int k = 0; k < 3; k++) {
+			n[k] /= length;
+		}
+		double d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+		for (int k = 0; k < 3; k++) {
+			quadrics[current[i + k]].addPlane(n[0], n[1], n[2], d,
+							  0.5 * length);
+		}
+		for (int k = 0; k < 3; k++) {
+			uint32_t a = current[i + k];
+			uint32_t b = current[i + (k + 1) % 3];
+			if (!is_border(edges, wedge[a], wedge[b])) {
+				continue;
+			}
+			// Plane through the border edge, perpendicular to
+			// the triangle.
+			double e[3], m[3];
+			for (int j = 0; j < 3; j++) {
+				e[j] = p[(k + 1) % 3][j] - p[k][j];
+			}
+			m[0] = e[1] * n[2] - e[2] * n[1];
+			m[1] = e[2] * n[0] - e[0] * n[2];
+			m[2] = e[0] * n[1] - e[1] * n[0];
+			double ml = std::sqrt(m[0] * m[0] + m[1] * m[1] +
+					      m[2] * m[2]);
+			if (ml == 0.0) {
+				continue;
+			}
+			double md = -(m[0] * p[k][0] + m[1] * p[k][1] +
+				      m[2] * p[k][2]) /
+				    ml;
+			double weight = SIMPLIFY_BORDER_WEIGHT * ml;
+			quadrics[a].addPlane(m[0] / ml, m[1] / ml, m[2] / ml,
+					     md, weight);
+			quadrics[b].addPlane(m[0] / ml, m[1] / ml, m[2] / ml,
+					     md, weight);
+			if (kind[a] == KIND_MANIFOLD) {
+				kind[a] = KIND_BORDER;
+			}
+			if (kind[b] == KIND_MANIFOLD) {
+				kind[b] = KIND_BORDER;
+			}
+		}
+	}
+	for (uint32_t v = 0; v < vertex_count; v++) {
+		if (wedge_size[wedge[v]] > 1) {
+			kind[v] = KIND_LOCKED;
+		}
+	}
+
+	std::vector<uint32_t> remap(vertex_count);
+	std::vector<bool> touched(vertex_count);
+	std::vector<uint32_t> adjacency_offsets(vertex_count + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> collapses;
+	double max_distance = 0.0;
+
+	while (current.size() > target_index_count) {
+		collect_edges(current, wedge, &edges);
+
+		// Vertex -> triangle adjacency of the current level.
+		std::fill(adjacency_offsets.begin(), adjacency_offsets.end(),
+			  0);
+		for (uint32_t v : current) {
+			adjacency_offsets[v + 1]++;
+		}
+		for (uint32_t v = 0; v < vertex_count; v++) {
+			adjacency_offsets[v + 1] += adjacency_offsets[v];
+		}
+		adjacency.resize(current.size());
+		std::vector<uint32_t> fill(adjacency_offsets.begin(),
+					   adjacency_offsets.end() - 1);
+		for (size_t i = 0; i < current.size(); i++) {
+			adjacency[fill[current[i]]++] = i / 3;
+		}
+
+		// Cheapest valid direction of every edge.
+		collapses.clear();
+		for (size_t i = 0; i < current.size(); i += 3) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t a = current[i + k];
+				uint32_t b = current[i + (k + 1) % 3];
+				if (a > b && edges.count(edge_key(wedge[b],
+								  wedge[a]))) {
+					continue; // seen from the twin
+				}
+				Collapse best = {0, 0, INFINITY, 0.0};
+				for (int dir = 0; dir < 2; dir++) {
+					uint32_t from = dir ? b : a;
+					uint32_t to = dir ? a : b;
+					if (kind[from] == KIND_LOCKED) {
+						continue;
+					}
+					if (kind[from] == KIND_BORDER &&
+					    (kind[to] != KIND_BORDER ||
+					     !is_border(edges, wedge[from],
+							wedge[to]))) {
+						continue;
+					}
+					const float *pt = position(mesh, to);
+					const float *nt = pt + 3;
+					const float *nf =
+					    position(mesh, from) + 3;
+					Quadric q = quadrics[from];
+					q.add(quadrics[to]);
+					double distance =
+					    q.w > 0.0 ? q.eval(pt) / q.w : 0.0;
+					double dn = 0.0;
+					for (int j = 0; j < 3; j++) {
+						dn += (nf[j] - nt[j]) *
+						      (nf[j] - nt[j]);
+					}
+					double cost =
+					    distance +
+					    normal_weight * normal_weight * dn;
+					if (cost < best.cost) {
+						best = {from, to, cost,
+							distance};
+					}
+				}
+				if (best.cost != INFINITY) {
+					collapses.push_back(best);
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(),
+			  [](const Collapse &x, const Collapse &y) {
+				  return x.cost < y.cost;
+			  });
+
+		// Each interior collapse removes two triangles; aim for the
+		// target in one pass but never touch a neighbourhood twice.
+		size_t budget = (current.size() - target_index_count) / 6 + 1;
+		for (uint32_t v = 0; v < vertex_count; v++) {
+			remap[v] = v;
+		}
+		std::fill(touched.begin(), touched.end(), false);
+		size_t performed = 0;
+		for (const Collapse &c : collapses) {
+			if (performed >= budget) {
+				break;
+			}
+			if (touched[c.from] || touched[c.to]) {
+				continue;
+			}
+			// Reject collapses that flip or fold a triangle.
+			const float *pt = position(mesh, c.to);
+			bool flips = false;
+			for (uint32_t a = adjacency_offsets[c.from];
+			     a < adjacency_offsets[c.from + 1] && !flips;
+			     a++) {
+				const uint32_t *t = &current[3 * adjacency[a]];
+				if (t[0] == c.to || t[1] == c.to ||
+				    t[2] == c.to) {
+					continue;
+				}
+				const float *p[3], *q[3];
+				for (int k = 0; k < 3; k++) {
+					p[k] = position(mesh, t[k]);
+					q[k] = t[k] == c.from ? pt : p[k];
+				}
+				double n0[3], n1[3];
+				triangle_normal(p[0], p[1], p[2], n0);
+				triangle_normal(q[0], q[1], q[2], n1);
+				double d = n0[0] * n1[0] + n0[1] * n1[1] +
+					   n0[2] * n1[2];
+				double l0 = n0[0] * n0[0] + n0[1] * n0[1] +
+					    n0[2] * n0[2];
+				double l1 = n1[0] * n1[0] + n1[1] * n1[1] +
+					    n1[2] * n1[2];
+				flips = d <= 0.25 * std::sqrt(l0 * l1);
+			}
+			if (flips) {
+				continue;
+			}
+			remap[c.from] = c.to;
+			quadrics[c.to].add(quadrics[c.from]);
+			max_distance = std::max(max_distance, c.distance);
+			// Lock the whole one-ring so the flip test above
+			// stays valid for the rest of the pass.
+			for (uint32_t a = adjacency_offsets[c.from];
+			     a < adjacency_offsets[c.from + 1]; a++) {
+				const uint32_t *t = &current[3 * adjacency[a]];
+				for (int k = 0; k < 3; k++) {
+					touched[t[k]] = true;
+				}
+			}
+			touched[c.to] = true;
+			performed++;
+		}
+		if (performed == 0) {
+			break;
+		}
+
+		std::vector<uint32_t> next;
+		next.reserve(current.size());
+		for (size_t i = 0; i < current.size(); i += 3) {
+			uint32_t a = remap[current[i]];
+			uint32_t b = remap[current[i + 1]];
+			uint32_t c = remap[current[i + 2]];
+			if (a != b && b != c && a != c) {
+				next.push_back(a);
+				next.push_back(b);
+				next.push_back(c);
+			}
+		}
+		current.swap(next);
+	}
+
+	out->swap(current);
+	return std::sqrt(max_distance);
+}
+
+void mesh_generate_lods(Mesh *mesh) {
+	mesh->lods.clear();
+	// source points into lods, it must not move.
+	mesh->lods.reserve(MESH_LOD_COUNT);
+	const std::vector<uint32_t> *source = &mesh->indices;
+	float error = 0.0f;
+	for (int level = 1; level <= MESH_LOD_COUNT; level++) {
+		uint32_t target = (mesh->indices.size() >> level) / 3 * 3;
+		MeshLod lod;
+		// Simplify from the previous level to keep the chain cheap;
+		// the triangle inequality bounds the accumulated error.
+		error += mesh_simplify(*mesh, *source, target, &lod.indices);
+		lod.error = error;
+		if (lod.indices.size() >= source->size() * 9 / 10) {
+			break;
+		}
+		mesh->lods.push_back(std::move(lod));
+		source = &mesh->lods.back().indices;
+	}
+}
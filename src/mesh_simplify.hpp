@@ -0,0 +1,27 @@
+#ifndef _MESH_SIMPLIFY_HPP
+#define _MESH_SIMPLIFY_HPP
+
+#include "mesh.hpp"
+#include <cstdint>
+#include <vector>
+
+// Levels generated by mesh_generate_lods, each with half the triangles of
+// the previous one: 50, 25, 12.5 and 6.25 percent.
+#define MESH_LOD_COUNT 4
+
+// Simplifies indices (triangles over mesh.vertices) towards target_index_count
+// with quadric error metrics (Garland and Heckbert). Edges are collapsed
+// onto one of their existing endpoints, so the result indexes the same
+// vertex buffer and every vertex keeps its own normal; a normal difference
+// term in the cost keeps collapses across creases for last. Vertices shared
+// by several normals (seams) are locked, open borders only collapse along
+// themselves. Returns the largest collapse error as an object space
+// distance.
+float mesh_simplify(const Mesh &mesh, const std::vector<uint32_t> &indices,
+		    uint32_t target_index_count, std::vector<uint32_t> *out);
+
+// Fills mesh->lods with up to MESH_LOD_COUNT levels simplified from
+// mesh->indices. Stops early once a level no longer shrinks.
+void mesh_generate_lods(Mesh *mesh);
+
+#endif
@@ -0,0 +1,125 @@
+#include "mesh_weld.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+typedef std::unordered_map<uint64_t, uint32_t> CellMap;
+
+static inline uint64_t hash_cell(int64_t x, int64_t y, int64_t z) {
+	uint64_t h = (uint64_t)x * 0x9e3779b97f4a7c15ull;
+	h ^= (uint64_t)y * 0xc2b2ae3d27d4eb4full + (h << 6) + (h >> 2);
+	h ^= (uint64_t)z * 0x165667b19e3779f9ull + (h << 6) + (h >> 2);
+	return h;
+}
+
+static inline bool same_vertex(const float *a, const float *b,
+			       float epsilon) {
+	for (int k = 0; k < MESH_FLOATS_PER_VERTEX; k++) {
+		if (std::fabs(a[k] - b[k]) > epsilon) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Looks for a welded vertex matching v in the cells around c.
+static uint32_t find_vertex(const CellMap &cells,
+			    const std::vector<uint32_t> &next,
+			    const std::vector<float> &vertices, const float *v,
+			    const int64_t c[3], int reach, float epsilon) {
+	for (int dx = -reach; dx <= reach; dx++) {
+		for (int dy = -reach; dy <= reach; dy++) {
+			for (int dz = -reach; dz <= reach; dz++) {
+				CellMap::const_iterator it = cells.find(
+				    hash_cell(c[0] + dx, c[1] + dy, c[2] + dz));
+				if (it == cells.end()) {
+					continue;
+				}
+				for (uint32_t o = it->second; o != ~0u;
+				     o = next[o]) {
+					const float *w =
+					    &vertices[(size_t)o *
+						      MESH_FLOATS_PER_VERTEX];
+					if (same_vertex(v, w, epsilon)) {
+						return o;
+					}
+				}
+			}
+		}
+	}
+	return ~0u;
+}
+
+static size_t buffer_bytes(const Mesh &mesh) {
+	return mesh.vertices.size() * sizeof(float) +
+	       mesh.indices.size() * mesh_index_size(mesh);
+}
+
+void mesh_weld(Mesh *mesh, float epsilon, MeshWeldStats *stats) {
+	uint32_t input_count = mesh->vertexCount();
+	stats->vertices_before = input_count;
+	stats->bytes_before = buffer_bytes(*mesh);
+
+	std::vector<uint32_t> corners = mesh->indices;
+	if (corners.empty()) {
+		corners.resize(input_count);
+		for (uint32_t i = 0; i < input_count; i++) {
+			corners[i] = i;
+		}
+	}
+
+	// Output vertex of every input vertex, ~0u until first seen.
+	std::vector<uint32_t> remap(input_count, ~0u);
+	std::vector<float> vertices;
+	std::vector<uint32_t> next; // chain of output vertices per cell
+	CellMap cells;
+	vertices.reserve(mesh->vertices.size());
+	cells.reserve(input_count);
+	int reach = epsilon > 0.0f ? 1 : 0;
+
+	for (uint32_t &corner : corners) {
+		if (remap[corner] != ~0u) {
+			corner = remap[corner];
+			continue;
+		}
+		const float *v =
+		    &mesh->vertices[(size_t)corner * MESH_FLOATS_PER_VERTEX];
+		int64_t c[3];
+		for (int k = 0; k < 3; k++) {
+			if (epsilon > 0.0f) {
+				c[k] = (int64_t)std::floor(v[k] / epsilon);
+			} else {
+				uint32_t bits;
+				memcpy(&bits, &v[k], sizeof(bits));
+				c[k] = bits;
+			}
+		}
+
+		uint32_t found =
+		    find_vertex(cells, next, vertices, v, c, reach, epsilon);
+		if (found == ~0u) {
+			found = next.size();
+			vertices.insert(vertices.end(), v,
+					v + MESH_FLOATS_PER_VERTEX);
+			uint64_t key = hash_cell(c[0], c[1], c[2]);
+			uint32_t &head = cells.emplace(key, ~0u).first->second;
+			next.push_back(head);
+			head = found;
+		}
+		remap[corner] = found;
+		corner = found;
+	}
+
+	mesh->vertices.swap(vertices);
+	mesh->indices.swap(corners);
+	stats->vertices_after = mesh->vertexCount();
+	stats->bytes_after = buffer_bytes(*mesh);
+}
+
+void mesh_weld_print(const char *name, const MeshWeldStats &stats) {
+	printf("%s: welded %u -> %u vertices, %zu -> %zu buffer bytes\n", name,
+	       stats.vertices_before, stats.vertices_after, stats.bytes_before,
+	       stats.bytes_after);
+}
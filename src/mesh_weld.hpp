@@ -0,0 +1,29 @@
+#ifndef _MESH_WELD_HPP
+#define _MESH_WELD_HPP
+
+#include "mesh.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Default tolerance when welding assets at load time. The text assets are
+// printed with six decimals, so anything closer than that is one vertex.
+#define MESH_WELD_EPSILON 1e-6f
+
+struct MeshWeldStats {
+	uint32_t vertices_before;
+	uint32_t vertices_after;
+	size_t bytes_before; // vertex + index buffer
+	size_t bytes_after;
+};
+
+// Merges vertices whose positions and normals all differ by at most epsilon
+// per component and rewrites the mesh as a compact vertex buffer plus index
+// buffer. Works on plain triangle lists and on already indexed meshes; the
+// first vertex of every group of duplicates is kept. Positions are bucketed
+// on a grid of epsilon sized cells, so a lookup only compares against the
+// vertices of the 27 surrounding cells (one cell when epsilon is 0).
+void mesh_weld(Mesh *mesh, float epsilon, MeshWeldStats *stats);
+
+void mesh_weld_print(const char *name, const MeshWeldStats &stats);
+
+#endif
@@ -0,0 +1,172 @@
+#include "norm_txt_loader.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Below this a chunk is not worth a task.
+#define NORM_TXT_MIN_CHUNK (256 * 1024)
+
+static inline bool is_space(char c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// Number of whitespace separated tokens in [p, end). Chunks start at the
+// beginning of a line, so the byte before p counts as whitespace.
+static size_t count_tokens(const char *p, const char *end) {
+	size_t count = 0;
+	bool prev_space = true;
+#ifdef __SSE2__
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i carriage = _mm_set1_epi8('\r');
+	const __m128i tab = _mm_set1_epi8('\t');
+	unsigned int carry = 1;
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i ws = _mm_or_si128(
+		    _mm_or_si128(_mm_cmpeq_epi8(v, space),
+				 _mm_cmpeq_epi8(v, newline)),
+		    _mm_or_si128(_mm_cmpeq_epi8(v, carriage),
+				 _mm_cmpeq_epi8(v, tab)));
+		unsigned int ws_mask = _mm_movemask_epi8(ws);
+		// A token starts at every non-space byte preceded by a space.
+		unsigned int starts = ~ws_mask & ((ws_mask << 1) | carry);
+		count += __builtin_popcount(starts & 0xffff);
+		carry = (ws_mask >> 15) & 1;
+		p += 16;
+	}
+	prev_space = carry;
+#endif
+	for (; p < end; p++) {
+		bool space = is_space(*p);
+		if (!space && prev_space) {
+			count++;
+		}
+		prev_space = space;
+	}
+	return count;
+}
+
+// Parses up to out_end - out floats from [p, end). Returns false on a token
+// that is not a number.
+static bool parse_chunk(const char *p, const char *end, float *out,
+			float *out_end) {
+	while (out < out_end) {
+		while (p < end && is_space(*p)) {
+			p++;
+		}
+		if (p == end) {
+			break;
+		}
+		std::from_chars_result r = std::from_chars(p, end, *out);
+		if (r.ec != std::errc()) {
+			return false;
+		}
+		p = r.ptr;
+		out++;
+	}
+	return true;
+}
+
+bool mesh_parse_norm_txt(const char *data, size_t size, Mesh *mesh,
+			 ThreadPool *pool) {
+	const char *end = data + size;
+	const char *p = data;
+	while (p < end && is_space(*p)) {
+		p++;
+	}
+	int triangle_count = 0;
+	std::from_chars_result r = std::from_chars(p, end, triangle_count);
+	if (r.ec != std::errc() || triangle_count < 0) {
+		fprintf(stderr, "norm.txt: missing triangle count\n");
+		return false;
+	}
+	const char *body = (const char *)memchr(r.ptr, '\n', end - r.ptr);
+	body = body == NULL ? end : body + 1;
+
+	// Cut the body into line aligned chunks, a few per thread so an
+	// uneven chunk does not hold up the whole pass.
+	size_t body_size = end - body;
+	size_t chunk_size =
+	    std::max((size_t)NORM_TXT_MIN_CHUNK, body_size / (pool->size() * 4));
+	std::vector<const char *> bounds;
+	bounds.push_back(body);
+	while (end - bounds.back() > (ptrdiff_t)chunk_size) {
+		const char *cut = bounds.back() + chunk_size;
+		cut = (const char *)memchr(cut, '\n', end - cut);
+		if (cut == NULL) {
+			break;
+		}
+		bounds.push_back(cut + 1);
+	}
+	bounds.push_back(end);
+	size_t chunk_count = bounds.size() - 1;
+
+	std::vector<size_t> offsets(chunk_count + 1, 0);
+	pool->parallelFor(chunk_count, [&](size_t i) {
+		offsets[i + 1] = count_tokens(bounds[i], bounds[i + 1]);
+	});
+	for (size_t i = 0; i < chunk_count; i++) {
+		offsets[i + 1] += offsets[i];
+	}
+	size_t expected = (size_t)triangle_count * 3 * MESH_FLOATS_PER_VERTEX;
+	if (offsets[chunk_count] != expected) {
+		fprintf(stderr, "norm.txt: expected %zu numbers, found %zu\n",
+			expected, offsets[chunk_count]);
+		return false;
+	}
+
+	mesh->indices.clear();
+	mesh->vertices.resize(expected);
+	float *out = mesh->vertices.data();
+	std::atomic<bool> ok(true);
+	pool->parallelFor(chunk_count, [&](size_t i) {
+		if (!parse_chunk(bounds[i], bounds[i + 1], out + offsets[i],
+				 out + offsets[i + 1])) {
+			ok = false;
+		}
+	});
+	if (!ok) {
+		fprintf(stderr, "norm.txt: malformed number\n");
+		return false;
+	}
+	return true;
+}
+
+bool mesh_load_norm_txt_mapped(const char *path, Mesh *mesh,
+			       ThreadPool *pool) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "failed to open asset file %s\n", path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		fprintf(stderr, "empty asset file %s\n", path);
+		close(fd);
+		return false;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "failed to map asset file %s\n", path);
+		return false;
+	}
+	madvise(map, st.st_size, MADV_WILLNEED);
+	bool ok = mesh_parse_norm_txt((const char *)map, st.st_size, mesh, pool);
+	munmap(map, st.st_size);
+	if (!ok) {
+		fprintf(stderr, "failed to parse asset file %s\n", path);
+	}
+	return ok;
+}
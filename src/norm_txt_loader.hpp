@@ -0,0 +1,21 @@
+#ifndef _NORM_TXT_LOADER_HPP
+#define _NORM_TXT_LOADER_HPP
+
+#include "mesh.hpp"
+#include "thread_pool.hpp"
+#include <cstddef>
+
+// Parallel reader for the .norm.txt text format. The body is split into
+// line aligned chunks; a first pass counts the numbers in every chunk (SSE2
+// where available), a prefix sum turns the counts into output offsets and a
+// second pass parses each chunk with std::from_chars straight into the
+// interleaved position + normal vertices. Unlike fscanf this does not
+// depend on the C locale.
+bool mesh_parse_norm_txt(const char *data, size_t size, Mesh *mesh,
+			 ThreadPool *pool);
+
+// mmaps path and runs mesh_parse_norm_txt over the mapping.
+bool mesh_load_norm_txt_mapped(const char *path, Mesh *mesh,
+			       ThreadPool *pool);
+
+#endif
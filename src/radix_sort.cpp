@@ -0,0 +1,43 @@
+#include "radix_sort.hpp"
+#include <cstring>
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+void radix_sort(SortItem *items, SortItem *scratch, size_t count) {
+	// All histograms in one read of the keys.
+	size_t counts[RADIX_PASSES][RADIX_BUCKETS] = {};
+	for (size_t i = 0; i < count; i++) {
+		uint64_t key = items[i].key;
+		for (int pass = 0; pass < RADIX_PASSES; pass++) {
+			counts[pass][(key >> (pass * RADIX_BITS)) & 0xff]++;
+		}
+	}
+
+	SortItem *from = items, *to = scratch;
+	for (int pass = 0; pass < RADIX_PASSES; pass++) {
+		size_t *bucket = counts[pass];
+		int shift = pass * RADIX_BITS;
+		// Every key has the same byte, the pass would change nothing.
+		if (count == 0 ||
+		    bucket[(items[0].key >> shift) & 0xff] == count) {
+			continue;
+		}
+		size_t offset = 0;
+		for (int b = 0; b < RADIX_BUCKETS; b++) {
+			size_t n = bucket[b];
+			bucket[b] = offset;
+			offset += n;
+		}
+		for (size_t i = 0; i < count; i++) {
+			to[bucket[(from[i].key >> shift) & 0xff]++] = from[i];
+		}
+		SortItem *t = from;
+		from = to;
+		to = t;
+	}
+	if (from != items) {
+		memcpy(items, from, count * sizeof(SortItem));
+	}
+}
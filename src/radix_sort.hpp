@@ -0,0 +1,19 @@
+#ifndef _RADIX_SORT_HPP
+#define _RADIX_SORT_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// A key and the index of what it sorts.
+struct SortItem {
+	uint64_t key;
+	uint32_t value;
+};
+
+// Sorts items by ascending key, keeping the order of equal keys. One
+// counting pass per key byte, 8 bits at a time; bytes that are the same in
+// every key are skipped, so keys that leave fields zero cost less. scratch
+// holds count items.
+void radix_sort(SortItem *items, SortItem *scratch, size_t count);
+
+#endif
@@ -0,0 +1,182 @@
+#include "render_queue.hpp"
+#include "gl_state.hpp"
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+
+// Layer in the top two bits. Opaque keys continue with program, mesh,
+// material and depth; transparent keys with inverted depth, then the state.
+#define KEY_LAYER_SHIFT 62
+#define KEY_LOW_SHIFT 6
+
+static_assert(RENDER_KEY_PROGRAM_BITS + RENDER_KEY_MESH_BITS +
+			  RENDER_KEY_MATERIAL_BITS + RENDER_KEY_DEPTH_BITS <=
+		      KEY_LAYER_SHIFT - KEY_LOW_SHIFT,
+	      "render key fields overlap");
+
+static inline uint64_t field(uint64_t value, int bits) {
+	return value & ((1ull << bits) - 1);
+}
+
+RenderQueue::RenderQueue() {
+	this->view = glm::mat4(1.0f);
+	this->far_plane = 1.0f;
+	this->stats = {};
+}
+
+void RenderQueue::begin(const glm::mat4 &view, float far_plane) {
+	this->view = view;
+	this->far_plane = far_plane;
+	this->packets.clear();
+	this->items.clear();
+}
+
+uint64_t RenderQueue::key(RenderLayer layer,
+			  const RenderPacket &packet) const {
+	// Distance along the view direction of the model's origin.
+	float z = -(this->view * packet.model[3]).z / this->far_plane;
+	z = std::min(std::max(z, 0.0f), 1.0f);
+	uint64_t depth_max = (1ull << RENDER_KEY_DEPTH_BITS) - 1;
+	uint64_t depth = (uint64_t)(z * depth_max);
+	uint64_t program =
+	    field(packet.pipeline->shader->ID, RENDER_KEY_PROGRAM_BITS);
+	// Pooled meshes share the pool's vertex array and sort together.
+	unsigned int vao =
+	    packet.pool != NULL ? packet.pool->VAO : packet.mesh->VAO;
+	uint64_t mesh = field(vao, RENDER_KEY_MESH_BITS);
+	uint64_t material = field(packet.material, RENDER_KEY_MATERIAL_BITS);
+
+	uint64_t state = program;
+	state = (state << RENDER_KEY_MESH_BITS) | mesh;
+	state = (state << RENDER_KEY_MATERIAL_BITS) | material;
+	const int state_bits = RENDER_KEY_PROGRAM_BITS + RENDER_KEY_MESH_BITS +
+			       RENDER_KEY_MATERIAL_BITS;
+	uint64_t key;
+	if (layer == RENDER_LAYER_OPAQUE) {
+		key = (state << RENDER_KEY_DEPTH_BITS) | depth;
+	} else {
+		key = ((depth_max - depth) << state_bits) | state;
+	}
+	return ((uint64_t)layer << KEY_LAYER_SHIFT) | (key << KEY_LOW_SHIFT);
+}
+
+void RenderQueue::push(RenderLayer layer, const RenderPacket &packet) {
+	SortItem item = {this->key(layer, packet),
+			 (uint32_t)this->packets.size()};
+	this->items.push_back(item);
+	this->packets.push_back(packet);
+}
+
+void RenderQueue::submit() {
+	double start = glfwGetTime();
+	size_t count = this->items.size();
+	this->scratch.resize(count);
+	radix_sort(this->items.data(), this->scratch.data(), count);
+	double sorted = glfwGetTime();
+
+	RenderQueueStats stats = {};
+	stats.packets = count;
+	BasicShader *shader = NULL;
+	const GpuMesh *mesh = NULL;
+	uint32_t material = 0;
+	bool oct_normals = false;
+	bool transparent = false;
+	MeshPool *pool = NULL; // holding the commands of the current run
+	for (const SortItem &item : this->items) {
+		const RenderPacket &p = this->packets[item.value];
+		const RenderPipeline &pipeline = *p.pipeline;
+		bool layer_changes =
+		    !transparent &&
+		    (item.key >> KEY_LAYER_SHIFT) == RENDER_LAYER_TRANSPARENT;
+		// A run ends before anything that changes the state it was
+		// recorded with.
+		if (pool != NULL && (p.pool != pool || layer_changes ||
+				     pipeline.shader != shader)) {
+			pool->draw();
+			pool = NULL;
+			stats.multi_draws++;
+		}
+		if (layer_changes) {
+			transparent = true;
+			gl_state_set(GL_BLEND, true);
+			gl_state_blend_func(GL_SRC_ALPHA,
+					    GL_ONE_MINUS_SRC_ALPHA);
+			gl_state_depth_mask(false);
+		}
+		// Uniforms stay set per program, they are only written when
+		// the packet needs another value.
+		bool switched = pipeline.shader != shader;
+		if (switched) {
+			shader = pipeline.shader;
+			shader->use();
+			stats.programs++;
+		}
+		if (p.mesh != mesh) {
+			mesh = p.mesh;
+			stats.meshes++;
+		}
+		shader->setMat4(pipeline.model, p.model);
+		if (switched || p.material != material) {
+			material = p.material;
+			shader->setInt(pipeline.material_index, material);
+		}
+		if (switched || p.oct_normals != oct_normals) {
+			oct_normals = p.oct_normals;
+			shader->setInt(pipeline.oct_normals, oct_normals);
+		}
+
+		if (p.pool != NULL) {
+			pool = p.pool;
+			uint32_t commands;
+			if (p.meshlet_count > 0) {
+				commands = pool->addMeshlets(
+				    p.pool_mesh, *p.mesh, p.meshlets,
+				    p.meshlet_count, p.model, p.material);
+			} else {
+				pool->addDraw(p.pool_mesh, p.lod, p.model,
+					      p.material);
+				commands = 1;
+			}
+			if (p.draws != NULL) {
+				*p.draws = commands;
+			}
+			stats.draws += commands;
+			continue;
+		}
+		if (p.timer != NULL) {
+			p.timer->begin();
+		}
+		uint32_t draws = 1;
+		if (p.patch_vertices != 0) {
+			gpu_mesh_draw_patches(*p.mesh, p.patch_vertices);
+		} else if (p.instances != NULL) {
+			draws = p.instances->draw();
+		} else if (p.meshlet_count > 0) {
+			draws = gpu_mesh_draw_meshlets(*p.mesh, p.meshlets,
+						       p.meshlet_count);
+		} else {
+			gpu_mesh_draw(*p.mesh, p.lod);
+		}
+		if (p.timer != NULL) {
+			p.timer->end();
+		}
+		if (p.draws != NULL) {
+			*p.draws = draws;
+		}
+		stats.draws += draws;
+	}
+	if (pool != NULL) {
+		pool->draw();
+		stats.multi_draws++;
+	}
+	if (transparent) {
+		gl_state_set(GL_BLEND, false);
+		gl_state_depth_mask(true);
+	}
+
+	stats.sort_ms = (sorted - start) * 1000.0;
+	stats.submit_ms = (glfwGetTime() - sorted) * 1000.0;
+	this->stats = stats;
+	this->packets.clear();
+	this->items.clear();
+}
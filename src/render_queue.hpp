@@ -0,0 +1,98 @@
+#ifndef _RENDER_QUEUE_HPP
+#define _RENDER_QUEUE_HPP
+
+#include "basic_shader.hpp"
+#include "gpu_mesh.hpp"
+#include "gpu_timer.hpp"
+#include "instance_batch.hpp"
+#include "mesh_pool.hpp"
+#include "radix_sort.hpp"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Bits of each field in a sort key; wider values are masked, which only
+// costs state changes, never correctness.
+#define RENDER_KEY_PROGRAM_BITS 12
+#define RENDER_KEY_MESH_BITS 12
+#define RENDER_KEY_MATERIAL_BITS 8
+#define RENDER_KEY_DEPTH_BITS 24
+
+// Opaque packets draw first, grouped by program, mesh and material and front
+// to back within a group; transparent ones follow back to front.
+enum RenderLayer : uint32_t {
+	RENDER_LAYER_OPAQUE = 0,
+	RENDER_LAYER_TRANSPARENT = 1,
+};
+
+// A program and the handles of the uniforms set per packet; -1 for those the
+// program does not have.
+struct RenderPipeline {
+	BasicShader *shader;
+	int model;
+	int oct_normals;
+	int material_index;
+};
+
+// One draw. Pointers must stay valid until RenderQueue::submit.
+struct RenderPacket {
+	const RenderPipeline *pipeline;
+	const GpuMesh *mesh;
+	glm::mat4 model;
+	uint32_t material; // index into the Materials block
+	bool oct_normals;
+	uint32_t lod;
+	// Meshlets of LOD0 to draw instead of lod, when meshlet_count > 0.
+	const uint32_t *meshlets;
+	uint32_t meshlet_count;
+	// Draws GL_PATCHES of this many control points when not 0.
+	uint32_t patch_vertices;
+	// Draws the batch's copies of mesh instead, with an INSTANCED
+	// program; model, material and lod are per instance then.
+	const InstanceBatch *instances;
+	// Records the draw into pool_mesh of pool instead, with an INSTANCED
+	// program; pooled packets next to each other in key order go out as
+	// one multi-draw. mesh stays the source, for its meshlets.
+	MeshPool *pool;
+	uint32_t pool_mesh;
+	GpuTimer *timer; // times this packet's draw, may be NULL, not pooled
+	uint32_t *draws; // receives the draws it took, may be NULL
+};
+
+struct RenderQueueStats {
+	uint32_t packets;
+	uint32_t programs; // switches made by the last submit
+	uint32_t meshes;
+	uint32_t draws; // including the ranges of meshlet draws
+	uint32_t multi_draws; // of pooled packets, one per run
+	float sort_ms;
+	float submit_ms;
+};
+
+// Draw packets collected during a frame, each with a 64-bit key, and drawn
+// in key order by submit with the fewest program, mesh and uniform changes.
+class RenderQueue {
+      private:
+	std::vector<RenderPacket> packets;
+	std::vector<SortItem> items;
+	std::vector<SortItem> scratch;
+	glm::mat4 view;
+	float far_plane;
+
+	uint64_t key(RenderLayer layer, const RenderPacket &packet) const;
+
+      public:
+	RenderQueueStats stats;
+
+	RenderQueue();
+
+	// Starts a frame; view and far_plane place packets in depth.
+	void begin(const glm::mat4 &view, float far_plane);
+
+	void push(RenderLayer layer, const RenderPacket &packet);
+
+	// Sorts and draws the packets pushed since begin.
+	void submit();
+};
+
+#endif
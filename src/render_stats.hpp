@@ -0,0 +1,72 @@
+#ifndef _RENDER_STATS_HPP
+#define _RENDER_STATS_HPP
+
+#include "asset_stream.hpp"
+#include "bezier_patch.hpp"
+#include "cull.hpp"
+#include "gl_state.hpp"
+#include "mesh_pool.hpp"
+#include "render_queue.hpp"
+#include "scene_bvh.hpp"
+#include "shader_manager.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// How the lit meshes are submitted, switched in the stats window to compare
+// the cost of draw calls.
+enum DrawPath : uint32_t {
+	DRAW_PATH_INSTANCED = 0,  // copies by instanced draws, one per LOD
+	DRAW_PATH_PER_OBJECT = 1, // a draw call for every object
+	DRAW_PATH_MULTI_DRAW = 2, // pooled, one multi-draw indirect
+	DRAW_PATH_COUNT,
+};
+
+static const char *const DRAW_PATH_NAMES[DRAW_PATH_COUNT] = {
+    "instanced", "per-object", "multi-draw"};
+
+// Objects of the scene BVH; the teapot copies follow the two.
+enum SceneObject : uint32_t {
+	SCENE_GROUND = 0,
+	SCENE_LIGHTCUBE = 1,
+	SCENE_COPIES = 2,
+};
+
+// Per frame numbers shown in the stats window.
+struct RenderStats {
+	bool asset_resident;
+	AssetLoadStats asset_load;
+	uint32_t asset_lod;
+	uint32_t asset_lod_count;
+	uint32_t asset_triangles;
+	float asset_error_pixels; // projected error of the drawn LOD
+	uint32_t asset_draws;	  // index ranges submitted
+	MeshletCullStats meshlets; // all zero when not drawn by meshlets
+	float asset_gpu_ms; // GPU time of the teapot's draws
+	RenderQueueStats queue;
+	uint32_t instances; // copies drawn
+	uint32_t instances_culled;
+	float instance_cull_ms;
+	bool instance_cull_bvh; // copies culled with the scene BVH
+	uint32_t instance_draws;
+	size_t instance_bytes; // streamed this frame
+	bool multi_draw_supported;
+	MeshPoolStats mesh_pool; // zero until the pool is made
+	SceneBvhStats scene_bvh;
+	float scene_bvh_cost;
+	float scene_build_ms; // of the last rebuild
+	float scene_move_ms;  // last refit after the light cube moved
+	uint32_t picked;      // SceneObject under the cursor or BVH_NONE
+	uint32_t picked_triangle; // of a picked copy, BVH_NONE for a box
+	float picked_distance;
+	size_t asset_buffer_bytes;
+	bool bezier; // teapot tessellated from its patches
+	bool bezier_hardware; // by the tessellation shaders
+	bool tessellation_supported;
+	BezierStats bezier_patches; // CPU tessellation only
+	uint32_t uniform_lookups;     // by name, zero in steady state
+	uint32_t uniform_block_bytes; // uploaded to the shared blocks
+	GlStateStats gl_state; // binds and switches, renderer thread only
+	ShaderSetupStats shaders;
+};
+
+#endif
@@ -0,0 +1,332 @@
+#include "scene_bvh.hpp"
+#include <algorithm>
+#include <cfloat>
+
+static float half_area(const glm::vec3 &min, const glm::vec3 &max) {
+	glm::vec3 d = max - min;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// Returns -1 when the box is outside one of the planes in mask, otherwise
+// mask without the planes the box is entirely inside of. The object test
+// with a full mask is frustum_test_box's.
+static int test_box(const Frustum &frustum, const glm::vec3 &min,
+		    const glm::vec3 &max, int mask) {
+	glm::vec3 center = 0.5f * (min + max);
+	glm::vec3 extent = 0.5f * (max - min);
+	for (int p = 0; p < 6; p++) {
+		if ((mask & (1 << p)) == 0) {
+			continue;
+		}
+		const glm::vec4 &plane = frustum.planes[p];
+		float reach = glm::dot(glm::abs(glm::vec3(plane)), extent);
+		float d = glm::dot(glm::vec3(plane), center) + plane.w;
+		if (d < -reach) {
+			return -1;
+		}
+		if (d >= reach) {
+			mask &= ~(1 << p);
+		}
+	}
+	return mask;
+}
+
+// Slab test; distance is where the ray enters the box, clamped to 0.
+static bool ray_box(const glm::vec3 &origin, const glm::vec3 &inverse,
+		    const glm::vec3 &min, const glm::vec3 &max,
+		    float max_distance, float *distance) {
+	glm::vec3 t0 = (min - origin) * inverse;
+	glm::vec3 t1 = (max - origin) * inverse;
+	glm::vec3 near = glm::min(t0, t1);
+	glm::vec3 far = glm::max(t0, t1);
+	float enter =
+	    std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+	float exit =
+	    std::min(std::min(far.x, far.y), std::min(far.z, max_distance));
+	*distance = enter;
+	return enter <= exit;
+}
+
+SceneBvh::SceneBvh() {
+	this->root = BVH_NONE;
+	this->stats = {};
+}
+
+void SceneBvh::build(const glm::vec3 *min, const glm::vec3 *max,
+		     uint32_t count) {
+	this->object_min.assign(min, min + count);
+	this->object_max.assign(max, max + count);
+	this->leaf.assign(count, BVH_NONE);
+	this->items.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		this->items[i] = i;
+	}
+	this->nodes.clear();
+	this->stats = {};
+	this->root = count > 0 ? this->buildNode(0, count, BVH_NONE, 1)
+			       : BVH_NONE;
+	this->stats.nodes = this->nodes.size();
+}
+
+uint32_t SceneBvh::buildNode(uint32_t first, uint32_t count, uint32_t parent,
+			     uint32_t depth) {
+	uint32_t index = this->nodes.size();
+	this->nodes.push_back({});
+	this->nodes[index].parent = parent;
+	this->stats.depth = std::max(this->stats.depth, depth);
+	if (count <= BVH_LEAF_OBJECTS) {
+		this->nodes[index].count = count;
+		this->nodes[index].child[0] = first;
+		for (uint32_t i = first; i < first + count; i++) {
+			this->leaf[this->items[i]] = index;
+		}
+		this->fit(index);
+		return index;
+	}
+
+	// Median of the centers along the axis they spread most on.
+	const glm::vec3 *lo = this->object_min.data();
+	const glm::vec3 *hi = this->object_max.data();
+	glm::vec3 spread_min(FLT_MAX), spread_max(-FLT_MAX);
+	for (uint32_t i = first; i < first + count; i++) {
+		glm::vec3 center = lo[this->items[i]] + hi[this->items[i]];
+		spread_min = glm::min(spread_min, center);
+		spread_max = glm::max(spread_max, center);
+	}
+	glm::vec3 spread = spread_max - spread_min;
+	int axis = spread.x > spread.y ? 0 : 1;
+	axis = spread.z > spread[axis] ? 2 : axis;
+	uint32_t half = count / 2;
+	std::vector<uint32_t>::iterator begin = this->items.begin() + first;
+	std::nth_element(begin, begin + half, begin + count,
+			 [lo, hi, axis](uint32_t a, uint32_t b) {
+				 return lo[a][axis] + hi[a][axis] <
+					lo[b][axis] + hi[b][axis];
+			 });
+	uint32_t left = this->buildNode(first, half, index, depth + 1);
+	uint32_t right =
+	    this->buildNode(first + half, count - half, index, depth + 1);
+	this->nodes[index].count = 0;
+	this->nodes[index].child[0] = left;
+	this->nodes[index].child[1] = right;
+	this->fit(index);
+	return index;
+}
+
+uint32_t SceneBvh::size() const {
+	return this->object_min.size();
+}
+
+// Recomputes a node's box from its objects or children; true when it changed.
+bool SceneBvh::fit(uint32_t index) {
+	Node &node = this->nodes[index];
+	glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+	if (node.count > 0) {
+		for (uint32_t i = 0; i < node.count; i++) {
+			uint32_t object = this->items[node.child[0] + i];
+			min = glm::min(min, this->object_min[object]);
+			max = glm::max(max, this->object_max[object]);
+		}
+	} else {
+		const Node &a = this->nodes[node.child[0]];
+		const Node &b = this->nodes[node.child[1]];
+		min = glm::min(a.min, b.min);
+		max = glm::max(a.max, b.max);
+	}
+	bool changed = min != node.min || max != node.max;
+	node.min = min;
+	node.max = max;
+	return changed;
+}
+
+// Kopta et al.: swapping a child with a grandchild under the other child
+// keeps the node's box but changes that other child's, take the swap that
+// shrinks it most.
+void SceneBvh::rotate(uint32_t index) {
+	Node &node = this->nodes[index];
+	float best = 0.0f;
+	int best_child = -1, best_grandchild = -1;
+	for (int c = 0; c < 2; c++) {
+		const Node &other = this->nodes[node.child[1 - c]];
+		if (other.count > 0) {
+			continue;
+		}
+		const Node &moved = this->nodes[node.child[c]];
+		float before = half_area(other.min, other.max);
+		for (int g = 0; g < 2; g++) {
+			// other keeps its grandchild 1 - g and gains moved.
+			const Node &kept = this->nodes[other.child[1 - g]];
+			float after = half_area(glm::min(moved.min, kept.min),
+						glm::max(moved.max, kept.max));
+			if (before - after > best) {
+				best = before - after;
+				best_child = c;
+				best_grandchild = g;
+			}
+		}
+	}
+	if (best_child < 0) {
+		return;
+	}
+	uint32_t moved = node.child[best_child];
+	uint32_t other = node.child[1 - best_child];
+	uint32_t grandchild = this->nodes[other].child[best_grandchild];
+	node.child[best_child] = grandchild;
+	this->nodes[grandchild].parent = index;
+	this->nodes[other].child[best_grandchild] = moved;
+	this->nodes[moved].parent = other;
+	this->fit(other);
+	this->stats.rotations++;
+}
+
+void SceneBvh::move(uint32_t object, const glm::vec3 &min,
+		    const glm::vec3 &max) {
+	this->set(object, min, max);
+	// Up from the leaf until a box stays the same; the ones above cannot
+	// change then.
+	for (uint32_t index = this->leaf[object]; index != BVH_NONE;
+	     index = this->nodes[index].parent) {
+		bool changed = this->fit(index);
+		if (this->nodes[index].count == 0) {
+			this->rotate(index);
+		}
+		if (!changed) {
+			break;
+		}
+	}
+}
+
+void SceneBvh::set(uint32_t object, const glm::vec3 &min,
+		   const glm::vec3 &max) {
+	this->object_min[object] = min;
+	this->object_max[object] = max;
+}
+
+void SceneBvh::refitNode(uint32_t index, bool rotate) {
+	if (this->nodes[index].count == 0) {
+		this->refitNode(this->nodes[index].child[0], rotate);
+		this->refitNode(this->nodes[index].child[1], rotate);
+	}
+	this->fit(index);
+	if (rotate && this->nodes[index].count == 0) {
+		this->rotate(index);
+	}
+}
+
+void SceneBvh::refit(bool rotate) {
+	if (this->root != BVH_NONE) {
+		this->refitNode(this->root, rotate);
+	}
+}
+
+uint32_t SceneBvh::cull(const Frustum &frustum, uint32_t *visible) {
+	uint32_t n = 0;
+	this->stats.visited = 0;
+	if (this->root == BVH_NONE) {
+		return 0;
+	}
+	// Pairs of node and the planes it still has to be tested against.
+	this->stack.clear();
+	this->stack.push_back(this->root);
+	this->stack.push_back(0x3f);
+	while (!this->stack.empty()) {
+		int mask = this->stack.back();
+		this->stack.pop_back();
+		const Node &node = this->nodes[this->stack.back()];
+		this->stack.pop_back();
+		this->stats.visited++;
+		mask = test_box(frustum, node.min, node.max, mask);
+		if (mask < 0) {
+			continue;
+		}
+		if (node.count == 0) {
+			for (int c = 0; c < 2; c++) {
+				this->stack.push_back(node.child[c]);
+				this->stack.push_back(mask);
+			}
+			continue;
+		}
+		for (uint32_t i = 0; i < node.count; i++) {
+			uint32_t object = this->items[node.child[0] + i];
+			if (mask == 0 ||
+			    test_box(frustum, this->object_min[object],
+				     this->object_max[object], mask) >= 0) {
+				visible[n++] = object;
+			}
+		}
+	}
+	return n;
+}
+
+bool SceneBvh::raycast(const glm::vec3 &origin, const glm::vec3 &direction,
+		       float max_distance, uint32_t *object,
+		       float *distance) {
+	bool hit = false;
+	float best = max_distance;
+	glm::vec3 inverse = glm::vec3(1.0f) / direction;
+	float t;
+	if (this->root == BVH_NONE ||
+	    !ray_box(origin, inverse, this->nodes[this->root].min,
+		     this->nodes[this->root].max, best, &t)) {
+		return false;
+	}
+	// Nodes the ray enters, nearer ones on top; a node is skipped once
+	// a hit closer than its entry is known.
+	std::vector<std::pair<uint32_t, float>> &pending = this->ray_stack;
+	pending.clear();
+	pending.push_back({this->root, t});
+	while (!pending.empty()) {
+		std::pair<uint32_t, float> top = pending.back();
+		pending.pop_back();
+		if (top.second > best) {
+			continue;
+		}
+		const Node &node = this->nodes[top.first];
+		if (node.count > 0) {
+			for (uint32_t i = 0; i < node.count; i++) {
+				uint32_t o = this->items[node.child[0] + i];
+				if (ray_box(origin, inverse,
+					    this->object_min[o],
+					    this->object_max[o], best, &t)) {
+					best = t;
+					*object = o;
+					hit = true;
+				}
+			}
+			continue;
+		}
+		float enter[2];
+		bool entered[2];
+		for (int c = 0; c < 2; c++) {
+			const Node &child = this->nodes[node.child[c]];
+			entered[c] = ray_box(origin, inverse, child.min,
+					     child.max, best, &enter[c]);
+		}
+		int near = enter[1] < enter[0] ? 1 : 0;
+		int far = 1 - near;
+		if (entered[far]) {
+			pending.push_back({node.child[far], enter[far]});
+		}
+		if (entered[near]) {
+			pending.push_back({node.child[near], enter[near]});
+		}
+	}
+	if (hit) {
+		*distance = best;
+	}
+	return hit;
+}
+
+float SceneBvh::cost() const {
+	if (this->root == BVH_NONE) {
+		return 0.0f;
+	}
+	float sum = 0.0f;
+	for (const Node &node : this->nodes) {
+		if (node.count == 0) {
+			sum += half_area(node.min, node.max);
+		}
+	}
+	const Node &root = this->nodes[this->root];
+	return sum / half_area(root.min, root.max);
+}
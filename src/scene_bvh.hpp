@@ -0,0 +1,89 @@
+#ifndef _SCENE_BVH_HPP
+#define _SCENE_BVH_HPP
+
+#include "cull.hpp"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+
+#define BVH_LEAF_OBJECTS 4
+#define BVH_NONE 0xffffffffu
+
+struct SceneBvhStats {
+	uint32_t nodes;
+	uint32_t depth;	    // of the last build
+	uint32_t visited;   // nodes the last cull looked at
+	uint32_t rotations; // made by move and refit since the build
+};
+
+// A binary tree of boxes over the scene's objects, each object a box known
+// by its index. Objects that move are refitted into the tree in place, and
+// the nodes on the way up are rotated when swapping a child with a
+// grandchild shrinks them, so the tree stays tight without a rebuild.
+class SceneBvh {
+      private:
+	struct Node {
+		glm::vec3 min;
+		uint32_t parent; // BVH_NONE for the root
+		glm::vec3 max;
+		uint32_t count; // objects of a leaf, 0 for inner nodes
+		// Inner nodes: the children. Leaves: where their objects
+		// start in items.
+		uint32_t child[2];
+	};
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> items; // objects, grouped by leaf
+	std::vector<uint32_t> leaf;  // of each object
+	std::vector<glm::vec3> object_min;
+	std::vector<glm::vec3> object_max;
+	uint32_t root;
+	std::vector<uint32_t> stack;
+	std::vector<std::pair<uint32_t, float>> ray_stack;
+
+	uint32_t buildNode(uint32_t first, uint32_t count, uint32_t parent,
+			   uint32_t depth);
+	bool fit(uint32_t node);
+	void rotate(uint32_t node);
+	void refitNode(uint32_t node, bool rotate);
+
+      public:
+	SceneBvhStats stats;
+
+	SceneBvh();
+
+	// Replaces the objects with count boxes and builds the tree over them
+	// from scratch, splitting at the median along the widest axis.
+	void build(const glm::vec3 *min, const glm::vec3 *max, uint32_t count);
+
+	uint32_t size() const;
+
+	// Moves one object and refits the nodes above it.
+	void move(uint32_t object, const glm::vec3 &min, const glm::vec3 &max);
+
+	// Changes an object's box without touching the tree; call refit once
+	// after moving many.
+	void set(uint32_t object, const glm::vec3 &min, const glm::vec3 &max);
+
+	// Refits every node bottom up, rotating them unless rotate is false.
+	void refit(bool rotate = true);
+
+	// Writes the objects whose boxes intersect the frustum to visible, in
+	// tree order, and returns how many there are. Subtrees entirely
+	// inside a plane skip it. visible needs room for size() objects.
+	uint32_t cull(const Frustum &frustum, uint32_t *visible);
+
+	// The object whose box the ray enters first within max_distance;
+	// false when it misses all of them. direction need not be normalized,
+	// distance is in its units.
+	bool raycast(const glm::vec3 &origin, const glm::vec3 &direction,
+		     float max_distance, uint32_t *object,
+		     float *distance);
+
+	// Surface area of the inner nodes relative to the root's, what a ray
+	// or cull is expected to visit; lower is better.
+	float cost() const;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "shader_cache.hpp"
+#include "asset_cache.hpp"
+#include <GL/glew.h>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define SHADER_CACHE_MAGIC 0x42505347 // "GSPB"
+
+struct ShaderCacheHeader {
+	uint32_t magic;
+	uint32_t format; // binaryFormat of glGetProgramBinary
+	uint64_t key;
+	uint64_t size;
+};
+
+static std::string cache_path(uint64_t key) {
+	char name[32];
+	snprintf(name, sizeof(name), "/%016" PRIx64 ".glprog", key);
+	return std::string(ASSET_CACHE_DIR) + name;
+}
+
+uint64_t shader_cache_key(const std::string *sources, uint32_t count) {
+	uint64_t hash = 0;
+	const GLenum strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION,
+				  GL_SHADING_LANGUAGE_VERSION};
+	for (GLenum name : strings) {
+		const char *s = (const char *)glGetString(name);
+		if (s != NULL) {
+			hash = asset_hash(s, strlen(s), hash);
+		}
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		hash = asset_hash(sources[i].data(), sources[i].size(), hash);
+	}
+	return hash;
+}
+
+bool shader_cache_supported() {
+	if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+		return false;
+	}
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+bool shader_cache_load(unsigned int program, uint64_t key) {
+	FILE *f = fopen(cache_path(key).c_str(), "rb");
+	if (f == NULL) {
+		return false;
+	}
+	ShaderCacheHeader header;
+	std::vector<char> binary;
+	bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+		  header.magic == SHADER_CACHE_MAGIC && header.key == key &&
+		  header.size > 0 && header.size < (1u << 30);
+	if (ok) {
+		binary.resize(header.size);
+		ok = fread(binary.data(), 1, binary.size(), f) == binary.size();
+	}
+	fclose(f);
+	if (!ok) {
+		return false;
+	}
+
+	glProgramBinary(program, header.format, binary.data(), binary.size());
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	return status == GL_TRUE;
+}
+
+void shader_cache_store(unsigned int program, uint64_t key) {
+	GLint size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0) {
+		return;
+	}
+	ShaderCacheHeader header = {SHADER_CACHE_MAGIC, 0, key,
+				    (uint64_t)size};
+	std::vector<char> binary(size);
+	GLenum format = 0;
+	glGetProgramBinary(program, size, NULL, &format, binary.data());
+	header.format = format;
+
+	if (mkdir(ASSET_CACHE_DIR, 0755) != 0 && errno != EEXIST) {
+		return;
+	}
+	// Written aside and renamed, a reader never sees half a file.
+	std::string path = cache_path(key);
+	std::string tmp_path = path + ".tmp";
+	FILE *f = fopen(tmp_path.c_str(), "wb");
+	if (f == NULL) {
+		return;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+		  fwrite(binary.data(), 1, binary.size(), f) == binary.size();
+	if (fclose(f) != 0 || !ok ||
+	    rename(tmp_path.c_str(), path.c_str()) != 0) {
+		unlink(tmp_path.c_str());
+	}
+}
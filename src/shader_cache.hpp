@@ -0,0 +1,27 @@
+#ifndef _SHADER_CACHE_HPP
+#define _SHADER_CACHE_HPP
+
+#include <cstdint>
+#include <string>
+
+// Linked programs are kept as driver binaries in ASSET_CACHE_DIR, named by
+// a hash of their stage sources and of the driver's vendor, renderer and
+// version strings. A driver update therefore maps to new files, and a blob
+// the driver still rejects only costs a compile from source.
+
+// Key of a program built from count stage sources. The sources are hashed
+// as handed to the compiler, so anything spliced into them is covered.
+uint64_t shader_cache_key(const std::string *sources, uint32_t count);
+
+// Whether the context can save and load program binaries at all.
+bool shader_cache_supported();
+
+// Loads the binary stored for key into program. Returns true if the
+// program is linked, false to build it from source.
+bool shader_cache_load(unsigned int program, uint64_t key);
+
+// Stores the binary of the linked program under key. The program must
+// have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+void shader_cache_store(unsigned int program, uint64_t key);
+
+#endif
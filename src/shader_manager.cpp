@@ -0,0 +1,221 @@
+#include "shader_manager.hpp"
+#include "asset_cache.hpp"
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstring>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+std::string shader_permutation_defines(uint32_t permutation) {
+	static const char *names[] = {"DIRECTIONAL_LIGHT", "PHONG_SPECULAR",
+				      "ATTENUATION", "SHADOWS", "INSTANCED"};
+	std::string defines;
+	for (uint32_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (permutation & (1u << i)) {
+			defines += "#define ";
+			defines += names[i];
+			defines += "\n";
+		}
+	}
+	return defines;
+}
+
+ShaderManager::ShaderManager(const char *dir) {
+	this->stats = {};
+	this->dir = dir;
+	this->watch = -1;
+#ifdef __linux__
+	// Editors either write the file in place or rename a new one over it.
+	this->watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (this->watch >= 0 &&
+	    inotify_add_watch(this->watch, dir, IN_CLOSE_WRITE | IN_MOVED_TO) <
+		0) {
+		fprintf(stderr, "shader manager: cannot watch %s\n", dir);
+		close(this->watch);
+		this->watch = -1;
+	}
+#endif
+	this->stats.watching = this->watch >= 0;
+	this->stats.parallel = GLEW_KHR_parallel_shader_compile ||
+			       GLEW_ARB_parallel_shader_compile;
+	// Let the driver pick how many threads to compile with.
+	if (GLEW_KHR_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsKHR(0xffffffff);
+	} else if (GLEW_ARB_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsARB(0xffffffff);
+	}
+	this->start = glfwGetTime();
+	this->fallback =
+	    new BasicShader((this->dir + "/vertex_phong.glsl").c_str(),
+			    (this->dir + "/fragment_fallback.glsl").c_str());
+}
+
+ShaderManager::~ShaderManager() {
+	for (BasicShader *shader : this->shaders) {
+		delete shader;
+	}
+	delete this->fallback;
+#ifdef __linux__
+	if (this->watch >= 0) {
+		close(this->watch);
+	}
+#endif
+}
+
+BasicShader *ShaderManager::track(BasicShader *shader, double issued) {
+	this->stats.issue_ms += (glfwGetTime() - issued) * 1000.0;
+	this->shaders.push_back(shader);
+	this->pending.push_back(shader);
+	this->stats.programs++;
+	this->stats.pending++;
+	return shader;
+}
+
+BasicShader *ShaderManager::add(const char *vertexShaderPath,
+				const char *fragmentShaderPath,
+				const std::string &defines) {
+	double t = glfwGetTime();
+	return this->track(new BasicShader(vertexShaderPath,
+					   fragmentShaderPath, true, defines),
+			   t);
+}
+
+BasicShader *ShaderManager::add(const char *vertexShaderPath,
+				const char *tessControlShaderPath,
+				const char *tessEvaluationShaderPath,
+				const char *fragmentShaderPath,
+				const std::string &defines) {
+	double t = glfwGetTime();
+	return this->track(
+	    new BasicShader(vertexShaderPath, tessControlShaderPath,
+			    tessEvaluationShaderPath, fragmentShaderPath, true,
+			    defines),
+	    t);
+}
+
+static uint64_t variant_key(const char *const *paths, uint32_t count,
+			    uint32_t permutation) {
+	uint64_t key = permutation;
+	for (uint32_t i = 0; i < count; i++) {
+		key = asset_hash(paths[i], strlen(paths[i]), key);
+	}
+	return key;
+}
+
+BasicShader *ShaderManager::variant(const char *vertexShaderPath,
+				    const char *fragmentShaderPath,
+				    uint32_t permutation) {
+	const char *paths[] = {vertexShaderPath, fragmentShaderPath};
+	BasicShader *&shader =
+	    this->variants[variant_key(paths, 2, permutation)];
+	if (shader == NULL) {
+		shader = this->add(vertexShaderPath, fragmentShaderPath,
+				   shader_permutation_defines(permutation));
+	}
+	return shader;
+}
+
+BasicShader *ShaderManager::variant(const char *vertexShaderPath,
+				    const char *tessControlShaderPath,
+				    const char *tessEvaluationShaderPath,
+				    const char *fragmentShaderPath,
+				    uint32_t permutation) {
+	const char *paths[] = {vertexShaderPath, tessControlShaderPath,
+			       tessEvaluationShaderPath, fragmentShaderPath};
+	BasicShader *&shader =
+	    this->variants[variant_key(paths, 4, permutation)];
+	if (shader == NULL) {
+		shader = this->add(vertexShaderPath, tessControlShaderPath,
+				   tessEvaluationShaderPath, fragmentShaderPath,
+				   shader_permutation_defines(permutation));
+	}
+	return shader;
+}
+
+void ShaderManager::markStale(BasicShader *shader, const std::string &file) {
+	if (std::find(shader->files.begin(), shader->files.end(), file) !=
+		shader->files.end() &&
+	    std::find(this->stale.begin(), this->stale.end(), shader) ==
+		this->stale.end()) {
+		this->stale.push_back(shader);
+	}
+}
+
+void ShaderManager::readChanges() {
+#ifdef __linux__
+	alignas(struct inotify_event) char buffer[4096];
+	ssize_t size;
+	while ((size = read(this->watch, buffer, sizeof(buffer))) > 0) {
+		for (char *p = buffer; p < buffer + size;) {
+			struct inotify_event *event =
+			    (struct inotify_event *)p;
+			p += sizeof(struct inotify_event) + event->len;
+			if (event->len == 0) {
+				continue;
+			}
+			std::string file = this->dir + "/" + event->name;
+			this->markStale(this->fallback, file);
+			for (BasicShader *shader : this->shaders) {
+				this->markStale(shader, file);
+			}
+		}
+	}
+#endif
+}
+
+uint32_t ShaderManager::update() {
+	if (this->watch >= 0) {
+		this->readChanges();
+	}
+	uint32_t reloads = 0;
+	while (!this->stale.empty() &&
+	       reloads < SHADER_MANAGER_RELOADS_PER_FRAME) {
+		BasicShader *shader = this->stale.front();
+		this->stale.erase(this->stale.begin());
+		shader->reload();
+		if (std::find(this->pending.begin(), this->pending.end(),
+			      shader) == this->pending.end()) {
+			this->pending.push_back(shader);
+		}
+		if (std::find(this->reloading.begin(), this->reloading.end(),
+			      shader) == this->reloading.end()) {
+			this->reloading.push_back(shader);
+		}
+		reloads++;
+	}
+	this->stats.reloads += reloads;
+
+	if (this->pending.empty()) {
+		return 0;
+	}
+	uint32_t kept = 0;
+	for (BasicShader *shader : this->pending) {
+		if (!shader->poll()) {
+			this->pending[kept++] = shader;
+			continue;
+		}
+		std::vector<BasicShader *>::iterator reload = std::find(
+		    this->reloading.begin(), this->reloading.end(), shader);
+		bool reloaded = reload != this->reloading.end();
+		if (reloaded) {
+			this->reloading.erase(reload);
+		}
+		if (shader->failed) {
+			this->stats.failures++;
+		} else if (shader->cached && reloaded) {
+			this->stats.reloads_cached++;
+		} else if (shader->cached) {
+			this->stats.cached++;
+		}
+	}
+	uint32_t finished = this->pending.size() - kept;
+	this->pending.resize(kept);
+	this->stats.pending = kept;
+	if (kept == 0 && this->stats.ms == 0.0f) {
+		this->stats.ms = (glfwGetTime() - this->start) * 1000.0;
+	}
+	return finished;
+}
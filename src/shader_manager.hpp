@@ -0,0 +1,104 @@
+#ifndef _SHADER_MANAGER_HPP
+#define _SHADER_MANAGER_HPP
+
+#include "basic_shader.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Specializations of fragment_lit.glsl, each bit one #define.
+enum ShaderPermutation : uint32_t {
+	SHADER_DIRECTIONAL_LIGHT = 1 << 0, // otherwise a point light
+	SHADER_PHONG_SPECULAR = 1 << 1,	   // otherwise Blinn-Phong
+	SHADER_ATTENUATION = 1 << 2,
+	SHADER_SHADOWS = 1 << 3,	   // needs light_space and shadow_map
+	SHADER_INSTANCED = 1 << 4,	   // with vertex_phong.glsl only
+};
+
+// The #define lines of permutation.
+std::string shader_permutation_defines(uint32_t permutation);
+
+// Compiling and linking of the programs added so far, for the stats window.
+struct ShaderSetupStats {
+	uint32_t programs;
+	uint32_t cached;  // added ones loaded from the binary cache
+	uint32_t pending; // still compiling
+	float issue_ms;	  // spent adding programs on the render thread
+	float ms;	  // from the manager's creation until none pending
+	bool parallel;	  // driver compiles in the background
+	bool watching;	  // reloads programs when their files change
+	uint32_t reloads;
+	uint32_t reloads_cached; // reloads loaded from the binary cache
+	uint32_t failures; // builds that did not compile or link
+};
+
+// Programs rebuilt per update after a file changed; the rest wait for the
+// next frames.
+#define SHADER_MANAGER_RELOADS_PER_FRAME 4
+
+// Builds programs in the background. All compiles are issued when a
+// program is added, with KHR_parallel_shader_compile the driver runs them on
+// its own threads, and update picks up the programs that finished. Draws
+// use the fallback program until theirs is ready, so startup does not wait
+// for every variant.
+//
+// The shader directory is watched with inotify. Saving a file rebuilds the
+// programs that read it, includes too, and each swaps in between frames once
+// it linked; one that fails keeps its previous program.
+class ShaderManager {
+      private:
+	std::vector<BasicShader *> shaders;
+	std::vector<BasicShader *> pending;
+	std::vector<BasicShader *> stale; // to reload
+	std::vector<BasicShader *> reloading; // pending ones being rebuilt
+	std::string dir;
+	int watch; // inotify descriptor, -1 when not watching
+	// By a hash of the stage paths and the permutation.
+	std::unordered_map<uint64_t, BasicShader *> variants;
+	double start; // glfwGetTime at construction
+
+	BasicShader *track(BasicShader *shader, double issued);
+	void readChanges();
+	void markStale(BasicShader *shader, const std::string &file);
+
+      public:
+	// Flat shaded, built before anything else. Shares the attributes and
+	// uniforms of the phong programs.
+	BasicShader *fallback;
+	ShaderSetupStats stats;
+
+	// dir holds the shaders, the paths given to add must start with it.
+	explicit ShaderManager(const char *dir);
+	~ShaderManager();
+
+	// The manager owns the returned program, draw with it once it is
+	// ready.
+	BasicShader *add(const char *vertexShaderPath,
+			 const char *fragmentShaderPath,
+			 const std::string &defines = "");
+
+	BasicShader *add(const char *vertexShaderPath,
+			 const char *tessControlShaderPath,
+			 const char *tessEvaluationShaderPath,
+			 const char *fragmentShaderPath,
+			 const std::string &defines = "");
+
+	// The program for permutation of these stages, added the first time
+	// it is asked for. Cheap enough to call every frame.
+	BasicShader *variant(const char *vertexShaderPath,
+			     const char *fragmentShaderPath,
+			     uint32_t permutation);
+
+	BasicShader *variant(const char *vertexShaderPath,
+			     const char *tessControlShaderPath,
+			     const char *tessEvaluationShaderPath,
+			     const char *fragmentShaderPath,
+			     uint32_t permutation);
+
+	// Finishes the programs the driver is done with, returns how many, and
+	// starts rebuilding the ones whose files changed.
+	uint32_t update();
+};
+
+#endif
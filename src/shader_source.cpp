@@ -0,0 +1,87 @@
+#include "shader_source.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+// Includes nested deeper than this are taken to be a cycle.
+#define SHADER_SOURCE_MAX_DEPTH 16
+
+// Makes the next line count as line of source string file.
+static std::string line_directive(int line, int file) {
+	return "#line " + std::to_string(line) + " " + std::to_string(file) +
+	       "\n";
+}
+
+static bool expand(const std::string &path, const std::string *defines,
+		   std::string *source, std::vector<std::string> *files,
+		   int depth) {
+	// Listed even when missing, creating it may fix the program.
+	int index = files->size();
+	files->push_back(path);
+	std::ifstream fs(path);
+	if (!fs) {
+		fprintf(stderr, "shader source: cannot read %s\n",
+			path.c_str());
+		return false;
+	}
+	std::string dir;
+	size_t slash = path.rfind('/');
+	if (slash != std::string::npos) {
+		dir = path.substr(0, slash + 1);
+	}
+
+	std::string line;
+	int number = 0;
+	while (std::getline(fs, line)) {
+		number++;
+		size_t first = line.find_first_not_of(" \t");
+		if (first == std::string::npos ||
+		    line.compare(first, 8, "#include") != 0) {
+			*source += line;
+			*source += '\n';
+			if (defines != NULL && first != std::string::npos &&
+			    line.compare(first, 8, "#version") == 0) {
+				*source += *defines;
+				*source += line_directive(number + 1, index);
+				defines = NULL;
+			}
+			continue;
+		}
+
+		size_t open = line.find('"', first);
+		size_t close = open == std::string::npos
+				   ? open
+				   : line.find('"', open + 1);
+		if (close == std::string::npos) {
+			fprintf(stderr, "shader source: %s:%d: bad #include\n",
+				path.c_str(), number);
+			return false;
+		}
+		std::string name = line.substr(open + 1, close - open - 1);
+		name = dir + name;
+		if (std::find(files->begin(), files->end(), name) !=
+		    files->end()) {
+			*source += '\n'; // keeps the line count
+			continue;
+		}
+		if (depth >= SHADER_SOURCE_MAX_DEPTH) {
+			fprintf(stderr,
+				"shader source: %s: includes too deep\n",
+				path.c_str());
+			return false;
+		}
+		*source += line_directive(1, files->size());
+		if (!expand(name, NULL, source, files, depth + 1)) {
+			return false;
+		}
+		*source += line_directive(number + 1, index);
+	}
+	return true;
+}
+
+bool shader_source_load(const char *path, const std::string &defines,
+			std::string *source, std::vector<std::string> *files) {
+	source->clear();
+	files->clear();
+	return expand(path, &defines, source, files, 0);
+}
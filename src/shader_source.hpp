@@ -0,0 +1,19 @@
+#ifndef _SHADER_SOURCE_HPP
+#define _SHADER_SOURCE_HPP
+
+#include <string>
+#include <vector>
+
+// Reads the GLSL file at path the way the compiler should see it. Lines
+// `#include "name"` are replaced by the file name, looked up next to the
+// including file; a file is only included once. defines, a block of
+// #define lines, goes right after #version. #line directives keep the
+// compiler's line numbers pointing into the original files, the source
+// string number being the index in files.
+//
+// files receives every file read, path first. Returns false, with a
+// message, if one cannot be read; it is still listed.
+bool shader_source_load(const char *path, const std::string &defines,
+			std::string *source, std::vector<std::string> *files);
+
+#endif
@@ -0,0 +1,18 @@
+#version 330 core
+
+// Drawn with while the real program compiles: the material's diffuse color,
+// lit only by the facing of the surface.
+
+in vec3 frag_nor;
+
+out vec3 color;
+
+#include "uniform_blocks.glsl"
+
+uniform int material_index;
+
+void main() {
+	// Geometry without normals, like the light cube, counts as facing up.
+	float up = dot(frag_nor, frag_nor) > 0.0 ? normalize(frag_nor).y : 1.0;
+	color = materials[material_index].diffuse * (0.5 + 0.5 * max(up, 0.0));
+}
@@ -2,15 +2,8 @@
 
 out vec3 color;
 
-struct Light {
-	vec3 position;
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
-uniform Light light;
-
+#include "uniform_blocks.glsl"
 
 void main() {
-	color = light.ambient + light.diffuse + light.specular;
+	color = lightcube.ambient + lightcube.diffuse + lightcube.specular;
 }
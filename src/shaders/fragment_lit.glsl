@@ -0,0 +1,83 @@
+#version 330 core
+
+// One light on one material. Variants are picked with defines, see
+// ShaderPermutation:
+//   DIRECTIONAL_LIGHT  light.position is the direction toward the light,
+//                      otherwise a point light
+//   PHONG_SPECULAR     reflected light vector, otherwise Blinn's halfway
+//                      vector
+//   ATTENUATION        point light falloff with distance
+//   SHADOWS            shadow_map, rendered from light_space
+//   INSTANCED          model and material per instance, from
+//                      vertex_phong.glsl
+
+#include "uniform_blocks.glsl"
+
+in vec3 frag_pos;
+in vec3 frag_nor;
+
+out vec3 color;
+
+#ifdef INSTANCED
+flat in int frag_material;
+#define material_index frag_material
+#else
+uniform int material_index;
+#endif
+
+#ifdef SHADOWS
+uniform mat4 light_space;
+uniform sampler2DShadow shadow_map;
+
+// 1 lit, 0 in shadow.
+float lit() {
+	vec4 p = light_space * vec4(frag_pos, 1.0);
+	vec3 coord = 0.5 * p.xyz / p.w + 0.5;
+	if (coord.z > 1.0) {
+		return 1.0;
+	}
+	return texture(shadow_map, vec3(coord.xy, coord.z - 0.002));
+}
+#endif
+
+void main() {
+	Material material = materials[material_index];
+
+	vec3 normal_direction = normalize(frag_nor);
+	vec3 view_direction = normalize(camera_pos - frag_pos);
+#ifdef DIRECTIONAL_LIGHT
+	vec3 light_direction = normalize(light.position);
+#else
+	vec3 light_direction = normalize(light.position - frag_pos);
+#endif
+
+	float attenuation = 1.0;
+#if defined(ATTENUATION) && !defined(DIRECTIONAL_LIGHT)
+	float Kc = 1.0;
+	float Kl = 0.09;
+	float Kq = 0.032;
+	float distance = length(light.position - frag_pos);
+	attenuation = 1.0 / (Kc + (Kl*distance) + Kq * (distance * distance));
+#endif
+
+#ifdef PHONG_SPECULAR
+	vec3 reflection_direction = reflect(-light_direction, normal_direction);
+	float spec = pow(max(dot(view_direction, reflection_direction), 0.0), material.shininess);
+#else
+	vec3 halfway = normalize(light_direction + view_direction);
+	float spec = pow(max(dot(halfway, normal_direction), 0.0), material.shininess);
+#endif
+
+	float shadow = 1.0;
+#ifdef SHADOWS
+	shadow = lit();
+#endif
+
+	vec3 ambient = attenuation * light.ambient * material.ambient;
+	float diff = max(dot(normal_direction, light_direction), 0.0);
+	vec3 diffuse = attenuation * light.diffuse * (diff * material.diffuse);
+	vec3 specular = attenuation * light.specular * spec * material.specular;
+	float gamma = 1.1;
+
+	color = pow(ambient + shadow * (diffuse + specular), vec3(1.0/gamma));
+}
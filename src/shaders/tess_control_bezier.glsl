@@ -0,0 +1,44 @@
+#version 400 core
+
+layout (vertices = 16) out;
+
+in vec3 control_pos[];
+out vec3 patch_pos[];
+
+uniform mat4 model;
+
+#include "uniform_blocks.glsl"
+
+// Pixels covered by one unit at distance one, and the pixels one segment
+// should cover (BEZIER_PIXELS_PER_SEGMENT).
+uniform float pixels_per_unit;
+uniform float pixels_per_segment;
+
+// Segments along the edge through control points a, b, c and d, from the
+// length of its control polygon and its distance to the eye. Only the edge's
+// own points are used, symmetrically, so the patch on the other side
+// computes the same level and no cracks open.
+float edge_level(int a, int b, int c, int d) {
+	vec3 p0 = vec3(model * vec4(control_pos[a], 1.0));
+	vec3 p1 = vec3(model * vec4(control_pos[b], 1.0));
+	vec3 p2 = vec3(model * vec4(control_pos[c], 1.0));
+	vec3 p3 = vec3(model * vec4(control_pos[d], 1.0));
+	float len = (distance(p0, p1) + distance(p2, p3)) + distance(p1, p2);
+	float dist = max(distance(camera_pos, 0.5 * (p0 + p3)), 0.5 * len);
+	float pixels = len * pixels_per_unit / max(dist, 1e-3);
+	return clamp(pixels / pixels_per_segment, 1.0, 64.0);
+}
+
+void main() {
+	patch_pos[gl_InvocationID] = control_pos[gl_InvocationID];
+	if (gl_InvocationID != 0) {
+		return;
+	}
+	// Control point 4 * i + j weighs B_i(u) B_j(v).
+	gl_TessLevelOuter[0] = edge_level(0, 1, 2, 3);	   // u = 0
+	gl_TessLevelOuter[1] = edge_level(0, 4, 8, 12);	   // v = 0
+	gl_TessLevelOuter[2] = edge_level(12, 13, 14, 15); // u = 1
+	gl_TessLevelOuter[3] = edge_level(3, 7, 11, 15);   // v = 1
+	gl_TessLevelInner[0] = max(gl_TessLevelOuter[1], gl_TessLevelOuter[3]);
+	gl_TessLevelInner[1] = max(gl_TessLevelOuter[0], gl_TessLevelOuter[2]);
+}
@@ -0,0 +1,54 @@
+#version 400 core
+
+// Counterclockwise in (u, v); the patches face outward along
+// dP/du x dP/dv.
+layout (quads, fractional_odd_spacing, ccw) in;
+
+in vec3 patch_pos[];
+
+uniform mat4 model;
+
+#include "uniform_blocks.glsl"
+
+out vec3 frag_pos;
+out vec3 frag_nor;
+
+void bernstein(float t, out vec4 b, out vec4 d) {
+	float s = 1.0 - t;
+	b = vec4(s * s * s, 3.0 * t * s * s, 3.0 * t * t * s, t * t * t);
+	d = vec4(-3.0 * s * s, 3.0 * s * (s - 2.0 * t),
+		 3.0 * t * (2.0 * s - t), 3.0 * t * t);
+}
+
+// Position and unnormalized normal at uv.
+void evaluate(vec2 uv, out vec3 p, out vec3 n) {
+	vec4 bu, du, bv, dv;
+	bernstein(uv.x, bu, du);
+	bernstein(uv.y, bv, dv);
+	vec3 pu = vec3(0.0);
+	vec3 pv = vec3(0.0);
+	p = vec3(0.0);
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			vec3 c = patch_pos[4 * i + j];
+			p += bu[i] * bv[j] * c;
+			pu += du[i] * bv[j] * c;
+			pv += bu[i] * dv[j] * c;
+		}
+	}
+	n = cross(pu, pv);
+}
+
+void main() {
+	vec3 p, n;
+	evaluate(gl_TessCoord.xy, p, n);
+	// A collapsed edge, like the pole of the lid, has no tangent plane;
+	// take the normal from just inside the patch.
+	if (dot(n, n) < 1e-12) {
+		vec3 q;
+		evaluate(mix(gl_TessCoord.xy, vec2(0.5), 0.004), q, n);
+	}
+	gl_Position = projection * view * model * vec4(p, 1.0);
+	frag_pos = vec3(model * vec4(p, 1.0));
+	frag_nor = normalize(n);
+}
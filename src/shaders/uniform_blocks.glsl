@@ -0,0 +1,31 @@
+// Blocks shared by all programs, laid out as the structs in
+// uniform_block.hpp.
+
+layout (std140) uniform Camera {
+	mat4 view;
+	mat4 projection;
+	vec3 camera_pos;
+};
+
+struct Light {
+	vec3 position;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
+
+layout (std140) uniform Lights {
+	Light light;
+	Light lightcube;
+};
+
+struct Material {
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+	float shininess;
+};
+
+layout (std140) uniform Materials {
+	Material materials[8]; // UNIFORM_BLOCK_MAX_MATERIALS
+};
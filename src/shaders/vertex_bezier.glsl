@@ -0,0 +1,11 @@
+#version 400 core
+
+// Control points of bicubic patches, 16 per patch, in object space. The
+// tessellation shaders do all the work.
+layout (location = 0) in vec3 aPos;
+
+out vec3 control_pos;
+
+void main() {
+	control_pos = aPos;
+}
@@ -3,15 +3,44 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNor;
 
+#ifdef INSTANCED
+// Per instance, see InstanceData: the rows of the model matrix and the
+// material, passed on to the fragment shader.
+layout (location = 2) in vec4 instance_model0;
+layout (location = 3) in vec4 instance_model1;
+layout (location = 4) in vec4 instance_model2;
+layout (location = 5) in uint instance_material;
+
+flat out int frag_material;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+
+#include "uniform_blocks.glsl"
+
+// Set for MESH_VERTEX_QUANTIZED meshes: aNor.xy holds an octahedral encoded
+// normal. Quantized positions need no decoding, the dequantization is part
+// of the model matrix.
+uniform bool oct_normals;
 
 out vec3 frag_pos;
 out vec3 frag_nor;
 
+vec3 oct_decode(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
 void main() {
+#ifdef INSTANCED
+	mat4 model = transpose(mat4(instance_model0, instance_model1,
+				    instance_model2, vec4(0.0, 0.0, 0.0, 1.0)));
+	frag_material = int(instance_material);
+#endif
 	gl_Position = projection * view * model * vec4(aPos, 1.0);
 	frag_pos = vec3(model * vec4(aPos, 1.0));
-	frag_nor = aNor;
+	frag_nor = oct_normals ? oct_decode(aNor.xy) : aNor;
 }
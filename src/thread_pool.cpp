@@ -0,0 +1,80 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(unsigned int threads) {
+	this->stopping = false;
+	if (threads == 0) {
+		threads = std::thread::hardware_concurrency();
+	}
+	// The thread calling wait() works too, so spawn one less.
+	for (unsigned int i = 1; i < threads; i++) {
+		this->workers.emplace_back(&ThreadPool::worker, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->task_available.notify_all();
+	for (std::thread &t : this->workers) {
+		t.join();
+	}
+}
+
+// Pops and runs one task. Called with the lock held, returns with it held.
+void ThreadPool::run(std::unique_lock<std::mutex> &lock) {
+	Task task = std::move(this->tasks.front());
+	this->tasks.pop_front();
+	lock.unlock();
+	task.fn();
+	lock.lock();
+	if (--task.group->pending == 0) {
+		this->task_done.notify_all();
+	}
+}
+
+void ThreadPool::worker() {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	for (;;) {
+		this->task_available.wait(lock, [this] {
+			return this->stopping || !this->tasks.empty();
+		});
+		if (this->tasks.empty()) {
+			return;
+		}
+		this->run(lock);
+	}
+}
+
+void ThreadPool::submit(Group *group, std::function<void()> fn) {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		group->pending++;
+		this->tasks.push_back({group, std::move(fn)});
+	}
+	this->task_available.notify_one();
+	// Threads blocked in wait() help out with whatever is queued.
+	this->task_done.notify_all();
+}
+
+void ThreadPool::wait(Group *group) {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (group->pending > 0) {
+		if (!this->tasks.empty()) {
+			this->run(lock);
+		} else {
+			// Woken both by finished tasks and by new submissions.
+			this->task_done.wait(lock);
+		}
+	}
+}
+
+void ThreadPool::parallelFor(size_t count,
+			     const std::function<void(size_t)> &fn) {
+	Group group;
+	for (size_t i = 0; i < count; i++) {
+		this->submit(&group, [&fn, i] { fn(i); });
+	}
+	this->wait(&group);
+}
@@ -0,0 +1,54 @@
+#ifndef _THREAD_POOL_HPP
+#define _THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads fed from one FIFO. Work is tracked in groups:
+// wait() on a group runs queued tasks on the calling thread until every task
+// of that group has finished, so tasks may submit and wait on nested groups
+// without starving the pool.
+class ThreadPool {
+      public:
+	struct Group {
+		size_t pending = 0;
+	};
+
+      private:
+	struct Task {
+		Group *group;
+		std::function<void()> fn;
+	};
+
+	std::vector<std::thread> workers;
+	std::deque<Task> tasks;
+	std::mutex mutex;
+	std::condition_variable task_available;
+	std::condition_variable task_done;
+	bool stopping;
+
+	void worker();
+
+	void run(std::unique_lock<std::mutex> &lock);
+
+      public:
+	// 0 picks std::thread::hardware_concurrency().
+	explicit ThreadPool(unsigned int threads = 0);
+	~ThreadPool();
+
+	unsigned int size() const { return workers.size() + 1; }
+
+	void submit(Group *group, std::function<void()> fn);
+
+	void wait(Group *group);
+
+	// Calls fn(i) for every i in [0, count) and returns once all are done.
+	void parallelFor(size_t count, const std::function<void(size_t)> &fn);
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "uniform_block.hpp"
+#include "gl_state.hpp"
+#include <GL/glew.h>
+#include <cstdio>
+#include <cstring>
+
+uint32_t UniformBlock::bytes_uploaded = 0;
+
+int uniform_block_binding(const char *name) {
+	if (strcmp(name, "Camera") == 0) {
+		return UNIFORM_BLOCK_CAMERA;
+	}
+	if (strcmp(name, "Lights") == 0) {
+		return UNIFORM_BLOCK_LIGHTS;
+	}
+	if (strcmp(name, "Materials") == 0) {
+		return UNIFORM_BLOCK_MATERIALS;
+	}
+	return -1;
+}
+
+UniformBlock::UniformBlock(unsigned int binding, size_t size) {
+	this->shadow.assign(size, 0);
+	glGenBuffers(1, &this->ID);
+	gl_state_bind_buffer(GL_UNIFORM_BUFFER, this->ID);
+	glBufferData(GL_UNIFORM_BUFFER, size, this->shadow.data(),
+		     GL_DYNAMIC_DRAW);
+	gl_state_bind_buffer_base(GL_UNIFORM_BUFFER, binding, this->ID);
+}
+
+UniformBlock::~UniformBlock() {
+	glDeleteBuffers(1, &this->ID);
+	gl_state_forget(this->ID);
+}
+
+void UniformBlock::update(const void *data, size_t size, size_t offset) {
+	if (offset > this->shadow.size() ||
+	    size > this->shadow.size() - offset) {
+		fprintf(stderr,
+			"uniform block %u: %zu bytes at %zu past its %zu\n",
+			this->ID, size, offset, this->shadow.size());
+		return;
+	}
+	unsigned char *old = this->shadow.data() + offset;
+	if (memcmp(old, data, size) == 0) {
+		return;
+	}
+	memcpy(old, data, size);
+	gl_state_bind_buffer(GL_UNIFORM_BUFFER, this->ID);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	bytes_uploaded += size;
+}
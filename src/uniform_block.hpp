@@ -0,0 +1,84 @@
+#ifndef _UNIFORM_BLOCK_HPP
+#define _UNIFORM_BLOCK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Binding points of the blocks shared by all programs. BasicShader binds
+// the blocks a program declares by name when it links.
+#define UNIFORM_BLOCK_CAMERA 0
+#define UNIFORM_BLOCK_LIGHTS 1
+#define UNIFORM_BLOCK_MATERIALS 2
+
+// Entries of the Materials block, picked per draw by material_index.
+#define UNIFORM_BLOCK_MAX_MATERIALS 8
+
+// The structs below mirror the std140 blocks in the shaders. A vec3 starts
+// on 16 bytes, a float after it fills the gap.
+struct CameraBlock {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 camera_pos;
+	float pad;
+};
+
+struct LightBlock {
+	glm::vec3 position;
+	float pad0;
+	glm::vec3 ambient;
+	float pad1;
+	glm::vec3 diffuse;
+	float pad2;
+	glm::vec3 specular;
+	float pad3;
+};
+
+// light shades the scene; lightcube colors the cube drawn at its position.
+struct LightsBlock {
+	LightBlock light;
+	LightBlock lightcube;
+};
+
+struct MaterialBlock {
+	glm::vec3 ambient;
+	float pad0;
+	glm::vec3 diffuse;
+	float pad1;
+	glm::vec3 specular;
+	float shininess;
+};
+
+struct MaterialsBlock {
+	MaterialBlock materials[UNIFORM_BLOCK_MAX_MATERIALS];
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock is not std140");
+static_assert(sizeof(LightsBlock) == 128, "LightsBlock is not std140");
+static_assert(sizeof(MaterialsBlock) == 48 * UNIFORM_BLOCK_MAX_MATERIALS,
+	      "MaterialsBlock is not std140");
+
+// Binding point of the block called name, -1 if it is not one of the above.
+int uniform_block_binding(const char *name);
+
+// A uniform buffer bound to a fixed binding point. update skips the upload
+// when the range it writes is unchanged since the last one, so unchanged
+// blocks cost nothing.
+class UniformBlock {
+      private:
+	unsigned int ID;
+	std::vector<unsigned char> shadow; // contents of the buffer
+
+      public:
+	// Bytes uploaded by update since the caller last reset it.
+	static uint32_t bytes_uploaded;
+
+	UniformBlock(unsigned int binding, size_t size);
+	~UniformBlock();
+
+	// Writes outside the buffer are dropped with a message.
+	void update(const void *data, size_t size, size_t offset = 0);
+};
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef _VERTEX_LAYOUT_HPP
+#define _VERTEX_LAYOUT_HPP
+
+#include "mesh.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Attribute locations a layout may use, the minimum GL_MAX_VERTEX_ATTRIBS.
+#define VERTEX_MAX_LOCATIONS 16
+
+// Layouts are described from the vertex struct and built at compile time:
+//
+//	constexpr MeshLayout layout = vertex_layout<Vertex>({
+//	    VERTEX_ATTRIBUTE(Vertex, position, 0, false),
+//	    VERTEX_ATTRIBUTE(Vertex, normal, 1, false),
+//	});
+//	static_assert(vertex_layout_valid(layout), "Vertex layout");
+//
+// Components and their type come from the declaration of the member, the
+// stride from the struct. A layout describes one stream, the attributes read
+// from one buffer; a vertex array may combine several, see
+// gpu_vertex_array_create.
+
+template <typename T> struct VertexComponent;
+
+template <> struct VertexComponent<float> {
+	static constexpr uint32_t type = MESH_TYPE_FLOAT;
+};
+
+template <> struct VertexComponent<int16_t> {
+	static constexpr uint32_t type = MESH_TYPE_SHORT;
+};
+
+template <> struct VertexComponent<uint16_t> {
+	static constexpr uint32_t type = MESH_TYPE_UNSIGNED_SHORT;
+};
+
+template <> struct VertexComponent<uint32_t> {
+	static constexpr uint32_t type = MESH_TYPE_UNSIGNED_INT;
+};
+
+// Member is the type of a scalar or array member, e.g. float[3], or of a row
+// of a 2D array member.
+template <typename Member>
+constexpr MeshAttribute vertex_attribute(uint32_t location, size_t offset,
+					 bool normalized) {
+	typedef typename std::remove_reference<Member>::type Type;
+	typedef typename std::remove_all_extents<Type>::type Component;
+	static_assert(std::rank<Type>::value <= 1,
+		      "vertex attributes are scalars or 1D arrays");
+	constexpr uint32_t components =
+	    std::rank<Type>::value == 0 ? 1 : std::extent<Type>::value;
+	static_assert(components >= 1 && components <= 4,
+		      "vertex attributes have 1 to 4 components");
+	return {location, components, VertexComponent<Component>::type,
+		normalized ? 1u : 0u, (uint32_t)offset};
+}
+
+#define VERTEX_ATTRIBUTE(Vertex, member, location, normalized)                 \
+	vertex_attribute<decltype(Vertex::member)>(                            \
+	    location, offsetof(Vertex, member), normalized)
+
+template <typename Vertex, size_t N>
+constexpr MeshLayout vertex_layout(const MeshAttribute (&attributes)[N]) {
+	static_assert(N <= MESH_MAX_ATTRIBUTES, "too many vertex attributes");
+	static_assert(std::is_standard_layout<Vertex>::value,
+		      "offsetof needs a standard layout vertex");
+	MeshLayout layout = {};
+	layout.stride = sizeof(Vertex);
+	layout.attribute_count = N;
+	for (size_t i = 0; i < N; i++) {
+		layout.attributes[i] = attributes[i];
+	}
+	return layout;
+}
+
+// 0 for types a layout may not use.
+constexpr uint32_t vertex_component_size(uint32_t type) {
+	if (type == MESH_TYPE_FLOAT || type == MESH_TYPE_UNSIGNED_INT) {
+		return 4;
+	}
+	if (type == MESH_TYPE_SHORT || type == MESH_TYPE_UNSIGNED_SHORT) {
+		return 2;
+	}
+	return 0;
+}
+
+// True when every attribute has a known type, 1 to 4 components, an aligned
+// offset and lies within the stride, and no two attributes overlap or share
+// a location. Also checks layouts read from .mesh files.
+constexpr bool vertex_layout_valid(const MeshLayout &layout) {
+	if (layout.stride == 0 ||
+	    layout.attribute_count > MESH_MAX_ATTRIBUTES) {
+		return false;
+	}
+	for (uint32_t i = 0; i < layout.attribute_count; i++) {
+		const MeshAttribute &a = layout.attributes[i];
+		uint32_t size = vertex_component_size(a.type);
+		uint32_t end = a.offset + a.components * size;
+		if (size == 0 || a.components < 1 || a.components > 4 ||
+		    a.location >= VERTEX_MAX_LOCATIONS ||
+		    a.offset % size != 0 || end > layout.stride ||
+		    (a.type == MESH_TYPE_UNSIGNED_INT && a.normalized)) {
+			return false;
+		}
+		for (uint32_t j = 0; j < i; j++) {
+			const MeshAttribute &b = layout.attributes[j];
+			uint32_t b_size = vertex_component_size(b.type);
+			uint32_t b_end = b.offset + b.components * b_size;
+			if (a.location == b.location ||
+			    (a.offset < b_end && b.offset < end)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// True when streams of a and b can feed one vertex array.
+constexpr bool vertex_layouts_disjoint(const MeshLayout &a,
+				       const MeshLayout &b) {
+	for (uint32_t i = 0; i < a.attribute_count; i++) {
+		for (uint32_t j = 0; j < b.attribute_count; j++) {
+			if (a.attributes[i].location ==
+			    b.attributes[j].location) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// True when vertices of a can be read with layout b.
+constexpr bool vertex_layouts_equal(const MeshLayout &a, const MeshLayout &b) {
+	if (a.stride != b.stride || a.attribute_count != b.attribute_count) {
+		return false;
+	}
+	for (uint32_t i = 0; i < a.attribute_count; i++) {
+		const MeshAttribute &x = a.attributes[i];
+		const MeshAttribute &y = b.attributes[i];
+		if (x.location != y.location || x.components != y.components ||
+		    x.type != y.type || x.normalized != y.normalized ||
+		    x.offset != y.offset) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Positions only: the lightcube, Bezier control points, and the stream a
+// depth pass reads.
+struct PositionVertex {
+	float position[3];
+};
+
+// One vertex of Mesh::vertices, the inputs of vertex_phong.glsl.
+struct MeshVertex {
+	float position[3];
+	float normal[3];
+};
+
+// Per instance data of the INSTANCED lit shaders, at the locations after
+// MeshVertex's. The model matrix is affine, its last row is left out.
+struct InstanceData {
+	float model[3][4]; // rows
+	uint32_t material; // index into the Materials block
+};
+
+static_assert(sizeof(MeshVertex) == MESH_FLOATS_PER_VERTEX * sizeof(float),
+	      "MeshVertex layout");
+
+constexpr MeshLayout VERTEX_LAYOUT_POSITION = vertex_layout<PositionVertex>({
+    VERTEX_ATTRIBUTE(PositionVertex, position, 0, false),
+});
+
+constexpr MeshLayout VERTEX_LAYOUT_MESH = vertex_layout<MeshVertex>({
+    VERTEX_ATTRIBUTE(MeshVertex, position, 0, false),
+    VERTEX_ATTRIBUTE(MeshVertex, normal, 1, false),
+});
+
+constexpr MeshLayout VERTEX_LAYOUT_INSTANCE = vertex_layout<InstanceData>({
+    VERTEX_ATTRIBUTE(InstanceData, model[0], 2, false),
+    VERTEX_ATTRIBUTE(InstanceData, model[1], 3, false),
+    VERTEX_ATTRIBUTE(InstanceData, model[2], 4, false),
+    VERTEX_ATTRIBUTE(InstanceData, material, 5, false),
+});
+
+static_assert(vertex_layout_valid(VERTEX_LAYOUT_POSITION),
+	      "PositionVertex layout");
+static_assert(vertex_layout_valid(VERTEX_LAYOUT_MESH), "MeshVertex layout");
+static_assert(vertex_layout_valid(VERTEX_LAYOUT_INSTANCE),
+	      "InstanceData layout");
+static_assert(vertex_layouts_disjoint(VERTEX_LAYOUT_MESH,
+				      VERTEX_LAYOUT_INSTANCE),
+	      "InstanceData locations");
+
+#endif